@@ -32,7 +32,17 @@
 #include <vector>
 #include <memory>
 #include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
 #include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+constexpr char Assembler::legacy_registers[];
+constexpr Assembler::Encoding Assembler::encodings[Assembler::MN_MAX][Assembler::FORM_MAX];
+constexpr unsigned char Assembler::nops[9][9];
 
 static bool _is_number(const char &c)
 {
@@ -49,37 +59,169 @@ static bool _is_text_char(const char &c)
 
 void Assembler::assemble(
 		const std::string &p_input_file,
-		const std::string &p_output_file
+		const std::string &p_output_file,
+		const Options &p_options
 ) {
 	_generate_header();
-	_generate_program_header();
 
 	_generate_text(p_input_file);
 
-	text_program_header.p_filesz = text.size() * sizeof(unsigned char);
-	text_program_header.p_memsz = text.size() * sizeof(unsigned char);
+	/* the file ends with the last section, or the last segment */
+	unsigned int size = 0;
+	if (p_options.compile_only)
+	{
+		_generate_object();
+		size = header.e_shoff + header.e_shnum * sizeof(Elf64_Shdr);
+	}
+	else
+	{
+		_layout_executable();
+		_add_executable_sections();
+		size = header.e_shoff + header.e_shnum * sizeof(Elf64_Shdr);
+	}
+
+	int file = open(p_output_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0755);
+	if (file < 0)
+	{
+		_fail("could not open '" + p_output_file + "'");
+	}
+
+	/* build the image straight into the file */
+	if (p_options.mmap_output)
+	{
+		if (ftruncate(file, size) != 0)
+		{
+			_fail("could not resize '" + p_output_file + "'");
+		}
+
+		void *image = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if (image == MAP_FAILED)
+		{
+			_fail("could not map '" + p_output_file + "'");
+		}
+		_write_image((unsigned char *)image);
+		munmap(image, size);
+		close(file);
+		return;
+	}
+
+	std::vector<unsigned char> image(size);
+	_write_image(image.data());
+	if (write(file, image.data(), size) != (ssize_t)size)
+	{
+		_fail("could not write '" + p_output_file + "'");
+	}
+	close(file);
+}
+
+int Assembler::run(const std::string &p_input_file, const Options &p_options)
+{
+	_generate_header();
+
+	_generate_text(p_input_file);
+
+	/* the segments keep the executable's layout and all code is rip relative, so it runs at any address */
+	_layout_executable();
+
+	const Elf64_Phdr &last = program_headers.back();
+	unsigned long size = (last.p_vaddr - BASE_ADDR + last.p_memsz + PAGE_SIZE - 1) & ~(unsigned long)(PAGE_SIZE - 1);
+	void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED)
+	{
+		_fail("could not map memory to run the program");
+	}
+	unsigned char *image = (unsigned char *)mapping;
+
+	unsigned int segment = 0;
+	const unsigned int text_offset = header.e_entry - BASE_ADDR;
+	for (const std::vector<unsigned char> *section : {&text, &rodata, &data})
+	{
+		if (section == &text || !section->empty())
+		{
+			Elf64_Off start = program_headers[segment].p_offset + ((section == &text) ? text_offset : 0);
+			memcpy(image + start, section->data(), section->size());
+			segment++;
+		}
+	}
+
+	/* then the same permissions the kernel would give each segment, bss is already zero */
+	for (const Elf64_Phdr &program_header : program_headers)
+	{
+		int protection = PROT_READ;
+		protection |= (program_header.p_flags & PF_W) ? PROT_WRITE : 0;
+		protection |= (program_header.p_flags & PF_X) ? PROT_EXEC : 0;
+
+		unsigned long length = (program_header.p_memsz + PAGE_SIZE - 1) & ~(unsigned long)(PAGE_SIZE - 1);
+		if (mprotect(image + program_header.p_offset, length, protection) != 0)
+		{
+			_fail("could not protect the program's memory");
+		}
+	}
+
+	/* START SIZE name in hex, read by perf when it reports on this process */
+	if (p_options.perf_map)
+	{
+		std::ofstream map("/tmp/perf-" + std::to_string(getpid()) + ".map");
+		std::set<unsigned int> function_starts = _function_starts();
+		for (const std::string &name : globals)
+		{
+			if (!text_labels.count(name))
+			{
+				continue;
+			}
+
+			unsigned int offset = text_labels.at(name);
+			map << std::hex << (unsigned long)(image + text_offset + offset) << " ";
+			map << *function_starts.upper_bound(offset) - offset << std::dec << " " << name << "\n";
+		}
+	}
+
+	int (*entry)() = reinterpret_cast<int (*)()>(image + text_offset);
+	int result = entry();
 
-	std::ofstream file;
-	file.open(p_output_file);
+	munmap(mapping, size);
+	return result;
+}
 
-	file.write((char *)&header, sizeof(Elf64_Ehdr));
-	file.write((char *)&text_program_header, sizeof(Elf64_Phdr));
+void Assembler::_write_image(unsigned char *p_image)
+{
+	memcpy(p_image, &header, sizeof(Elf64_Ehdr));
 
-	for(unsigned int i=0; i< text.size(); ++i)
+	/* the loaded sections of an executable come from its segments, they hold no data of their own */
+	for (unsigned int i = 0; i < sections.size(); i++)
 	{
-		std::cout << std::hex << (int)text[i];
+		const Section &section = sections[i];
+		if (!section.data.empty())
+		{
+			memcpy(p_image + section.header.sh_offset, section.data.data(), section.data.size());
+		}
+		memcpy(p_image + header.e_shoff + i * sizeof(Elf64_Shdr), &section.header, sizeof(Elf64_Shdr));
 	}
 
-	for (const char opcode : text)
+	if (header.e_type == ET_REL)
 	{
-		file.write((const char *)&opcode, 1);
+		return;
 	}
 
-	file.close();
+	memcpy(p_image + header.e_phoff, program_headers.data(), program_headers.size() * sizeof(Elf64_Phdr));
+
+	/* the first segment also maps the headers, the rest start with their section */
+	unsigned int segment = 0;
+	const unsigned int text_offset = header.e_entry - BASE_ADDR;
+	for (const std::vector<unsigned char> *section : {&text, &rodata, &data})
+	{
+		if (section == &text || !section->empty())
+		{
+			Elf64_Off start = program_headers[segment].p_offset + ((section == &text) ? text_offset : 0);
+			memcpy(p_image + start, section->data(), section->size());
+			segment++;
+		}
+	}
 }
 
 void Assembler::_generate_header()
 {
+	header = Elf64_Ehdr();
 	header.e_ident[EI_MAG0] = ELFMAG0;
 	header.e_ident[EI_MAG1] = ELFMAG1;
 	header.e_ident[EI_MAG2] = ELFMAG2;
@@ -94,7 +236,7 @@ void Assembler::_generate_header()
 	header.e_type = ET_EXEC;
 	header.e_machine = EM_X86_64;
 	header.e_version = EV_CURRENT;
-	header.e_entry = TEXT_ADDR;
+	header.e_entry = 0;
 	header.e_phoff = sizeof(Elf64_Ehdr);
 	header.e_shoff = 0;
 	header.e_flags = 0;
@@ -106,25 +248,50 @@ void Assembler::_generate_header()
 	header.e_shstrndx = 0;
 }
 
-void Assembler::_generate_program_header()
-{
-	text_program_header.p_type = PT_LOAD;
-	text_program_header.p_offset = sizeof(Elf64_Ehdr) + sizeof(Elf64_Phdr);
-	text_program_header.p_vaddr = TEXT_ADDR;
-	text_program_header.p_paddr = 0;
-	text_program_header.p_filesz = 0;
-	text_program_header.p_memsz = 0;
-	text_program_header.p_flags = PF_R | PF_X;
-	text_program_header.p_align = 0;
+void Assembler::_push_program_header(
+		Elf64_Word p_flags,
+		Elf64_Off p_offset,
+		Elf64_Xword p_file_size,
+		Elf64_Xword p_memory_size
+) {
+	/* the file is laid out like memory, so every segment is mapped from a page of its own */
+	Elf64_Phdr program_header;
+	program_header.p_type = PT_LOAD;
+	program_header.p_flags = p_flags;
+	program_header.p_offset = p_offset;
+	program_header.p_vaddr = BASE_ADDR + p_offset;
+	program_header.p_paddr = BASE_ADDR + p_offset;
+	program_header.p_filesz = p_file_size;
+	program_header.p_memsz = p_memory_size;
+	program_header.p_align = PAGE_SIZE;
+	program_headers.push_back(program_header);
 }
 
 void Assembler::_generate_text(const std::string &p_input_file)
 {
 	_load_assembly(p_input_file);
-
-	std::unordered_map<std::string, unsigned char> label_addresses;
-	std::unordered_map<int, std::string> pending_addresses;
-	std::unordered_map<int, int> instruction_size; /* TODO: need to keep better track */
+	current_section = SECTION_TEXT;
+	section_alignments[SECTION_NULL] = 1;
+	section_alignments[SECTION_TEXT] = 16;
+	section_alignments[SECTION_DATA] = 8;
+	section_alignments[SECTION_BSS] = 8;
+	section_alignments[SECTION_RODATA] = 8;
+	bss_size = 0;
+	bss_labels.clear();
+
+	text.clear();
+	rodata.clear();
+	rodata_labels.clear();
+	data.clear();
+	data_labels.clear();
+	fixups.clear();
+	fragments.clear();
+	globals.clear();
+	source_file.clear();
+	line_rows.clear();
+
+	/* forward references are fixups, resolved in one pass once every label is known */
+	text_labels.clear();
 
 	Node node = _advance();
 	while (node.type != TK_EOF && node.type != TK_ERROR)
@@ -133,25 +300,25 @@ void Assembler::_generate_text(const std::string &p_input_file)
 		{
 			case TK_GLOB:
 			{
-				// TODO: implement
+				globals.insert(node.value);
 			} break;
 			case TK_IDENTIFIER:
 			{
-				if (!label_addresses.count(node.value))
+				if (current_section == SECTION_RODATA)
 				{
-					unsigned int address = text.size();
-					label_addresses[node.value] = address;
-
-					for (std::pair<int, std::string> jump : pending_addresses)
-					{
-						if (jump.second != node.value)
-						{
-							continue;
-						}
-
-						unsigned char relative_address = (text.size() - jump.first) - instruction_size[jump.first];
-						text[jump.first + 1] = ((relative_address) & 0xFF);
-					}
+					rodata_labels[node.value] = rodata.size();
+				}
+				else if (current_section == SECTION_DATA)
+				{
+					data_labels[node.value] = data.size();
+				}
+				else if (current_section == SECTION_BSS)
+				{
+					bss_labels[node.value] = bss_size;
+				}
+				else if (!text_labels.count(node.value))
+				{
+					text_labels[node.value] = text.size();
 				}
 
 				node = _advance();
@@ -161,75 +328,176 @@ void Assembler::_generate_text(const std::string &p_input_file)
 					_error("expected ':' but found '" + node.value + "'");
 				}
 			} break;
-			case TK_CMP:
+			case TK_DIRECTIVE:
 			{
-				node = _advance();
-				Argument source{node.type, node.value, 0};
-
-				/* skip comma */
-				node = _advance();
+				if (node.value == "section")
+				{
+					node = _advance();
+					if (node.type != TK_DIRECTIVE || (node.value != "text" && node.value != "data" && node.value != "rodata" && node.value != "bss"))
+					{
+						_error("unknown section '" + node.value + "'");
+					}
+					current_section = (node.value == "text") ? SECTION_TEXT : (node.value == "data") ? SECTION_DATA : (node.value == "rodata") ? SECTION_RODATA : SECTION_BSS;
+				}
+				else if (node.value == "text")
+				{
+					current_section = SECTION_TEXT;
+				}
+				else if (node.value == "data")
+				{
+					current_section = SECTION_DATA;
+				}
+				else if (current_section == SECTION_BSS && node.value != "zero" && node.value != "p2align")
+				{
+					_error("only .zero can go in .bss");
+				}
+				else if (node.value == "zero")
+				{
+					node = _advance();
+					if (node.type != TK_CONSTANT)
+					{
+						_error("expected constant but found '" + node.value + "'");
+					}
 
-				node = _advance();
-				Argument destination{node.type, node.value, 0};
+					unsigned int size = std::stoi(node.value);
+					if (current_section == SECTION_BSS)
+					{
+						bss_size += size;
+						break;
+					}
 
-				_push_opcode("cmp", source, destination);
-			} break;
-			case TK_TEST:
-			{
-				node = _advance();
-				Argument source{node.type, node.value, 0};
+					std::vector<unsigned char> &section = _section_data(current_section);
+					section.insert(section.end(), size, 0x00);
+				}
+				else if (node.value == "asciz")
+				{
+					node = _advance();
+					if (node.type != TK_STRING)
+					{
+						_error("expected string but found '" + node.value + "'");
+					}
 
-				/* skip comma */
-				node = _advance();
+					std::vector<unsigned char> &section = _section_data(current_section);
+					section.insert(section.end(), node.value.begin(), node.value.end());
+					section.push_back(0x00);
+				}
+				else if (node.value == "long")
+				{
+					/* a constant, or label - label, ie jump table entries */
+					std::vector<unsigned char> &section = _section_data(current_section);
+					Node symbol = _advance();
+					if (symbol.type == TK_CONSTANT)
+					{
+						_push_int(section, std::stoi(symbol.value));
+						break;
+					}
 
-				node = _advance();
-				Argument destination{node.type, node.value, 0};
+					if (_advance().type != TK_MINUS)
+					{
+						_error("expected '-' in .long");
+					}
+					Node base = _advance();
 
-				_push_opcode("test", source, destination);
-			} break;
-			case TK_CALL:
-			{
-				/* TODO: merge with JMP? */
-				std::string jump_type = node.value;
-				node = _advance();
+					_push_fixup(current_section, section.size(), symbol.value, base.value);
+					_push_int(section, 0);
+				}
+				else if (node.value == "file")
+				{
+					node = _advance();
+					if (node.type != TK_CONSTANT || _peek().type != TK_STRING)
+					{
+						_error("expected a file number and name after .file");
+					}
+					source_file = _advance().value;
+				}
+				else if (node.value == "loc")
+				{
+					node = _advance();
+					if (node.type != TK_CONSTANT || _peek().type != TK_CONSTANT)
+					{
+						_error("expected a file number and line after .loc");
+					}
 
-				if (label_addresses.count(node.value))
+					/* only the last line given for an address counts */
+					LineRow row{(unsigned int)text.size(), std::stoi(_advance().value)};
+					if (!line_rows.empty() && line_rows.back().offset == row.offset)
+					{
+						line_rows.pop_back();
+					}
+					line_rows.push_back(row);
+				}
+				else if (node.value == "p2align")
 				{
-					int relative_address = (label_addresses[node.value] - text.size()) - 5;
-					_push_opcode(jump_type);
-					_push_int(text, relative_address);
+					/* .p2align n or .p2align n,,max, the fill is always nops in text and zeros elsewhere */
+					node = _advance();
+					if (node.type != TK_CONSTANT || std::stoi(node.value) > 12)
+					{
+						_error("expected an alignment up to 12 but found '" + node.value + "'");
+					}
+
+					unsigned int alignment = 1u << std::stoi(node.value);
+					unsigned int max_skip = alignment - 1;
+					if (_peek().type == TK_COMMA)
+					{
+						_advance();
+						if (_advance().type != TK_COMMA)
+						{
+							_error("expected ',,' before the most to skip in .p2align");
+						}
+
+						node = _advance();
+						if (node.type != TK_CONSTANT)
+						{
+							_error("expected constant but found '" + node.value + "'");
+						}
+						max_skip = std::min((unsigned int)std::stoi(node.value), max_skip);
+					}
+					_align(alignment, max_skip);
 				}
 				else
 				{
-					pending_addresses[text.size()] = node.value;
-					instruction_size[text.size()] = 5;
-					Argument value{TK_CONSTANT, "0", 0};
-					_push_opcode(jump_type);
-					text.push_back(0x0);
-					text.push_back(0x0);
-					text.push_back(0x0);
-					text.push_back(0x0);
+					_error("unknown directive '." + node.value + "'");
 				}
 			} break;
+			case TK_CMP:
+			{
+				_push_binary(MN_CMP);
+			} break;
+			case TK_TEST:
+			{
+				_push_binary(MN_TEST);
+			} break;
+			case TK_CALL:
+			{
+				node = _advance();
+
+				/* always a fixup, branch relaxation can move the target */
+				_push_encoding(MN_CALL, FORM_D);
+				_push_fixup(SECTION_TEXT, text.size(), node.value, "", 0, true);
+				_push_int(text, 0);
+			} break;
 			case TK_JMP:
 			{
-				std::string jump_type = node.value;
+				Mnemonic mnemonic = (node.value == "jmp") ? MN_JMP : MN_JCC;
+				unsigned char condition = node.code;
 				node = _advance();
 
-				if (label_addresses.count(node.value))
-				{
-					char relative_address = (label_addresses[node.value] - text.size()) - 2;
-					_push_opcode(jump_type);
-					text.push_back(relative_address & 0xFF);
-				}
-				else
+				/* jmp *%reg, always 64 bit */
+				if (node.type == TK_STAR)
 				{
-					pending_addresses[text.size()] = node.value;
-					instruction_size[text.size()] = 2;
-					Argument value{TK_CONSTANT, "0", 0};
-					_push_opcode(jump_type);
-					text.push_back(0x0);
+					node = _advance();
+					if (mnemonic != MN_JMP || node.type != TK_REGISTER)
+					{
+						_error("expected 'jmp *%register'");
+					}
+					_push_encoding(MN_JMP, FORM_M, false, 0x00, Address{0, node.code, -1, 1, true});
+					break;
 				}
+
+				/* room is left for the rel32 form, the final encoding is picked by _relax_text */
+				Fragment branch{(unsigned int)text.size(), mnemonic, condition, node.value, false, (unsigned int)assembly_line, 0, 0, 0};
+				fragments.push_back(branch);
+				text.insert(text.end(), _fragment_size(branch, true), 0x00);
 			} break;
 			case TK_PUSH:
 			{
@@ -238,12 +506,12 @@ void Assembler::_generate_text(const std::string &p_input_file)
 				{
 					case TK_CONSTANT:
 					{
-						Argument value{node.type, node.value, 0};
-						_push_opcode("push_imm", value);
+						_push_encoding(MN_PUSH, FORM_I, false, 0x00, Address{0, -1, -1, 1, true}, true, std::stoi(node.value));
 					} break;
 					case TK_REGISTER:
 					{
-						_push_opcode("push_" + node.value);
+						/* always 64 bit, so no REX.W */
+						_push_encoding(MN_PUSH, FORM_O, false, node.code);
 					} break;
 					default:
 					{
@@ -258,223 +526,1356 @@ void Assembler::_generate_text(const std::string &p_input_file)
 				{
 					_error("expected register but found '" + node.value + "'");
 				}
-				_push_opcode("pop_" + node.value);
+				_push_encoding(MN_POP, FORM_O, false, node.code);
 			} break;
 			case TK_ADD:
+			{
+				_push_binary(MN_ADD);
+			} break;
+			case TK_SUB:
+			{
+				_push_binary(MN_SUB);
+			} break;
+			case TK_MUL:
+			{
+				node = _advance();
+				Argument source = _calulate_displacement_argument(node);
+
+				/* imul %src, edx:eax = eax * src */
+				if (_peek().type != TK_COMMA)
+				{
+					if (source.type != TK_REGISTER)
+					{
+						_error("expected register or memory but found '" + source.value + "'");
+					}
+					_push_encoding(MN_IMUL, FORM_M, _is_quad(source), 0x00, _argument_address(source));
+					break;
+				}
+
+				/* skip comma */
+				node = _advance();
+
+				node = _advance();
+				Argument destination = _calulate_displacement_argument(node);
+				if (destination.type != TK_REGISTER)
+				{
+					_error("expected register but found '" + destination.value + "'");
+				}
+
+				/* imul $imm,%src,%dest */
+				if (source.type == TK_CONSTANT)
+				{
+					/* skip comma */
+					node = _advance();
+
+					node = _advance();
+					if (node.type != TK_REGISTER)
+					{
+						_error("expected register but found '" + node.value + "'");
+					}
+
+					bool wide = node.op == OP_QUAD;
+					_push_encoding(MN_IMUL, FORM_RMI, wide, node.code, _argument_address(destination), true, std::stoi(source.value));
+					break;
+				}
+
+				/* imul %src,%dest */
+				if (destination.indirect)
+				{
+					_error("expected register but found '" + destination.value + "'");
+				}
+				bool wide = _is_quad(source) || _is_quad(destination);
+				_push_encoding(MN_IMUL, FORM_RM, wide, destination.reg, _argument_address(source));
+			} break;
+			case TK_SHL:
+			case TK_SAR:
+			case TK_SHR:
+			{
+				Mnemonic mnemonic = (node.type == TK_SHL) ? MN_SHL : (node.type == TK_SAR) ? MN_SAR : MN_SHR;
+				node = _advance();
+				if (node.type != TK_CONSTANT)
+				{
+					_error("expected constant but found '" + node.value + "'");
+				}
+				int count = std::stoi(node.value);
+
+				/* skip comma */
+				node = _advance();
+
+				node = _advance();
+				if (node.type != TK_REGISTER)
+				{
+					_error("expected register but found '" + node.value + "'");
+				}
+				_push_encoding(mnemonic, FORM_MI, node.op == OP_QUAD, 0x00, Address{0, node.code, -1, 1, true}, true, count & 0x3F);
+			} break;
+			case TK_ASM_AND:
+			{
+				_push_binary(MN_AND);
+			} break;
+			case TK_NEG:
+			case TK_DIV:
+			case TK_INC:
+			case TK_DEC:
+			{
+				Mnemonic mnemonic = MN_NEG;
+				switch (node.type)
+				{
+					case TK_DIV:
+					{
+						mnemonic = MN_IDIV;
+					} break;
+					case TK_INC:
+					{
+						mnemonic = MN_INC;
+					} break;
+					case TK_DEC:
+					{
+						mnemonic = MN_DEC;
+					} break;
+				}
+				Token size = node.op;
+				node = _advance();
+
+				/* label[+offset](%rip), ie counters */
+				if (node.type == TK_IDENTIFIER)
+				{
+					std::string symbol = node.value;
+					int addend = 0;
+					if (_peek().type == TK_PLUS)
+					{
+						_advance();
+						addend = std::stoi(_advance().value);
+					}
+
+					if (_advance().value != "rip")
+					{
+						_error("expected %rip after '" + symbol + "'");
+					}
+
+					_push_encoding(mnemonic, FORM_M, size == OP_QUAD, 0x00, Address{0, REG_RIP, -1, 1, false});
+					_push_fixup(SECTION_TEXT, text.size() - 4, symbol, "", addend);
+					break;
+				}
+
+				Argument argument = _calulate_displacement_argument(node);
+				if (argument.type != TK_REGISTER)
+				{
+					_error("expected register or memory but found '" + argument.value + "'");
+				}
+				bool wide = _is_quad(argument) || (argument.indirect && size == OP_QUAD);
+				_push_encoding(mnemonic, FORM_M, wide, 0x00, _argument_address(argument));
+			} break;
+			case TK_CLTD:
+			{
+				_push_encoding(MN_CLTD, FORM_ZO);
+			} break;
+			case TK_LEA:
+			{
+				_push_memory_operation(MN_LEA);
+			} break;
+			case TK_MOVSX:
+			{
+				if (node.value != "movslq")
+				{
+					_error("unsupported sign extension '" + node.value + "'");
+				}
+				_push_memory_operation(MN_MOVSXD);
+			} break;
+			case TK_SET:
+			{
+				unsigned char condition = node.code;
+				node = _advance();
+				if (node.type != TK_REGISTER || node.op != OP_BYTE)
+				{
+					_error("expected %al but found '" + node.value + "'");
+				}
+
+				/* the condition is part of the opcode, 0x0F 0x9X /0 */
+				const Encoding &encoding = encodings[MN_SET][FORM_M];
+				text.push_back(encoding.prefix);
+				text.push_back(encoding.opcode + condition);
+				_push_address(encoding.extension, Address{0, node.code, -1, 1, true});
+			} break;
+			case TK_MOVZX:
 			{
 				node = _advance();
-				Argument source{node.type, node.value, 0};
+				if (node.type != TK_REGISTER || node.op != OP_BYTE)
+				{
+					_error("expected %al but found '" + node.value + "'");
+				}
+				unsigned char rm = node.code;
 
 				/* skip comma */
 				node = _advance();
 
-				node = _advance();
-				Argument destination{node.type, node.value, 0};
+				node = _advance();
+				if (node.type != TK_REGISTER)
+				{
+					_error("expected register but found '" + node.value + "'");
+				}
+				_push_encoding(MN_MOVZX, FORM_RM, node.op == OP_QUAD, node.code, Address{0, rm, -1, 1, true});
+			} break;
+			case TK_MOV:
+			{
+				_push_binary(MN_MOV);
+			} break;
+			case TK_RET:
+			{
+				node = _advance();
+
+				_push_encoding(MN_RET, FORM_ZO);
+			} break;
+			case TK_SYSCALL:
+			{
+				node = _advance();
+
+				_push_encoding(MN_SYSCALL, FORM_ZO);
+			} break;
+		}
+
+		//std::cout << token_to_string.at(node.type) << " " << token_to_string.at(node.op) << " " << node.value << std::endl;
+		node = _advance();
+	}
+
+	_relax_text(text_labels);
+}
+
+void Assembler::_layout_executable()
+{
+	/*
+	 * Text, rodata and data each start on a page of their own, in the
+	 * file as well as in memory, so the kernel can map every segment
+	 * straight from the file with only the permissions it needs. Bss is
+	 * the zero filled tail of the data segment. Addresses are kept
+	 * relative to the start of text.
+	 */
+	bool writable = !data.empty() || bss_size > 0;
+	unsigned int segments = 1 + (rodata.empty() ? 0 : 1) + (writable ? 1 : 0);
+	unsigned int text_offset = sizeof(Elf64_Ehdr) + sizeof(Elf64_Phdr) * segments;
+	text_offset = (text_offset + section_alignments[SECTION_TEXT] - 1) & ~(section_alignments[SECTION_TEXT] - 1);
+	header.e_phnum = segments;
+	header.e_entry = BASE_ADDR + text_offset;
+
+	program_headers.clear();
+	_push_program_header(PF_R | PF_X, 0, text_offset + text.size(), text_offset + text.size());
+	unsigned long end = text_offset + text.size();
+
+	unsigned int rodata_base = 0;
+	if (!rodata.empty())
+	{
+		end = (end + PAGE_SIZE - 1) & ~(unsigned long)(PAGE_SIZE - 1);
+		_push_program_header(PF_R, end, rodata.size(), rodata.size());
+		rodata_base = end - text_offset;
+		end += rodata.size();
+	}
+
+	unsigned int data_base = 0;
+	unsigned int bss_base = 0;
+	if (writable)
+	{
+		end = (end + PAGE_SIZE - 1) & ~(unsigned long)(PAGE_SIZE - 1);
+		unsigned int data_size = (data.size() + section_alignments[SECTION_BSS] - 1) & ~(section_alignments[SECTION_BSS] - 1);
+		_push_program_header(PF_R | PF_W, end, data.size(), data_size + bss_size);
+		data_base = end - text_offset;
+		bss_base = data_base + data_size;
+	}
+
+	std::unordered_map<std::string, unsigned int> label_addresses = text_labels;
+	const std::pair<const std::unordered_map<std::string, unsigned int> *, unsigned int> label_sections[] = {
+		{&rodata_labels, rodata_base},
+		{&data_labels, data_base},
+		{&bss_labels, bss_base}
+	};
+	for (const std::pair<const std::unordered_map<std::string, unsigned int> *, unsigned int> &section : label_sections)
+	{
+		for (const std::pair<const std::string, unsigned int> &label : *section.first)
+		{
+			if (label_addresses.count(label.first))
+			{
+				_error("label '" + label.first + "' is defined twice");
+			}
+			label_addresses[label.first] = section.second + label.second;
+		}
+	}
+
+	/* report every symbol that is never defined, where it was first used */
+	std::set<std::string> undefined;
+	for (const Fixup &fixup : fixups)
+	{
+		for (const std::string &symbol : {fixup.symbol, fixup.base})
+		{
+			if (!symbol.empty() && !label_addresses.count(symbol) && !undefined.count(symbol))
+			{
+				undefined.insert(symbol);
+				_report(fixup.line, "undefined symbol '" + symbol + "'");
+			}
+		}
+	}
+
+	if (!undefined.empty())
+	{
+		exit(0);
+	}
+
+	for (const Fixup &fixup : fixups)
+	{
+		std::vector<unsigned char> &section = _section_data(fixup.section);
+		if (fixup.base.empty())
+		{
+			unsigned int base = (fixup.section == SECTION_RODATA) ? rodata_base : (fixup.section == SECTION_DATA) ? data_base : 0;
+			_set_int(section, fixup.offset, label_addresses[fixup.symbol] + fixup.addend - (base + fixup.offset + 4));
+			continue;
+		}
+		_set_int(section, fixup.offset, label_addresses[fixup.symbol] - label_addresses[fixup.base]);
+	}
+}
+
+void Assembler::_add_executable_sections()
+{
+	/*
+	 * Nothing loads these, they are there for perf and gdb. Every
+	 * function goes in the symbol table and, when there were .loc
+	 * lines, DWARF maps the code back to the source.
+	 */
+	sections.clear();
+	section_names.assign(1, 0x00);
+
+	unsigned long text_address = header.e_entry;
+	_add_section("", SHT_NULL, 0, std::vector<unsigned char>(), 0);
+	unsigned int text_section = _add_section(".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, std::vector<unsigned char>(), section_alignments[SECTION_TEXT]);
+	sections[text_section].header.sh_addr = text_address;
+	sections[text_section].header.sh_size = text.size();
+
+	unsigned int segment = 1;
+	if (!rodata.empty())
+	{
+		unsigned int index = _add_section(".rodata", SHT_PROGBITS, SHF_ALLOC, std::vector<unsigned char>(), section_alignments[SECTION_RODATA]);
+		sections[index].header.sh_addr = program_headers[segment++].p_vaddr;
+		sections[index].header.sh_size = rodata.size();
+	}
+
+	if (!data.empty())
+	{
+		unsigned int index = _add_section(".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, std::vector<unsigned char>(), section_alignments[SECTION_DATA]);
+		sections[index].header.sh_addr = program_headers[segment].p_vaddr;
+		sections[index].header.sh_size = data.size();
+	}
+
+	if (bss_size > 0)
+	{
+		const Elf64_Phdr &program_header = program_headers[segment];
+		unsigned int index = _add_section(".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE, std::vector<unsigned char>(), section_alignments[SECTION_BSS]);
+		sections[index].header.sh_addr = program_header.p_vaddr + program_header.p_memsz - bss_size;
+		sections[index].header.sh_size = bss_size;
+	}
+
+	for (Section &section : sections)
+	{
+		if (section.header.sh_flags & SHF_ALLOC)
+		{
+			section.header.sh_offset = section.header.sh_addr - BASE_ADDR;
+		}
+	}
+
+	std::set<unsigned int> function_starts = _function_starts();
+	std::vector<unsigned char> strings(1, 0x00);
+	std::vector<unsigned char> symbol_table(sizeof(Elf64_Sym), 0x00);
+	for (const std::string &name : globals)
+	{
+		if (!text_labels.count(name))
+		{
+			continue;
+		}
+
+		unsigned int offset = text_labels.at(name);
+		Elf64_Sym symbol{};
+		symbol.st_name = strings.size();
+		symbol.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+		symbol.st_shndx = text_section;
+		symbol.st_value = text_address + offset;
+		symbol.st_size = *function_starts.upper_bound(offset) - offset;
+
+		strings.insert(strings.end(), name.begin(), name.end());
+		strings.push_back(0x00);
+		const unsigned char *bytes = (const unsigned char *)&symbol;
+		symbol_table.insert(symbol_table.end(), bytes, bytes + sizeof(Elf64_Sym));
+	}
+
+	unsigned int symbol_section = _add_section(".symtab", SHT_SYMTAB, 0, symbol_table, 8, sizeof(Elf64_Sym));
+	sections[symbol_section].header.sh_link = symbol_section + 1;
+	sections[symbol_section].header.sh_info = 1;
+	_add_section(".strtab", SHT_STRTAB, 0, strings, 1);
+
+	if (!line_rows.empty())
+	{
+		_generate_debug_sections(text_address);
+		_add_section(".debug_abbrev", SHT_PROGBITS, 0, debug_abbrev, 1);
+		_add_section(".debug_info", SHT_PROGBITS, 0, debug_info, 1);
+		_add_section(".debug_line", SHT_PROGBITS, 0, debug_line, 1);
+	}
+
+	header.e_shstrndx = _add_section(".shstrtab", SHT_STRTAB, 0, std::vector<unsigned char>(), 1);
+	sections[header.e_shstrndx].data = section_names;
+	sections[header.e_shstrndx].header.sh_size = section_names.size();
+
+	/* after the last segment */
+	unsigned long offset = program_headers.back().p_offset + program_headers.back().p_filesz;
+	for (Section &section : sections)
+	{
+		if (section.header.sh_type == SHT_NULL || (section.header.sh_flags & SHF_ALLOC))
+		{
+			continue;
+		}
+
+		unsigned long align = std::max(section.header.sh_addralign, (Elf64_Xword)1);
+		offset = (offset + align - 1) & ~(align - 1);
+		section.header.sh_offset = offset;
+		offset += section.data.size();
+	}
+	header.e_shoff = (offset + 7) & ~7ul;
+	header.e_shnum = sections.size();
+}
+
+Assembler::DebugFields Assembler::_generate_debug_sections(unsigned long p_text_address)
+{
+	/*
+	 * A single compile unit covering text, with no children, and its
+	 * line table. The line table only has the rows from .loc, anything
+	 * before the first one, ie _start, is not covered.
+	 */
+	DebugFields fields;
+	char directory[4096];
+	std::string comp_dir = (getcwd(directory, sizeof(directory)) != nullptr) ? directory : "";
+
+	const unsigned char abbreviations[] = {
+		DW_AT_PRODUCER, DW_FORM_STRING,
+		DW_AT_LANGUAGE, DW_FORM_DATA1,
+		DW_AT_NAME, DW_FORM_STRING,
+		DW_AT_COMP_DIR, DW_FORM_STRING,
+		DW_AT_LOW_PC, DW_FORM_ADDR,
+		DW_AT_HIGH_PC, DW_FORM_DATA8,
+		DW_AT_STMT_LIST, DW_FORM_SEC_OFFSET,
+		0, 0
+	};
+	debug_abbrev.clear();
+	_push_uleb128(debug_abbrev, 1);
+	_push_uleb128(debug_abbrev, DW_TAG_COMPILE_UNIT);
+	debug_abbrev.push_back(0x00);
+	debug_abbrev.insert(debug_abbrev.end(), abbreviations, abbreviations + sizeof(abbreviations));
+	debug_abbrev.push_back(0x00);
+
+	/* the unit lengths are filled in once the rest is there */
+	debug_info.clear();
+	_push_int(debug_info, 0);
+	_push_value(debug_info, 4, 2);
+	fields.abbrev_offset = debug_info.size();
+	_push_int(debug_info, 0);
+	debug_info.push_back(8);
+	_push_uleb128(debug_info, 1);
+	_push_string(debug_info, "pcc");
+	debug_info.push_back(DW_LANG_C89);
+	for (const std::string &name : {source_file, comp_dir})
+	{
+		_push_string(debug_info, name);
+	}
+	fields.low_pc = debug_info.size();
+	_push_value(debug_info, p_text_address, 8);
+	_push_value(debug_info, text.size(), 8);
+	fields.stmt_list = debug_info.size();
+	_push_int(debug_info, 0);
+	_set_int(debug_info, 0, debug_info.size() - 4);
+
+	const unsigned char standard_opcode_lengths[] = {0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1};
+	debug_line.clear();
+	_push_int(debug_line, 0);
+	_push_value(debug_line, 4, 2);
+	_push_int(debug_line, 0);
+	unsigned int header_start = debug_line.size();
+	debug_line.push_back(1);
+	debug_line.push_back(1);
+	debug_line.push_back(1);
+	debug_line.push_back(line_base);
+	debug_line.push_back(line_range);
+	debug_line.push_back(opcode_base);
+	debug_line.insert(debug_line.end(), standard_opcode_lengths, standard_opcode_lengths + sizeof(standard_opcode_lengths));
+
+	/* no include directories, then the one file in the compilation directory */
+	debug_line.push_back(0x00);
+	_push_string(debug_line, source_file);
+	debug_line.insert(debug_line.end(), {0x00, 0x00, 0x00, 0x00});
+	_set_int(debug_line, header_start - 4, debug_line.size() - header_start);
+
+	debug_line.insert(debug_line.end(), {0x00, 9, DW_LNE_SET_ADDRESS});
+	fields.set_address = debug_line.size();
+	_push_value(debug_line, p_text_address, 8);
+
+	unsigned int address = 0;
+	int line = 1;
+	for (const LineRow &row : line_rows)
+	{
+		unsigned int address_advance = row.offset - address;
+		int line_advance = row.line - line;
+		int special = (line_advance - line_base) + line_range * address_advance + opcode_base;
+		if (line_advance >= line_base && line_advance < line_base + line_range && special <= 255)
+		{
+			debug_line.push_back(special);
+		}
+		else
+		{
+			if (line_advance != 0)
+			{
+				debug_line.push_back(DW_LNS_ADVANCE_LINE);
+				_push_sleb128(debug_line, line_advance);
+			}
+			if (address_advance != 0)
+			{
+				debug_line.push_back(DW_LNS_ADVANCE_PC);
+				_push_uleb128(debug_line, address_advance);
+			}
+			debug_line.push_back(DW_LNS_COPY);
+		}
+		address = row.offset;
+		line = row.line;
+	}
+
+	debug_line.push_back(DW_LNS_ADVANCE_PC);
+	_push_uleb128(debug_line, text.size() - address);
+	debug_line.insert(debug_line.end(), {0x00, 1, DW_LNE_END_SEQUENCE});
+	_set_int(debug_line, 0, debug_line.size() - 4);
+	return fields;
+}
+
+std::set<unsigned int> Assembler::_function_starts()
+{
+	/* functions run up to the next global in text */
+	std::set<unsigned int> starts;
+	for (const std::string &name : globals)
+	{
+		if (text_labels.count(name))
+		{
+			starts.insert(text_labels.at(name));
+		}
+	}
+	starts.insert(text.size());
+	return starts;
+}
+
+void Assembler::_generate_object()
+{
+	/*
+	 * The sections are kept apart. References within a section are
+	 * resolved here, everything else becomes a relocation against the
+	 * section symbol, or the symbol itself when it is global or undefined.
+	 */
+	header.e_type = ET_REL;
+	header.e_phoff = 0;
+	header.e_phnum = 0;
+	header.e_phentsize = 0;
+	sections.clear();
+	section_names.assign(1, 0x00);
+
+	/* the section symbols share their index with the section */
+	std::vector<Elf64_Sym> symbols(1, Elf64_Sym{});
+	for (unsigned int section = SECTION_TEXT; section <= SECTION_RODATA; section++)
+	{
+		symbols.push_back(Elf64_Sym{0, ELF64_ST_INFO(STB_LOCAL, STT_SECTION), 0, (Elf64_Section)section, 0, 0});
+	}
+
+	/* the debug info refers to the other debug sections by offset, which the linker moves */
+	unsigned int abbrev_symbol = symbols.size();
+	unsigned int line_symbol = abbrev_symbol + 1;
+	if (!line_rows.empty())
+	{
+		symbols.push_back(Elf64_Sym{0, ELF64_ST_INFO(STB_LOCAL, STT_SECTION), 0, SECTION_DEBUG_ABBREV, 0, 0});
+		symbols.push_back(Elf64_Sym{0, ELF64_ST_INFO(STB_LOCAL, STT_SECTION), 0, SECTION_DEBUG_LINE, 0, 0});
+	}
+	unsigned int first_global = symbols.size();
+
+	/* globals, and anything used but not defined */
+	std::set<std::string> names(globals.begin(), globals.end());
+	for (const Fixup &fixup : fixups)
+	{
+		for (const std::string &symbol : {fixup.symbol, fixup.base})
+		{
+			unsigned int section;
+			unsigned int offset;
+			if (!symbol.empty() && !_find_label(symbol, section, offset))
+			{
+				names.insert(symbol);
+			}
+		}
+	}
+
+	std::set<unsigned int> function_starts = _function_starts();
+
+	std::vector<unsigned char> strings(1, 0x00);
+	std::unordered_map<std::string, unsigned int> symbol_indices;
+	for (const std::string &name : names)
+	{
+		unsigned int section = SHN_UNDEF;
+		unsigned int offset = 0;
+		_find_label(name, section, offset);
+
+		Elf64_Sym symbol{};
+		symbol.st_name = strings.size();
+		symbol.st_info = ELF64_ST_INFO(STB_GLOBAL, (section == SECTION_TEXT) ? STT_FUNC : (section == SHN_UNDEF) ? STT_NOTYPE : STT_OBJECT);
+		symbol.st_shndx = section;
+		symbol.st_value = offset;
+		if (section == SECTION_TEXT)
+		{
+			symbol.st_size = *function_starts.upper_bound(offset) - offset;
+		}
+
+		strings.insert(strings.end(), name.begin(), name.end());
+		strings.push_back(0x00);
+		symbol_indices[name] = symbols.size();
+		symbols.push_back(symbol);
+	}
+
+	std::vector<Elf64_Rela> text_relocations;
+	std::vector<Elf64_Rela> data_relocations;
+	std::vector<Elf64_Rela> rodata_relocations;
+	for (const Fixup &fixup : fixups)
+	{
+		unsigned int section = fixup.section;
+		std::vector<unsigned char> &contents = _section_data(section);
+
+		unsigned int symbol_section = SHN_UNDEF;
+		unsigned int symbol_offset = 0;
+		_find_label(fixup.symbol, symbol_section, symbol_offset);
+
+		int addend = fixup.addend;
+		if (fixup.base.empty())
+		{
+			if (symbol_section == section)
+			{
+				_set_int(contents, fixup.offset, symbol_offset + addend - (fixup.offset + 4));
+				continue;
+			}
+
+			/* relative to the end of the field */
+			addend -= 4;
+		}
+		else
+		{
+			unsigned int base_section = SHN_UNDEF;
+			unsigned int base_offset = 0;
+			_find_label(fixup.base, base_section, base_offset);
+			if (base_section != SHN_UNDEF && base_section == symbol_section)
+			{
+				_set_int(contents, fixup.offset, symbol_offset - base_offset);
+				continue;
+			}
+
+			if (base_section != section)
+			{
+				_report(fixup.line, "can not relocate '" + fixup.symbol + "-" + fixup.base + "'");
+				exit(0);
+			}
+
+			/* S - B as S + A - P, where P is the field itself */
+			addend += fixup.offset - base_offset;
+		}
+
+		unsigned int symbol = symbol_section;
+		if (symbol_indices.count(fixup.symbol))
+		{
+			symbol = symbol_indices.at(fixup.symbol);
+		}
+		else
+		{
+			addend += symbol_offset;
+		}
+
+		Elf64_Rela relocation;
+		relocation.r_offset = fixup.offset;
+		relocation.r_info = ELF64_R_INFO(symbol, fixup.call ? R_X86_64_PLT32 : R_X86_64_PC32);
+		relocation.r_addend = addend;
+		if (section == SECTION_TEXT)
+		{
+			text_relocations.push_back(relocation);
+		}
+		else
+		{
+			((section == SECTION_DATA) ? data_relocations : rodata_relocations).push_back(relocation);
+		}
+	}
+
+	std::vector<unsigned char> symbol_table;
+	for (const Elf64_Sym &symbol : symbols)
+	{
+		const unsigned char *bytes = (const unsigned char *)&symbol;
+		symbol_table.insert(symbol_table.end(), bytes, bytes + sizeof(Elf64_Sym));
+	}
+
+	_add_section("", SHT_NULL, 0, std::vector<unsigned char>(), 0);
+	_add_section(".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, text, section_alignments[SECTION_TEXT]);
+	_add_section(".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, data, section_alignments[SECTION_DATA]);
+	_add_section(".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE, std::vector<unsigned char>(), section_alignments[SECTION_BSS]);
+	sections[SECTION_BSS].header.sh_size = bss_size;
+	_add_section(".rodata", SHT_PROGBITS, SHF_ALLOC, rodata, section_alignments[SECTION_RODATA]);
+
+	_add_section(".symtab", SHT_SYMTAB, 0, symbol_table, 8, sizeof(Elf64_Sym));
+	sections[SECTION_SYMTAB].header.sh_link = SECTION_STRTAB;
+	sections[SECTION_SYMTAB].header.sh_info = first_global;
+	_add_section(".strtab", SHT_STRTAB, 0, strings, 1);
+
+	std::vector<Elf64_Rela> info_relocations;
+	std::vector<Elf64_Rela> line_relocations;
+	if (!line_rows.empty())
+	{
+		DebugFields fields = _generate_debug_sections(0);
+		_add_section(".debug_abbrev", SHT_PROGBITS, 0, debug_abbrev, 1);
+		_add_section(".debug_info", SHT_PROGBITS, 0, debug_info, 1);
+		_add_section(".debug_line", SHT_PROGBITS, 0, debug_line, 1);
+
+		info_relocations.push_back(Elf64_Rela{fields.abbrev_offset, ELF64_R_INFO(abbrev_symbol, R_X86_64_32), 0});
+		info_relocations.push_back(Elf64_Rela{fields.low_pc, ELF64_R_INFO(SECTION_TEXT, R_X86_64_64), 0});
+		info_relocations.push_back(Elf64_Rela{fields.stmt_list, ELF64_R_INFO(line_symbol, R_X86_64_32), 0});
+		line_relocations.push_back(Elf64_Rela{fields.set_address, ELF64_R_INFO(SECTION_TEXT, R_X86_64_64), 0});
+	}
+
+	const std::pair<unsigned int, std::vector<Elf64_Rela> *> relocations[] = {
+		{SECTION_TEXT, &text_relocations},
+		{SECTION_DATA, &data_relocations},
+		{SECTION_RODATA, &rodata_relocations},
+		{SECTION_DEBUG_INFO, &info_relocations},
+		{SECTION_DEBUG_LINE, &line_relocations}
+	};
+	for (const std::pair<unsigned int, std::vector<Elf64_Rela> *> &target : relocations)
+	{
+		if (target.second->empty())
+		{
+			continue;
+		}
+
+		const unsigned char *bytes = (const unsigned char *)target.second->data();
+		std::vector<unsigned char> data(bytes, bytes + target.second->size() * sizeof(Elf64_Rela));
+		unsigned int index = _add_section(".rela" + _section_name(target.first), SHT_RELA, SHF_INFO_LINK, data, 8, sizeof(Elf64_Rela));
+		sections[index].header.sh_link = SECTION_SYMTAB;
+		sections[index].header.sh_info = target.first;
+	}
+
+	/* the stack does not need to be executable */
+	_add_section(".note.GNU-stack", SHT_PROGBITS, 0, std::vector<unsigned char>(), 1);
+
+	/* its own name has to be in it, so it is filled in last */
+	header.e_shstrndx = _add_section(".shstrtab", SHT_STRTAB, 0, std::vector<unsigned char>(), 1);
+	sections[header.e_shstrndx].data = section_names;
+	sections[header.e_shstrndx].header.sh_size = section_names.size();
+
+	unsigned long offset = sizeof(Elf64_Ehdr);
+	for (Section &section : sections)
+	{
+		if (section.header.sh_type == SHT_NULL)
+		{
+			continue;
+		}
+
+		unsigned long align = std::max(section.header.sh_addralign, (Elf64_Xword)1);
+		offset = (offset + align - 1) & ~(align - 1);
+		section.header.sh_offset = offset;
+		if (section.header.sh_type != SHT_NOBITS)
+		{
+			offset += section.data.size();
+		}
+	}
+	header.e_shoff = (offset + 7) & ~7ul;
+	header.e_shnum = sections.size();
+}
+
+unsigned int Assembler::_add_section(
+		const std::string &p_name,
+		Elf64_Word p_type,
+		Elf64_Xword p_flags,
+		const std::vector<unsigned char> &p_data,
+		Elf64_Xword p_align,
+		Elf64_Xword p_entry_size
+) {
+	Section section;
+	section.header = Elf64_Shdr{};
+	section.header.sh_name = p_name.empty() ? 0 : section_names.size();
+	section.header.sh_type = p_type;
+	section.header.sh_flags = p_flags;
+	section.header.sh_size = p_data.size();
+	section.header.sh_addralign = p_align;
+	section.header.sh_entsize = p_entry_size;
+	section.data = p_data;
+
+	if (!p_name.empty())
+	{
+		section_names.insert(section_names.end(), p_name.begin(), p_name.end());
+		section_names.push_back(0x00);
+	}
+	sections.push_back(section);
+	return sections.size() - 1;
+}
+
+std::string Assembler::_section_name(unsigned int p_section)
+{
+	switch (p_section)
+	{
+		case SECTION_TEXT:
+		{
+			return ".text";
+		} break;
+		case SECTION_DATA:
+		{
+			return ".data";
+		} break;
+		case SECTION_RODATA:
+		{
+			return ".rodata";
+		} break;
+		case SECTION_DEBUG_INFO:
+		{
+			return ".debug_info";
+		} break;
+		case SECTION_DEBUG_LINE:
+		{
+			return ".debug_line";
+		} break;
+	}
+	return "";
+}
+
+std::vector<unsigned char> &Assembler::_section_data(unsigned int p_section)
+{
+	switch (p_section)
+	{
+		case SECTION_DATA:
+		{
+			return data;
+		} break;
+		case SECTION_RODATA:
+		{
+			return rodata;
+		} break;
+	}
+	return text;
+}
+
+bool Assembler::_find_label(const std::string &p_name, unsigned int &r_section, unsigned int &r_offset)
+{
+	if (text_labels.count(p_name))
+	{
+		r_section = SECTION_TEXT;
+		r_offset = text_labels.at(p_name);
+		return true;
+	}
+
+	if (rodata_labels.count(p_name))
+	{
+		r_section = SECTION_RODATA;
+		r_offset = rodata_labels.at(p_name);
+		return true;
+	}
+
+	if (data_labels.count(p_name))
+	{
+		r_section = SECTION_DATA;
+		r_offset = data_labels.at(p_name);
+		return true;
+	}
+
+	if (bss_labels.count(p_name))
+	{
+		r_section = SECTION_BSS;
+		r_offset = bss_labels.at(p_name);
+		return true;
+	}
+	return false;
+}
+
+void Assembler::_align(unsigned int p_alignment, unsigned int p_max_skip)
+{
+	section_alignments[current_section] = std::max(section_alignments[current_section], p_alignment);
+	if (current_section == SECTION_TEXT)
+	{
+		/* text moves once the branches are relaxed, so the padding is worked out then */
+		Fragment alignment{(unsigned int)text.size(), MN_MAX, 0, "", false, (unsigned int)assembly_line, p_alignment, p_max_skip, 0};
+		fragments.push_back(alignment);
+		text.insert(text.end(), _fragment_size(alignment, true), 0x00);
+		return;
+	}
+
+	unsigned int size = (current_section == SECTION_BSS) ? bss_size : _section_data(current_section).size();
+	unsigned int padding = (p_alignment - size % p_alignment) % p_alignment;
+	if (padding > p_max_skip)
+	{
+		return;
+	}
+
+	if (current_section == SECTION_BSS)
+	{
+		bss_size += padding;
+		return;
+	}
+	_section_data(current_section).insert(_section_data(current_section).end(), padding, 0x00);
+}
+
+void Assembler::_relax_text(std::unordered_map<std::string, unsigned int> &r_label_addresses)
+{
+	/*
+	 * Every branch to a text label starts out as rel8, any that can no
+	 * longer reach are grown to rel32 and everything measured again.
+	 * Branches only ever grow and the padding only depends on which
+	 * have, so this stops once nothing changes. Anything else, ie
+	 * undefined symbols, stays rel32 and goes through a fixup.
+	 */
+	std::vector<unsigned int> offsets;
+	for (Fragment &fragment : fragments)
+	{
+		offsets.push_back(fragment.offset);
+		fragment.rel8 = fragment.alignment == 0 && r_label_addresses.count(fragment.target);
+	}
+
+	/* removed[i] is how many of the reserved bytes the fragments before fragment i gave back */
+	std::vector<unsigned int> removed(fragments.size() + 1, 0);
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (unsigned int i = 0; i < fragments.size(); i++)
+		{
+			Fragment &fragment = fragments[i];
+			if (fragment.alignment != 0)
+			{
+				unsigned int address = fragment.offset - removed[i];
+				fragment.padding = (fragment.alignment - address % fragment.alignment) % fragment.alignment;
+				if (fragment.padding > fragment.max_skip)
+				{
+					fragment.padding = 0;
+				}
+			}
+			removed[i + 1] = removed[i] + _fragment_size(fragment, true) - _fragment_size(fragment, false);
+		}
+
+		for (unsigned int i = 0; i < fragments.size(); i++)
+		{
+			Fragment &branch = fragments[i];
+			if (!branch.rel8)
+			{
+				continue;
+			}
+
+			int target = _relaxed_address(offsets, removed, r_label_addresses[branch.target]);
+			int next = (branch.offset - removed[i]) + _fragment_size(branch, false);
+			if (target - next < -128 || target - next > 127)
+			{
+				branch.rel8 = false;
+				changed = true;
+			}
+		}
+	}
+
+	for (std::pair<const std::string, unsigned int> &label : r_label_addresses)
+	{
+		label.second = _relaxed_address(offsets, removed, label.second);
+	}
+
+	for (Fixup &fixup : fixups)
+	{
+		if (fixup.section == SECTION_TEXT)
+		{
+			fixup.offset = _relaxed_address(offsets, removed, fixup.offset);
+		}
+	}
+
+	for (LineRow &row : line_rows)
+	{
+		row.offset = _relaxed_address(offsets, removed, row.offset);
+	}
+
+	std::vector<unsigned char> relaxed;
+	relaxed.reserve(text.size());
+	unsigned int start = 0;
+	for (const Fragment &fragment : fragments)
+	{
+		relaxed.insert(relaxed.end(), text.begin() + start, text.begin() + fragment.offset);
+		start = fragment.offset + _fragment_size(fragment, true);
+
+		if (fragment.alignment != 0)
+		{
+			_push_nops(relaxed, fragment.padding);
+			continue;
+		}
+
+		/* the condition, if any, is part of the opcode */
+		const Encoding &encoding = encodings[fragment.mnemonic][FORM_D];
+		if (fragment.rel8)
+		{
+			int next = relaxed.size() + _fragment_size(fragment, false);
+			relaxed.push_back(encoding.short_opcode + fragment.condition);
+			relaxed.push_back((r_label_addresses[fragment.target] - next) & 0xFF);
+			continue;
+		}
+
+		if (encoding.prefix != 0x00)
+		{
+			relaxed.push_back(encoding.prefix);
+		}
+		relaxed.push_back(encoding.opcode + fragment.condition);
+		fixups.push_back({SECTION_TEXT, (unsigned int)relaxed.size(), fragment.target, "", 0, true, fragment.line});
+		_push_int(relaxed, 0);
+	}
+	relaxed.insert(relaxed.end(), text.begin() + start, text.end());
+	text.swap(relaxed);
+}
+
+unsigned int Assembler::_relaxed_address(
+		const std::vector<unsigned int> &p_offsets,
+		const std::vector<unsigned int> &p_removed,
+		unsigned int p_address
+) {
+	/* only fragments that start before the address move it */
+	unsigned int before = std::lower_bound(p_offsets.begin(), p_offsets.end(), p_address) - p_offsets.begin();
+	return p_address - p_removed[before];
+}
+
+unsigned int Assembler::_fragment_size(const Fragment &p_fragment, bool p_reserved)
+{
+	if (p_fragment.alignment != 0)
+	{
+		return p_reserved ? std::min(p_fragment.alignment - 1, p_fragment.max_skip) : p_fragment.padding;
+	}
+
+	if (!p_reserved && p_fragment.rel8)
+	{
+		return 2;
+	}
+	return (encodings[p_fragment.mnemonic][FORM_D].prefix != 0x00) ? 6 : 5;
+}
+
+void Assembler::_push_nops(std::vector<unsigned char> &p_vector, unsigned int p_size)
+{
+	while (p_size > 0)
+	{
+		unsigned int size = std::min(p_size, 9u);
+		p_vector.insert(p_vector.end(), nops[size - 1], nops[size - 1] + size);
+		p_size -= size;
+	}
+}
+
+bool Assembler::_is_quad(const Argument &p_argument)
+{
+	return p_argument.type == TK_REGISTER && !p_argument.indirect && p_argument.size == OP_QUAD;
+}
+
+Assembler::Address Assembler::_argument_address(const Argument &p_argument)
+{
+	return Address{p_argument.displacement, p_argument.reg, -1, 1, !p_argument.indirect};
+}
+
+Assembler::Address Assembler::_parse_address(const std::vector<Node> &p_nodes)
+{
+	/* [-][disp] [base] [, index [, scale]], the parens have already gone */
+	Address address{0, -1, -1, 1, false};
+	unsigned int i = 0;
+	int sign = 1;
+	if (i < p_nodes.size() && p_nodes[i].type == TK_MINUS)
+	{
+		sign = -1;
+		i++;
+	}
+
+	if (i < p_nodes.size() && p_nodes[i].type == TK_CONSTANT)
+	{
+		address.displacement = _parse_displacement(p_nodes[i].value, sign < 0);
+		i++;
+	}
+
+	if (i < p_nodes.size() && p_nodes[i].type == TK_REGISTER)
+	{
+		address.base = p_nodes[i].code;
+		i++;
+	}
+
+	if (i + 1 < p_nodes.size() && p_nodes[i].type == TK_COMMA)
+	{
+		if (p_nodes[i + 1].type != TK_REGISTER)
+		{
+			_error("expected index register but found '" + p_nodes[i + 1].value + "'");
+		}
+		address.index = p_nodes[i + 1].code;
+		i += 2;
+	}
+
+	if (i + 1 < p_nodes.size() && p_nodes[i].type == TK_COMMA)
+	{
+		address.scale = std::stoi(p_nodes[i + 1].value);
+		if (address.scale != 1 && address.scale != 2 && address.scale != 4 && address.scale != 8)
+		{
+			_error("scale must be 1, 2, 4 or 8 but found '" + p_nodes[i + 1].value + "'");
+		}
+		i += 2;
+	}
+
+	if (i != p_nodes.size() || (address.base < 0 && address.index < 0))
+	{
+		_error("malformed address");
+	}
+
+	if (address.index == REG_SP)
+	{
+		_error("rsp cannot be an index");
+	}
+
+	if (address.base == REG_RIP || address.index == REG_RIP)
+	{
+		_error("rip can only be used as label(%rip)");
+	}
+	return address;
+}
 
-				_push_opcode("add", source, destination);
-			} break;
-			case TK_SUB:
-			{
-				node = _advance();
-				Argument source{node.type, node.value, 0};
+void Assembler::_push_address(unsigned char p_register, const Address &p_address)
+{
+	unsigned char reg = (p_register & 0x07) << 3;
+	if (p_address.direct)
+	{
+		text.push_back(REGISTER_ADRESSING | reg | (p_address.base & 0x07));
+		return;
+	}
 
-				/* skip comma */
-				node = _advance();
+	/* mod 00 with r/m 101 is a disp32 from the end of the instruction */
+	if (p_address.base == REG_RIP)
+	{
+		text.push_back(REGISTER_INDIRECT_ADRESSING | reg | 0x05);
+		_push_int(text, p_address.displacement);
+		return;
+	}
 
-				node = _advance();
-				Argument destination{node.type, node.value, 0};
+	/* rbp and r13 as a base always need a displacement, no base always has a disp32 */
+	unsigned char base = (p_address.base >= 0) ? (p_address.base & 0x07) : 0x05;
+	unsigned char mod = FOUR_BYTE_DISPLACEMENT;
+	if (p_address.base < 0 || (p_address.displacement == 0 && base != 0x05))
+	{
+		mod = REGISTER_INDIRECT_ADRESSING;
+	}
+	else if (p_address.displacement >= -128 && p_address.displacement <= 127)
+	{
+		mod = ONE_BYTE_DISPLACEMENT;
+	}
 
-				_push_opcode("sub", source, destination);
-			} break;
-			case TK_MUL:
-			{
-				node = _advance();
-				Argument source{node.type, node.value, 0};
+	/* an index, rsp as a base or no base at all go through the SIB byte */
+	bool has_sib = p_address.index >= 0 || p_address.base < 0 || base == 0x04;
+	unsigned char rm = has_sib ? 0x04 : base;
+	text.push_back(mod | reg | rm);
 
-				/* skip comma */
-				node = _advance();
+	if (has_sib)
+	{
+		unsigned char scale = 0;
+		while ((1 << scale) < p_address.scale)
+		{
+			scale++;
+		}
 
-				node = _advance();
-				Argument destination{node.type, node.value, 0};
+		unsigned char index = (p_address.index >= 0) ? (p_address.index & 0x07) : 0x04;
+		text.push_back((scale << 6) | (index << 3) | base);
+	}
 
-				_push_opcode("mul", source, destination);
-			} break;
-			case TK_INC:
-			{
-				node = _advance();
-				if (node.type != TK_REGISTER)
-				{
-					_error("expected register but found '" + node.value + "'");
-				}
-				text.push_back(0x48);
-				text.push_back(0xFF);
-				_push_opcode("inc_" + node.value);
-			} break;
-			case TK_DEC:
-			{
-				node = _advance();
-				if (node.type != TK_REGISTER)
-				{
-					_error("expected register but found '" + node.value + "'");
-				}
-				text.push_back(0x48);
-				text.push_back(0xFF);
-				_push_opcode("dec_" + node.value);
-			} break;
-			case TK_MOV:
-			{
-				node = _advance();
+	if (mod == ONE_BYTE_DISPLACEMENT)
+	{
+		text.push_back(p_address.displacement & 0xFF);
+	}
+	else if (mod == FOUR_BYTE_DISPLACEMENT || p_address.base < 0)
+	{
+		_push_int(text, p_address.displacement);
+	}
+}
 
-				Argument source = _calulate_displacement_argument(node);
+void Assembler::_push_binary(Mnemonic p_mnemonic)
+{
+	Argument source = _calulate_displacement_argument(_advance());
 
-				/* skip comma */
-				node = _advance();
-				node = _advance();
+	/* skip comma */
+	_advance();
 
-				Argument destination = _calulate_displacement_argument(node);
+	Argument destination = _calulate_displacement_argument(_advance());
+	if (destination.type != TK_REGISTER)
+	{
+		_error("expected register or memory but found '" + destination.value + "'");
+	}
 
-				if (source.displacement == 0)
-				{
-					_push_opcode("mov_dreg", source, destination);
-				}
-				else
-				{
-					_push_opcode("mov_sreg", source, destination);
-				}
-			} break;
-			case TK_RET:
-			{
-				node = _advance();
+	/* operand size comes from the registers, not the mnemonic */
+	bool wide = _is_quad(source) || _is_quad(destination);
+	if (source.type == TK_CONSTANT)
+	{
+		/* B8+r imm32, zero extended into the full register */
+		if (p_mnemonic == MN_MOV && !destination.indirect && !wide)
+		{
+			_push_encoding(MN_MOV, FORM_OI, false, destination.reg, _argument_address(destination), true, std::stoi(source.value));
+			return;
+		}
+		_push_encoding(p_mnemonic, FORM_MI, wide, 0x00, _argument_address(destination), true, std::stoi(source.value));
+		return;
+	}
 
-				_push_opcode("ret");
-			} break;
-			case TK_SYSCALL:
-			{
-				node = _advance();
+	if (source.type != TK_REGISTER)
+	{
+		_error("expected register, memory or constant but found '" + source.value + "'");
+	}
 
-				text.push_back(0x0F);
-				text.push_back(0x05);
-			} break;
+	if (source.indirect)
+	{
+		if (destination.indirect)
+		{
+			_error("only one operand can be in memory");
 		}
+		_push_encoding(p_mnemonic, FORM_RM, wide, destination.reg, _argument_address(source));
+		return;
+	}
+	_push_encoding(p_mnemonic, FORM_MR, wide, source.reg, _argument_address(destination));
+}
 
-		//std::cout << token_to_string.at(node.type) << " " << token_to_string.at(node.op) << " " << node.value << std::endl;
-		node = _advance();
+void Assembler::_push_memory_operation(Mnemonic p_mnemonic)
+{
+	/* the parens are skipped, so the destination is whatever comes last */
+	std::vector<Node> operands;
+	while (_peek().type != TK_NEWLINE && _peek().type != TK_EOF)
+	{
+		operands.push_back(_advance());
+	}
+
+	if (operands.size() < 3 || operands.back().type != TK_REGISTER || operands[operands.size() - 2].type != TK_COMMA)
+	{
+		_error("expected address and register");
+	}
+
+	Node destination = operands.back();
+	operands.pop_back();
+	operands.pop_back(); // ,
+
+	bool wide = destination.op == OP_QUAD;
+
+	/* label(%rip) */
+	if (operands.size() == 2 && operands[1].type == TK_REGISTER && operands[1].code == REG_RIP)
+	{
+		_push_encoding(p_mnemonic, FORM_RM, wide, destination.code, Address{0, REG_RIP, -1, 1, false});
+		_push_fixup(SECTION_TEXT, text.size() - 4, operands[0].value);
+		return;
+	}
+	_push_encoding(p_mnemonic, FORM_RM, wide, destination.code, _parse_address(operands));
+}
+
+int Assembler::_parse_displacement(const std::string &p_value, bool p_negative)
+{
+	/* the magnitude of -2147483648 does not fit an int, so it is read wider */
+	long long displacement = (p_value.size() <= 10) ? std::stoll(p_value) : (1ll << 32);
+	displacement = p_negative ? -displacement : displacement;
+	if (displacement < INT32_MIN || displacement > INT32_MAX)
+	{
+		_error("displacement '" + std::string(p_negative ? "-" : "") + p_value + "' does not fit in 32 bits");
 	}
+	return (int)displacement;
 }
 
 Assembler::Argument Assembler::_calulate_displacement_argument(Node p_node)
 {
-	Token type = p_node.type;
-	std::string value = p_node.value;
 	int displacement = 0;
+	bool indirect = false;
 	if (p_node.type == TK_MINUS)
 	{
-		p_node = _advance(); // -
-		displacement = -std::stoi(p_node.value);
 		p_node = _advance(); // constant
-		type = p_node.type,
-		value = p_node.value;
+		displacement = _parse_displacement(p_node.value, true);
+		p_node = _advance(); // register
+		indirect = true;
 	}
-	else if (_peek().type == TK_REGISTER)
+	else if (p_node.type == TK_CONSTANT && _peek().type == TK_REGISTER)
 	{
-		displacement = std::stoi(p_node.value);
-		p_node = _advance(); // constant
-		type = p_node.type,
-		value = p_node.value;
+		displacement = _parse_displacement(p_node.value, false);
+		p_node = _advance(); // register
+		indirect = true;
 	}
-	return Argument{type, value, displacement};
+	return Argument{p_node.type, p_node.value, p_node.code, p_node.op, displacement, indirect};
 }
 
-void Assembler::_push_opcode(
-		std::string p_mnemonic,
-		Argument p_source,
-		Argument p_destination
+void Assembler::_push_encoding(
+		Mnemonic p_mnemonic,
+		Form p_form,
+		bool p_wide,
+		unsigned char p_register,
+		const Address &p_address,
+		bool p_has_immediate,
+		int p_immediate
 ) {
 	/*
-	 *                           operand
-	 *  prefix  | opcode d s | MOD REG R/M | immediate
-	 * 00000000 | 000000 0 0 | 00  000 000 | 00000000
+	 *   REX    |  prefix  |  opcode  | MOD REG R/M | SCALE INDEX BASE | disp     | immediate
+	 * 0100WRXB | 00001111 | 00000000 | 00  000 000 | 00    000   000  | 0, 1, 4  | 0, 1, 4
 	 */
-	bool has_prefix = false;
-	bool has_operand = false;
-	bool has_immediate = false;
-
-	unsigned char prefix;
-	if (prefix_opcodes.count(p_mnemonic))
+	const Encoding &encoding = encodings[p_mnemonic][p_form];
+	bool imm8 = p_has_immediate && encoding.short_opcode != 0x00 && p_immediate >= -128 && p_immediate <= 127;
+	if (encoding.opcode == 0x00 && !imm8)
 	{
-		has_prefix = true;
-		prefix = prefix_opcodes.at(p_mnemonic);
+		_error("invalid operands for instruction");
 	}
 
-	unsigned char opcode = op_opcodes.at(p_mnemonic);
+	bool has_modrm = p_form == FORM_MR || p_form == FORM_RM || p_form == FORM_MI || p_form == FORM_M || p_form == FORM_RMI;
+	unsigned char reg = (encoding.extension >= 0) ? encoding.extension : p_register;
 
-	unsigned char operand;
-	std::vector<unsigned char> immediate;
-	if (p_source.type != NONE || p_destination.type != NONE)
+	/* r8 - r15 carry their top bit in REX.R, REX.X and REX.B */
+	unsigned char rex = p_wide ? 0x48 : 0x00;
+	if (has_modrm)
 	{
-
-		if (p_source.type == TK_CONSTANT)
+		if (reg > 0x07)
 		{
-			has_immediate = true;
-			_push_int(immediate, std::stoi(p_source.value));
+			rex |= 0x44;
 		}
-		else
-		{
-			has_operand = true;
-			operand = 0x00;
-			bool source_is_dest = (opcode & 2) != 0;
-			Argument reg = source_is_dest ? p_destination : p_source;
-			Argument rm =  source_is_dest ? p_source : p_destination;
 
-			unsigned char mod = 0x00;
-			if (rm.type == TK_REGISTER && rm.displacement == 0)
-			{
-				mod = REGISTER_ADRESSING;
-			}
-			else
-			{
-				mod = FOUR_BYTE_DISPLACEMENT;
-			}
-			operand |= mod;
+		if (p_address.index > 0x07)
+		{
+			rex |= 0x42;
+		}
 
-			operand |= register_values.at(reg.value) << 3;
-			operand |= register_values.at(rm.value);
-			if (mod == FOUR_BYTE_DISPLACEMENT)
-			{
-				if (!has_immediate && rm.displacement != 0)
-				{
-					has_immediate = true;
-					int displacement = rm.displacement;
-					if (rm.displacement < 0)
-					{
-						displacement = 0xFFFFFFFF ^(-displacement - 1);
-					}
-					_push_int(immediate, displacement);
-				}
-			}
+		if (p_address.base > 0x07 && p_address.base != REG_RIP)
+		{
+			rex |= 0x41;
 		}
 	}
-
-	if (has_prefix)
+	else if (p_register > 0x07)
 	{
-		text.push_back(prefix);
+		rex |= 0x41;
 	}
 
-	text.push_back(opcode);
-
-	if (has_operand)
+	if (rex != 0x00)
 	{
-		text.push_back(operand);
+		text.push_back(0x40 | rex);
 	}
 
-	if (has_immediate)
+	if (imm8)
+	{
+		text.push_back(encoding.short_opcode);
+	}
+	else
 	{
-		for (unsigned char c : immediate)
+		if (encoding.prefix != 0x00)
+		{
+			text.push_back(encoding.prefix);
+		}
+
+		/* +r */
+		unsigned char opcode = encoding.opcode;
+		if (p_form == FORM_O || p_form == FORM_OI)
 		{
-			text.push_back(c);
+			opcode += p_register & 0x07;
 		}
+		text.push_back(opcode);
+	}
+
+	if (has_modrm)
+	{
+		_push_address(reg, p_address);
 	}
 
+	if (imm8)
+	{
+		text.push_back(p_immediate & 0xFF);
+	}
+	else if (p_has_immediate)
+	{
+		_push_int(text, p_immediate);
+	}
 }
 
 void Assembler::_push_int(std::vector<unsigned char> &p_vector, int p_value)
@@ -485,6 +1886,56 @@ void Assembler::_push_int(std::vector<unsigned char> &p_vector, int p_value)
 	p_vector.push_back((p_value >> 24) & 0xFF);
 }
 
+void Assembler::_push_value(std::vector<unsigned char> &p_vector, unsigned long p_value, unsigned int p_size)
+{
+	for (unsigned int i = 0; i < p_size; i++)
+	{
+		p_vector.push_back((p_value >> (i * 8)) & 0xFF);
+	}
+}
+
+void Assembler::_push_uleb128(std::vector<unsigned char> &p_vector, unsigned long p_value)
+{
+	/* seven bits at a time, the top bit says more follow */
+	do
+	{
+		unsigned char byte = p_value & 0x7F;
+		p_value >>= 7;
+		p_vector.push_back(byte | ((p_value != 0) ? 0x80 : 0x00));
+	} while (p_value != 0);
+}
+
+void Assembler::_push_sleb128(std::vector<unsigned char> &p_vector, long p_value)
+{
+	bool more = true;
+	while (more)
+	{
+		unsigned char byte = p_value & 0x7F;
+		p_value >>= 7;
+		more = !((p_value == 0 && !(byte & 0x40)) || (p_value == -1 && (byte & 0x40)));
+		p_vector.push_back(byte | (more ? 0x80 : 0x00));
+	}
+}
+
+void Assembler::_push_fixup(
+		ObjectSection p_section,
+		unsigned int p_offset,
+		const std::string &p_symbol,
+		const std::string &p_base,
+		int p_addend,
+		bool p_call
+) {
+	fixups.push_back({p_section, p_offset, p_symbol, p_base, p_addend, p_call, (unsigned int)assembly_line});
+}
+
+void Assembler::_set_int(std::vector<unsigned char> &p_vector, unsigned int p_offset, int p_value)
+{
+	p_vector[p_offset] = p_value & 0xFF;
+	p_vector[p_offset + 1] = (p_value >> 8) & 0xFF;
+	p_vector[p_offset + 2] = (p_value >> 16) & 0xFF;
+	p_vector[p_offset + 3] = (p_value >> 24) & 0xFF;
+}
+
 void Assembler::_push_string(std::vector<unsigned char> &p_vector, std::string p_string)
 {
 	for (char c : p_string)
@@ -502,25 +1953,37 @@ void Assembler::_push_string(std::vector<unsigned char> &p_vector, std::string p
 
 void Assembler::_error(std::string p_error)
 {
-	std::cout << "assembler: line " << (assembly_line);
-	std::cout << ": error: " << p_error << std::endl;
+	_report(assembly_line, p_error);
+	exit(0);
+}
+
+void Assembler::_fail(std::string p_error)
+{
+	std::cout << "assembler: error: " << p_error << std::endl;
 	exit(0);
 }
 
+void Assembler::_report(unsigned int p_line, std::string p_error)
+{
+	std::cout << "assembler: line " << p_line;
+	std::cout << ": error: " << p_error << std::endl;
+}
+
 void Assembler::_load_assembly(const std::string &p_file)
 {
 	const int buffer_size = 4096;
 	std::unique_ptr<char[]> buffer(new char[buffer_size]);
 	std::ifstream stream(p_file);
+	assembly_code.clear();
 	while (stream)
 	{
 		stream.read(buffer.get(), buffer_size);
-		assembly_code.append(buffer.get());
+		assembly_code.append(buffer.get(), stream.gcount());
 	}
 	stream.close();
 	assembly_code_size = assembly_code.length();
 	assembly_offset = -1;
-	assembly_line = 0;
+	assembly_line = 1;
 }
 
 Assembler::Node Assembler::_peek()
@@ -613,13 +2076,50 @@ Assembler::Node Assembler::_advance()
 			{
 				return _make_node(TK_COMMA, ",");
 			} break;
+			case '*':
+			{
+				return _make_node(TK_STAR, "*");
+			} break;
+			case '+':
+			{
+				return _make_node(TK_PLUS, "+");
+			} break;
+			case '"':
+			{
+				/* no escapes, only used for file names */
+				int i = 1;
+				std::string value;
+				while (_look_ahead(i) != '"')
+				{
+					if (_look_ahead(i) == '\n' || _look_ahead(i) == 0)
+					{
+						_error("unterminated string");
+					}
+					value += _look_ahead(i);
+					i++;
+				}
+				assembly_offset += i;
+				return _make_node(TK_STRING, value);
+			} break;
+			case '.':
+			{
+				int i = 1;
+				std::string word;
+				while (_is_text_char(_look_ahead(i)))
+				{
+					word += _look_ahead(i);
+					i++;
+				}
+				assembly_offset += i - 1;
+				return _make_node(TK_DIRECTIVE, word);
+			} break;
 			case '$':
 			{
 				std::string value;
 				Node tk_value = _advance();
 				if (tk_value.type == TK_MINUS)
 				{
-					value != "-";
+					value += "-";
 					tk_value = _advance();
 				}
 
@@ -643,7 +2143,13 @@ Assembler::Node Assembler::_advance()
 				{
 					_error("expetect identifier but found '" + tk_value.value + "'" );
 				}
-				return _make_node(TK_REGISTER, tk_value.value);
+
+				Node node = _make_node(TK_REGISTER, tk_value.value);
+				if (!_decode_register(tk_value.value, node))
+				{
+					_error("unknown register '%" + tk_value.value + "'");
+				}
+				return node;
 			} break;
 			default:
 			{
@@ -667,12 +2173,19 @@ Assembler::Node Assembler::_advance()
 					word += _look_ahead(i);
 					i++;
 				}
+				/* labels can share a name with a mnemonic */
+				bool is_label = _look_ahead(i) == ':';
 				assembly_offset += i - 1;
 
+				if (is_label)
+				{
+					return _make_node(TK_IDENTIFIER, word);
+				}
+
 				if (word == "globl")
 				{
 					Node value = _advance();
-					if (value.type != TK_IDENTIFIER)
+					if (value.type == TK_REGISTER || value.type == TK_CONSTANT || value.type == TK_NEWLINE || value.type == TK_EOF)
 					{
 						_error("expected identifier, but found: '" + token_to_string.at(value.type) + "'" );
 					}
@@ -699,7 +2212,7 @@ Assembler::Node Assembler::_advance()
 					return _make_node(TK_SUB, word, _get_op_type(word));
 				}
 
-				if (word.find("mul") == 0)
+				if (word.find("mul") == 0 || word.find("imul") == 0)
 				{
 					return _make_node(TK_MUL, word, _get_op_type(word));
 				}
@@ -714,21 +2227,86 @@ Assembler::Node Assembler::_advance()
 					return _make_node(TK_DEC, word, _get_op_type(word));
 				}
 
+				if (word.find("movs") == 0)
+				{
+					return _make_node(TK_MOVSX, word);
+				}
+
+				if (word.find("movz") == 0)
+				{
+					return _make_node(TK_MOVZX, word);
+				}
+
 				if (word.find("mov") == 0)
 				{
 					return _make_node(TK_MOV, word, _get_op_type(word));
 				}
 
+				if (word.find("lea") == 0)
+				{
+					return _make_node(TK_LEA, word, _get_op_type(word));
+				}
+
+				if (word.find("shl") == 0)
+				{
+					return _make_node(TK_SHL, word, _get_op_type(word));
+				}
+
+				if (word.find("sar") == 0)
+				{
+					return _make_node(TK_SAR, word, _get_op_type(word));
+				}
+
+				if (word.find("shr") == 0)
+				{
+					return _make_node(TK_SHR, word, _get_op_type(word));
+				}
+
+				if (word.find("and") == 0)
+				{
+					return _make_node(TK_ASM_AND, word, _get_op_type(word));
+				}
+
+				if (word.find("neg") == 0)
+				{
+					return _make_node(TK_NEG, word, _get_op_type(word));
+				}
+
+				if (word.find("idiv") == 0)
+				{
+					return _make_node(TK_DIV, word);
+				}
+
+				if (word == "cltd")
+				{
+					return _make_node(TK_CLTD, word);
+				}
+
+				/* anything else, ie call setup, is left as an identifier */
+				if (word.find("set") == 0 && condition_codes.count(word.substr(3)))
+				{
+					Node node = _make_node(TK_SET, word);
+					node.code = condition_codes.at(word.substr(3));
+					return node;
+				}
+
 				if (word.find("ret") == 0)
 				{
 					return _make_node(TK_RET, word);
 				}
 
-				if (jump_operations.count(word))
+				if (word == "jmp")
 				{
 					return _make_node(TK_JMP, word);
 				}
 
+				if (word[0] == 'j' && condition_codes.count(word.substr(1)))
+				{
+					Node node = _make_node(TK_JMP, word);
+					node.code = condition_codes.at(word.substr(1));
+					return node;
+				}
+
 				if (word.find("syscall") == 0)
 				{
 					return _make_node(TK_SYSCALL, word);
@@ -803,9 +2381,69 @@ Assembler::Node Assembler::_make_node(Token p_token, std::string p_value, Token
 	node.type = p_token;
 	node.value = p_value;
 	node.op = p_op;
+	node.code = 0x00;
 	return node;
 }
 
+bool Assembler::_decode_register(const std::string &p_name, Node &r_node)
+{
+	/* al, rip, r8 - r15 with an optional d, or e / r and the legacy name */
+	if (p_name == "al")
+	{
+		r_node.code = REG_AX;
+		r_node.op = OP_BYTE;
+		return true;
+	}
+
+	if (p_name == "rip")
+	{
+		r_node.code = REG_RIP;
+		r_node.op = OP_QUAD;
+		return true;
+	}
+
+	if (p_name.length() < 2 || (p_name[0] != 'r' && p_name[0] != 'e'))
+	{
+		return false;
+	}
+
+	if (p_name[0] == 'r' && _is_number(p_name[1]))
+	{
+		unsigned int i = 1;
+		unsigned int number = 0;
+		while (i < p_name.length() && _is_number(p_name[i]))
+		{
+			number = number * 10 + (p_name[i] - '0');
+			i++;
+		}
+
+		bool is_long = i < p_name.length() && p_name[i] == 'd';
+		if (number < 8 || number > 15 || i + (is_long ? 1 : 0) != p_name.length())
+		{
+			return false;
+		}
+		r_node.code = number;
+		r_node.op = is_long ? OP_LONG : OP_QUAD;
+		return true;
+	}
+
+	if (p_name.length() != 3)
+	{
+		return false;
+	}
+
+	for (unsigned char i = 0; i < 8; i++)
+	{
+		if (legacy_registers[i * 2] == p_name[1] && legacy_registers[i * 2 + 1] == p_name[2])
+		{
+			r_node.code = i;
+			r_node.op = (p_name[0] == 'r') ? OP_QUAD : OP_LONG;
+			return true;
+		}
+	}
+	return false;
+}
+
 char Assembler::_get_next_char()
 {
 	assembly_offset++;
@@ -31,123 +31,182 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <set>
 #include <elf.h>
 
 #include "tokens.h"
+#include "options.h"
 
 class Assembler
 {
 private:
-	const std::unordered_map<std::string, unsigned char> prefix_opcodes
+	enum Register
 	{
-		{"sub",  0x48},
-		{"mul", 0x0F},
+		REG_AX,
+		REG_CX,
+		REG_DX,
+		REG_BX,
+		REG_SP,
+		REG_BP,
+		REG_SI,
+		REG_DI,
+
+		/* need a REX prefix */
+		REG_R8,
+		REG_R9,
+		REG_R10,
+		REG_R11,
+		REG_R12,
+		REG_R13,
+		REG_R14,
+		REG_R15,
+
+		/* only as a base, label(%rip) */
+		REG_RIP
+	};
+
+	/* ax, cx, dx... in encoding order, the e and r prefixes give the size */
+	static constexpr char legacy_registers[] = "axcxdxbxspbpsidi";
+
+	/* the cc in jcc and setcc */
+	const std::unordered_map<std::string, unsigned char> condition_codes
+	{
+		{"o",   0x00},
+		{"no",  0x01},
+		{"b",   0x02},
+		{"nae", 0x02},
+		{"c",   0x02},
+		{"nb",  0x03},
+		{"ae",  0x03},
+		{"nc",  0x03},
+		{"e",   0x04},
+		{"z",   0x04},
+		{"ne",  0x05},
+		{"nz",  0x05},
+		{"be",  0x06},
+		{"na",  0x06},
+		{"a",   0x07},
+		{"nbe", 0x07},
+		{"s",   0x08},
+		{"ns",  0x09},
+		{"p",   0x0A},
+		{"pe",  0x0A},
+		{"np",  0x0B},
+		{"po",  0x0B},
+		{"l",   0x0C},
+		{"nge", 0x0C},
+		{"ge",  0x0D},
+		{"nl",  0x0D},
+		{"le",  0x0E},
+		{"ng",  0x0E},
+		{"g",   0x0F},
+		{"nle", 0x0F}
+	};
 
-		{"mov_dreg", 0x48},
-		{"mov_sreg", 0x48},
+	enum Mnemonic
+	{
+		MN_ADD,
+		MN_SUB,
+		MN_AND,
+		MN_CMP,
+		MN_TEST,
+		MN_MOV,
+		MN_IMUL,
+		MN_LEA,
+		MN_MOVSXD,
+		MN_MOVZX,
+		MN_SHL,
+		MN_SHR,
+		MN_SAR,
+		MN_INC,
+		MN_DEC,
+		MN_NEG,
+		MN_IDIV,
+		MN_PUSH,
+		MN_POP,
+		MN_SET,
+		MN_JMP,
+		MN_JCC,
+		MN_CALL,
+		MN_RET,
+		MN_CLTD,
+		MN_SYSCALL,
+		MN_MAX
+	};
 
-		{"cmp",  0x48},
+	/* operand kinds, named as in the Intel manual */
+	enum Form
+	{
+		FORM_MR,  /* r/m, reg */
+		FORM_RM,  /* reg, r/m */
+		FORM_MI,  /* r/m, imm */
+		FORM_M,   /* r/m, the reg field is an extension */
+		FORM_O,   /* register added to the opcode */
+		FORM_OI,  /* register added to the opcode, imm */
+		FORM_RMI, /* reg, r/m, imm */
+		FORM_I,   /* imm */
+		FORM_D,   /* rel */
+		FORM_ZO,  /* no operands */
+		FORM_MAX
 	};
 
-	const std::unordered_map<std::string, unsigned char> op_opcodes
+	/*
+	 * prefix is 0x0F for the two byte opcodes, the extension is the /digit
+	 * in the reg field or -1 when it holds a register. short_opcode takes an
+	 * imm8 or rel8 instead, and never has the prefix. No opcodes means no form.
+	 */
+	struct Encoding
 	{
-		{"add", 0x01},
-		{"sub", 0x29},
-
-		{"inc_eax", 0xC0},
-		{"inc_ecx", 0xC1},
-		{"inc_edx", 0xC2},
-		{"inc_ebx", 0xC3},
-		{"inc_esp", 0xC4},
-		{"inc_ebp", 0xC5},
-		{"inc_esi", 0xC6},
-		{"inc_edi", 0xC7},
-
-		{"dec_eax", 0xC8},
-		{"dec_ecx", 0xC9},
-		{"dec_edx", 0xCA},
-		{"dec_ebx", 0xCB},
-		{"dec_esp", 0xCC},
-		{"dec_ebp", 0xCD},
-		{"dec_esi", 0xCE},
-		{"dec_edi", 0xCF},
-
-		{"push_eax", 0x50},
-		{"push_ecx", 0x51},
-		{"push_edx", 0x52},
-		{"push_ebx", 0x53},
-		{"push_esp", 0x54},
-		{"push_ebp", 0x55},
-		{"push_esi", 0x56},
-		{"push_edi", 0x57},
-		{"push_imm", 0x68},
-
-		{"pop_eax", 0x58},
-		{"pop_ecx", 0x59},
-		{"pop_edx", 0x5A},
-		{"pop_ebx", 0x5B},
-		{"pop_esp", 0x5C},
-		{"pop_ebp", 0x5D},
-		{"pop_esi", 0x5E},
-		{"pop_edi", 0x5F},
-
-		{"mov_dreg",     0x89},
-		{"mov_sreg",     0x8B},
-
-		{"mul", 0xAF},
-		{"ret", 0xC3},
-
-		{"test", 0x85},
-
-		{"call", 0xE8},
-		{"cmp",  0x3B},
-
-		{"jo",    0x70},
-		{"jno",   0x71},
-		{"jb",    0x72},
-		{"jnae",  0x72},
-		{"jc",    0x72},
-		{"jnb",   0x73},
-		{"jae",   0x73},
-		{"jnc",   0x73},
-		{"je",    0x74},
-		{"jz",    0x74},
-		{"jne",   0x75},
-		{"jnz",   0x75},
-		{"jbe",   0x76},
-		{"jna",   0x76},
-		{"ja",    0x77},
-		{"jnbe",  0x77},
-		{"js",    0x78},
-		{"jns",   0x79},
-		{"jp",    0x7A},
-		{"jse",   0x7A},
-		{"jnp",   0x7B},
-		{"jpo",   0x7B},
-		{"jl",    0x7C},
-		{"jnge",  0x7C},
-		{"jge",   0x7D},
-		{"jnl",   0x7D},
-		{"jle",   0x7E},
-		{"jng",   0x7E},
-		{"jg",    0x7F},
-		{"jnle",  0x7F},
-		{"jcxz",  0xE3},
-		{"jecxz", 0xE3},
-		{"jmp",  0xEB}
+		unsigned char prefix;
+		unsigned char opcode;
+		signed char extension;
+		unsigned char short_opcode;
 	};
 
-	const std::unordered_map<std::string, unsigned char> register_values
+	static constexpr Encoding encodings[MN_MAX][FORM_MAX] =
 	{
-		{"eax", 0x00},
-		{"ecx", 0x01},
-		{"edx", 0x02},
-		{"ebx", 0x03},
-		{"esp", 0x04},
-		{"ebp", 0x05},
-		{"esi", 0x06},
-		{"edi", 0x07}
+		/*              MR                   RM                      MI                     M                      O                    OI                   RMI                     I                       D                         ZO */
+		/* add */     { {0, 0x01, -1, 0},    {0, 0x03, -1, 0},       {0, 0x81, 0, 0x83},    {},                    {},                  {},                  {},                     {},                     {},                       {} },
+		/* sub */     { {0, 0x29, -1, 0},    {0, 0x2B, -1, 0},       {0, 0x81, 5, 0x83},    {},                    {},                  {},                  {},                     {},                     {},                       {} },
+		/* and */     { {0, 0x21, -1, 0},    {0, 0x23, -1, 0},       {0, 0x81, 4, 0x83},    {},                    {},                  {},                  {},                     {},                     {},                       {} },
+		/* cmp */     { {0, 0x39, -1, 0},    {0, 0x3B, -1, 0},       {0, 0x81, 7, 0x83},    {},                    {},                  {},                  {},                     {},                     {},                       {} },
+		/* test */    { {0, 0x85, -1, 0},    {},                     {0, 0xF7, 0, 0},       {},                    {},                  {},                  {},                     {},                     {},                       {} },
+		/* mov */     { {0, 0x89, -1, 0},    {0, 0x8B, -1, 0},       {0, 0xC7, 0, 0},       {},                    {},                  {0, 0xB8, -1, 0},    {},                     {},                     {},                       {} },
+		/* imul */    { {},                  {0x0F, 0xAF, -1, 0},    {},                    {0, 0xF7, 5, 0},       {},                  {},                  {0, 0x69, -1, 0x6B},    {},                     {},                       {} },
+		/* lea */     { {},                  {0, 0x8D, -1, 0},       {},                    {},                    {},                  {},                  {},                     {},                     {},                       {} },
+		/* movsxd */  { {},                  {0, 0x63, -1, 0},       {},                    {},                    {},                  {},                  {},                     {},                     {},                       {} },
+		/* movzx */   { {},                  {0x0F, 0xB6, -1, 0},    {},                    {},                    {},                  {},                  {},                     {},                     {},                       {} },
+		/* shl */     { {},                  {},                     {0, 0x00, 4, 0xC1},    {},                    {},                  {},                  {},                     {},                     {},                       {} },
+		/* shr */     { {},                  {},                     {0, 0x00, 5, 0xC1},    {},                    {},                  {},                  {},                     {},                     {},                       {} },
+		/* sar */     { {},                  {},                     {0, 0x00, 7, 0xC1},    {},                    {},                  {},                  {},                     {},                     {},                       {} },
+		/* inc */     { {},                  {},                     {},                    {0, 0xFF, 0, 0},       {},                  {},                  {},                     {},                     {},                       {} },
+		/* dec */     { {},                  {},                     {},                    {0, 0xFF, 1, 0},       {},                  {},                  {},                     {},                     {},                       {} },
+		/* neg */     { {},                  {},                     {},                    {0, 0xF7, 3, 0},       {},                  {},                  {},                     {},                     {},                       {} },
+		/* idiv */    { {},                  {},                     {},                    {0, 0xF7, 7, 0},       {},                  {},                  {},                     {},                     {},                       {} },
+		/* push */    { {},                  {},                     {},                    {},                    {0, 0x50, -1, 0},    {},                  {},                     {0, 0x68, -1, 0x6A},    {},                       {} },
+		/* pop */     { {},                  {},                     {},                    {},                    {0, 0x58, -1, 0},    {},                  {},                     {},                     {},                       {} },
+		/* setcc */   { {},                  {},                     {},                    {0x0F, 0x90, 0, 0},    {},                  {},                  {},                     {},                     {},                       {} },
+		/* jmp */     { {},                  {},                     {},                    {0, 0xFF, 4, 0},       {},                  {},                  {},                     {},                     {0, 0xE9, -1, 0xEB},      {} },
+		/* jcc */     { {},                  {},                     {},                    {},                    {},                  {},                  {},                     {},                     {0x0F, 0x80, -1, 0x70},   {} },
+		/* call */    { {},                  {},                     {},                    {},                    {},                  {},                  {},                     {},                     {0, 0xE8, -1, 0},         {} },
+		/* ret */     { {},                  {},                     {},                    {},                    {},                  {},                  {},                     {},                     {},                       {0, 0xC3, -1, 0} },
+		/* cltd */    { {},                  {},                     {},                    {},                    {},                  {},                  {},                     {},                     {},                       {0, 0x99, -1, 0} },
+		/* syscall */ { {},                  {},                     {},                    {},                    {},                  {},                  {},                     {},                     {},                       {0x0F, 0x05, -1, 0} }
+	};
+
+	/* the recommended nop of each length, 1 to 9 bytes, longer padding takes several */
+	static constexpr unsigned char nops[9][9] =
+	{
+		{0x90},
+		{0x66, 0x90},
+		{0x0F, 0x1F, 0x00},
+		{0x0F, 0x1F, 0x40, 0x00},
+		{0x0F, 0x1F, 0x44, 0x00, 0x00},
+		{0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00},
+		{0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00},
+		{0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+		{0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00}
 	};
 
 	enum Mod
@@ -158,93 +217,282 @@ private:
 		REGISTER_ADRESSING = 0xC0
 	};
 
-	typedef struct Argument
-	{
-		const Token type;
-		const std::string value;
-		const int displacement;
-	} Argument;
-
 	/*
 	 * For Assembeler Lexer parser
 	 */
 	struct Node
 	{
 		Token type;
+
+		/* the suffix, or the size of a register */
 		Token op;
 		std::string value;
+
+		/* the Register or condition code */
+		unsigned char code;
+	};
+
+	/* a register, constant or base + displacement */
+	struct Argument
+	{
+		Token type;
+		std::string value;
+		unsigned char reg;
+		Token size;
+		int displacement;
+		bool indirect;
+	};
+
+	/*
+	 * base + index * scale + displacement, base and index are -1 when there is none.
+	 * direct is the register itself rather than memory.
+	 */
+	struct Address
+	{
+		int displacement;
+		int base;
+		int index;
+		int scale;
+		bool direct;
+	};
+
+	/*
+	 * -c, the fixed sections of a relocatable object. The debug sections
+	 * are only there when there is line information, any .rela sections
+	 * follow.
+	 */
+	enum ObjectSection
+	{
+		SECTION_NULL,
+		SECTION_TEXT,
+		SECTION_DATA,
+		SECTION_BSS,
+		SECTION_RODATA,
+		SECTION_SYMTAB,
+		SECTION_STRTAB,
+		SECTION_DEBUG_ABBREV,
+		SECTION_DEBUG_INFO,
+		SECTION_DEBUG_LINE
+	};
+
+	/* the few DWARF 4 values the line table and its compile unit need */
+	enum Dwarf
+	{
+		DW_TAG_COMPILE_UNIT = 0x11,
+		DW_AT_NAME = 0x03,
+		DW_AT_STMT_LIST = 0x10,
+		DW_AT_LOW_PC = 0x11,
+		DW_AT_HIGH_PC = 0x12,
+		DW_AT_LANGUAGE = 0x13,
+		DW_AT_COMP_DIR = 0x1B,
+		DW_AT_PRODUCER = 0x25,
+		DW_FORM_ADDR = 0x01,
+		DW_FORM_DATA8 = 0x07,
+		DW_FORM_STRING = 0x08,
+		DW_FORM_DATA1 = 0x0B,
+		DW_FORM_SEC_OFFSET = 0x17,
+		DW_LANG_C89 = 0x01,
+		DW_LNS_COPY = 0x01,
+		DW_LNS_ADVANCE_PC = 0x02,
+		DW_LNS_ADVANCE_LINE = 0x03,
+		DW_LNE_END_SEQUENCE = 0x01,
+		DW_LNE_SET_ADDRESS = 0x02
+	};
+
+	/* special opcodes cover lines -5 to +8 away, with the address moving up to 17 bytes */
+	const int line_base = -5;
+	const int line_range = 14;
+	const int opcode_base = 13;
+
+	/* .loc, the source line of the code from offset on */
+	struct LineRow
+	{
+		unsigned int offset;
+		int line;
 	};
 
-#define TEXT_ADDR  0x40000078
+	/* where the debug sections hold addresses and section offsets, for relocations */
+	struct DebugFields
+	{
+		unsigned int abbrev_offset;
+		unsigned int low_pc;
+		unsigned int stmt_list;
+		unsigned int set_address;
+	};
+
+	/* a 32 bit field patched once every label has its final address */
+	struct Fixup
+	{
+		ObjectSection section;
+		unsigned int offset;
+		std::string symbol;
+
+		/* subtracted from the symbol, when empty it is relative to the end of the field, ie rip */
+		std::string base;
+		int addend;
+
+		/* a call or jump, so a PLT32 relocation in objects */
+		bool call;
+
+		/* where it was used, for reporting undefined symbols */
+		unsigned int line;
+	};
+
+	/*
+	 * Text whose size is only known once the labels are placed. jmp and jcc
+	 * are written as rel32 then shrunk to rel8 where the target is close
+	 * enough. .p2align keeps room for its most padding and is cut down to
+	 * what its final address needs.
+	 */
+	struct Fragment
+	{
+		unsigned int offset;
+		Mnemonic mnemonic;
+		unsigned char condition;
+		std::string target;
+		bool rel8;
+		unsigned int line;
+
+		/* the boundary for .p2align, 0 for a branch, no padding when it would take more than max_skip */
+		unsigned int alignment;
+		unsigned int max_skip;
+		unsigned int padding;
+	};
+
+	struct Section
+	{
+		Elf64_Shdr header;
+		std::vector<unsigned char> data;
+	};
+
+#define BASE_ADDR  0x40000000
+#define PAGE_SIZE  0x1000
 
 	Elf64_Ehdr header;
-	Elf64_Phdr text_program_header;
+
+	/* one per segment, text then any rodata then data and bss, each on its own pages */
+	std::vector<Elf64_Phdr> program_headers;
 
 	std::vector<std::string> functions;
 
 	std::vector<unsigned char> text;
 
+	/* where directives and labels go, instructions always go in text */
+	ObjectSection current_section;
+
+	/* the largest .p2align in each section, that the section itself starts on */
+	unsigned int section_alignments[SECTION_SYMTAB];
+
+	/* read only, mapped without execute */
+	std::vector<unsigned char> rodata;
+	std::unordered_map<std::string, unsigned int> rodata_labels;
+
+	std::vector<unsigned char> data;
+	std::unordered_map<std::string, unsigned int> data_labels;
+
+	/* zero filled, it takes no space in the file and follows data in the same segment */
+	unsigned int bss_size;
+	std::unordered_map<std::string, unsigned int> bss_labels;
+
+	std::vector<Fixup> fixups;
+	std::vector<Fragment> fragments;
+
+	std::unordered_map<std::string, unsigned int> text_labels;
+	std::set<std::string> globals;
+
+	/* from .file and .loc, only the one file is supported */
+	std::string source_file;
+	std::vector<LineRow> line_rows;
+
+	std::vector<unsigned char> debug_abbrev;
+	std::vector<unsigned char> debug_info;
+	std::vector<unsigned char> debug_line;
+
+	std::vector<Section> sections;
+	std::vector<unsigned char> section_names;
+
 	void _generate_header();
-	void _generate_program_header();
+	void _push_program_header(
+			Elf64_Word p_flags,
+			Elf64_Off p_offset,
+			Elf64_Xword p_file_size,
+			Elf64_Xword p_memory_size
+	);
 	void _generate_text(const std::string &p_input_file);
+	void _write_image(unsigned char *p_image);
+	void _layout_executable();
+
+	void _generate_object();
+	unsigned int _add_section(
+			const std::string &p_name,
+			Elf64_Word p_type,
+			Elf64_Xword p_flags,
+			const std::vector<unsigned char> &p_data,
+			Elf64_Xword p_align,
+			Elf64_Xword p_entry_size = 0
+	);
+	std::set<unsigned int> _function_starts();
+	DebugFields _generate_debug_sections(unsigned long p_text_address);
+	void _add_executable_sections();
+	std::string _section_name(unsigned int p_section);
+	std::vector<unsigned char> &_section_data(unsigned int p_section);
+	bool _find_label(const std::string &p_name, unsigned int &r_section, unsigned int &r_offset);
+
+	void _align(unsigned int p_alignment, unsigned int p_max_skip);
+	void _relax_text(std::unordered_map<std::string, unsigned int> &r_label_addresses);
+	unsigned int _relaxed_address(
+			const std::vector<unsigned int> &p_offsets,
+			const std::vector<unsigned int> &p_removed,
+			unsigned int p_address
+	);
+	unsigned int _fragment_size(const Fragment &p_fragment, bool p_reserved);
+	void _push_nops(std::vector<unsigned char> &p_vector, unsigned int p_size);
 
 	Argument _calulate_displacement_argument(Node p_node);
-
-	void _push_opcode(
-			std::string p_mnemonic,
-			Argument p_source = {NONE, "", 0},
-			Argument p_destination = {NONE, "", 0}
+	int _parse_displacement(const std::string &p_value, bool p_negative);
+	bool _is_quad(const Argument &p_argument);
+	Address _argument_address(const Argument &p_argument);
+	Address _parse_address(const std::vector<Node> &p_nodes);
+	void _push_address(unsigned char p_register, const Address &p_address);
+	void _push_binary(Mnemonic p_mnemonic);
+	void _push_memory_operation(Mnemonic p_mnemonic);
+
+	void _push_encoding(
+			Mnemonic p_mnemonic,
+			Form p_form,
+			bool p_wide = false,
+			unsigned char p_register = 0x00,
+			const Address &p_address = {0, -1, -1, 1, true},
+			bool p_has_immediate = false,
+			int p_immediate = 0
 	);
 
+	void _push_fixup(
+			ObjectSection p_section,
+			unsigned int p_offset,
+			const std::string &p_symbol,
+			const std::string &p_base = "",
+			int p_addend = 0,
+			bool p_call = false
+	);
 	void _push_int(std::vector<unsigned char> &p_vector, int p_value);
+	void _push_value(std::vector<unsigned char> &p_vector, unsigned long p_value, unsigned int p_size);
+	void _push_uleb128(std::vector<unsigned char> &p_vector, unsigned long p_value);
+	void _push_sleb128(std::vector<unsigned char> &p_vector, long p_value);
+	void _set_int(std::vector<unsigned char> &p_vector, unsigned int p_offset, int p_value);
 	void _push_string(std::vector<unsigned char> &p_vector, std::string p_string);
 
 	/*
 	 * Assembeler Lexer parser
 	 */
-	const std::set<std::string> jump_operations
-	{
-		"jo",
-		"jno",
-		"jb",
-		"jnae",
-		"jc",
-		"jnb",
-		"jae",
-		"jnc",
-		"je",
-		"jz",
-		"jne",
-		"jnz",
-		"jbe",
-		"jna",
-		"ja",
-		"jnbe",
-		"js",
-		"jns",
-		"jp",
-		"jse",
-		"jnp",
-		"jpo",
-		"jl",
-		"jnge",
-		"jge",
-		"jnl",
-		"jle",
-		"jng",
-		"jg",
-		"jnle",
-		"jcxz",
-		"jecxz",
-		"jmp"
-	};
-
 	std::string assembly_code;
 	int assembly_code_size;
 	int assembly_offset;
 	int assembly_line;
 
 	void _error(std::string p_error);
+	void _report(unsigned int p_line, std::string p_error);
+	void _fail(std::string p_error);
 
 	void _load_assembly(const std::string &p_file);
 
@@ -254,11 +502,15 @@ private:
 	Node _make_node(Token p_token, std::string p_value, Token p_op = NONE);
 
 	Token _get_op_type(const std::string &p_instruction);
+	bool _decode_register(const std::string &p_name, Node &r_node);
 
 	char _get_next_char();
 	char _look_ahead(const int p_amount);
 public:
-	void assemble(const std::string &p_input_file, const std::string &p_output_file);
+	void assemble(const std::string &p_input_file, const std::string &p_output_file, const Options &p_options);
+
+	/* --run, loads the program into this process and returns what main did */
+	int run(const std::string &p_input_file, const Options &p_options);
 
 	Assembler();
 };
@@ -30,47 +30,150 @@
 
 #include <string>
 #include <vector>
+#include <set>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
-#include "./data_structures/tree_node.h"
+static void _extend_interval(
+		std::unordered_map<int, unsigned int> &p_starts,
+		std::unordered_map<int, unsigned int> &p_ends,
+		int p_register,
+		unsigned int p_position
+) {
+	if (!p_starts.count(p_register) || p_position < p_starts[p_register])
+	{
+		p_starts[p_register] = p_position;
+	}
+
+	if (!p_ends.count(p_register) || p_position > p_ends[p_register])
+	{
+		p_ends[p_register] = p_position;
+	}
+}
+
+/* for .p2align, p_value is a power of two */
+static unsigned int _log2(unsigned int p_value)
+{
+	unsigned int shift = 0;
+	while ((1u << shift) < p_value)
+	{
+		shift++;
+	}
+	return shift;
+}
+
+/* leal only keeps 32 bits, so the displacement wraps like the add it replaces */
+static int _add_displacement(int p_displacement, int p_sign, int p_constant)
+{
+	long long displacement = (long long)p_displacement + p_sign * (long long)p_constant;
+	return (int)(unsigned int)(displacement & 0xFFFFFFFFll);
+}
+
+/*
+ * Signed division by a constant as a multiply high and shift,
+ * Granlund and Montgomery via Hacker's Delight. |p_divisor| >= 2.
+ */
+static void _division_magic(int p_divisor, int &r_multiplier, int &r_shift)
+{
+	const unsigned int two31 = 0x80000000;
+	unsigned int divisor = (p_divisor < 0) ? -(unsigned int)p_divisor : p_divisor;
+	unsigned int t = two31 + ((unsigned int)p_divisor >> 31);
+	unsigned int anc = t - 1 - t % divisor;
+
+	int p = 31;
+	unsigned int q1 = two31 / anc;
+	unsigned int r1 = two31 - q1 * anc;
+	unsigned int q2 = two31 / divisor;
+	unsigned int r2 = two31 - q2 * divisor;
+	unsigned int delta = 0;
+	do
+	{
+		p++;
+		q1 = 2 * q1;
+		r1 = 2 * r1;
+		if (r1 >= anc)
+		{
+			q1++;
+			r1 -= anc;
+		}
+
+		q2 = 2 * q2;
+		r2 = 2 * r2;
+		if (r2 >= divisor)
+		{
+			q2++;
+			r2 -= divisor;
+		}
+		delta = divisor - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+
+	r_multiplier = q2 + 1;
+	if (p_divisor < 0)
+	{
+		r_multiplier = -r_multiplier;
+	}
+	r_shift = p - 32;
+}
 
 void CodeGenerator::generate_code(
-		std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_root,
-		const std::string &p_output_file
+		const std::vector<IRGenerator::Function> &p_functions,
+		const std::string &p_source_file,
+		const std::string &p_output_file,
+		const Options &p_options
 ) {
-	function_map.clear();
-
-	if_counter = 0;
-	if_clause_counter = 0;
-	loop_counter = 0;
-	comp_clause_counter = 0;
+	options = p_options;
 
 	code.clear();
-	current_node_offset = -1;
-	tree_vector = _create_list(p_root);
-	_advance();
+	last_line = 0;
+	table_counter = 0;
+	source_line = 0;
+
+	_append_line(".file 1 \"" + p_source_file + "\"");
 
-	if (current_node.type != TYPE_PROGRAM)
+	/* Inject _start, objects only get it along with main */
+	bool has_main = false;
+	for (const IRGenerator::Function &function : p_functions)
 	{
-		_error("expected program, but found: '" + token_to_string.at(current_node.type) + "'");
+		has_main |= function.name == "main";
 	}
 
-	_advance();
+	if (!options.compile_only || has_main)
+	{
+		_append_line("globl _start");
+		_append_line("_start:");
 
-	/* Inject _start */
-	_append_line("globl _start");
-	_append_line("_start:");
-	_append_line("  push %ebp");
-	_append_line("  movl %esp,%ebp");
-	_append_line("  call main");
-	_append_line("  movl %eax,%edi");
-	_append_line("  push $60");
-	_append_line("  popl %eax");
-	_append_line("  syscall");
-	_append_line("  ret"); /* debug only, not executed. */
+		/* --run calls _start from pcc itself, so it keeps what it uses of pcc's registers and returns */
+		if (options.run)
+		{
+			_append_line("  pushq %rbp");
+			_append_line("  pushq %rbx");
+			_append_line("  subq $8,%rsp");
+		}
+		_append_line("  movq %rsp,%rbp");
+		_append_line("  call main");
+		if (options.profile_generate)
+		{
+			_generate_profile_dump(p_functions);
+		}
 
-	_generate_program();
+		if (options.run)
+		{
+			_append_line("  addq $8,%rsp");
+			_append_line("  popq %rbx");
+			_append_line("  popq %rbp");
+			_append_line("  ret");
+		}
+		else
+		{
+			_append_line("  movl %eax,%edi");
+			_append_line("  movl $60,%eax");
+			_append_line("  syscall");
+			_append_line("  ret"); /* debug only, not executed. */
+		}
+	}
+
+	_generate_program(p_functions);
 
 	std::cout << "-----------------------------------------------" << std::endl;
 	std::ofstream file;
@@ -85,27 +188,6 @@ void CodeGenerator::generate_code(
 	std::cout << "-----------------------------------------------" << std::endl;
 }
 
-std::vector<SymanticAnalysier::Node> CodeGenerator::_create_list(
-		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_root,
-		unsigned int parent_id
-) {
-	std::vector<SymanticAnalysier::Node> node_list;
-	SymanticAnalysier::Node node = p_root->get_data();
-	node.parent_id = parent_id;
-	node_list.push_back(node);
-
-	const std::list<std::unique_ptr<TreeNode<SymanticAnalysier::Node>>> &children = p_root->get_children();
-	for (const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &child : children)
-	{
-		std::vector<SymanticAnalysier::Node> child_nodes = _create_list(child, node.id);
-		for (SymanticAnalysier::Node &childs : child_nodes)
-		{
-			node_list.push_back(childs);
-		}
-	}
-	return node_list;
-}
-
 void CodeGenerator::_error(std::string p_error)
 {
 	std::cout << "error: " << p_error << std::endl;
@@ -117,25 +199,6 @@ void CodeGenerator::_warn(std::string p_warning)
 	std::cout << "warning: " << p_warning << std::endl;
 }
 
-void CodeGenerator::_advance()
-{
-	if (current_node_offset + 1 >= tree_vector.size())
-	{
-		return;
-	}
-	current_node_offset++;
-	current_node = tree_vector[current_node_offset];
-}
-
-Token CodeGenerator::_peek()
-{
-	if (current_node_offset + 1 >= tree_vector.size())
-	{
-		return TK_SEMICOLON;
-	}
-	return tree_vector[current_node_offset+1].type;
-}
-
 void CodeGenerator::_append_line(std::string p_code)
 {
 	_set_line(last_line + 1, p_code);
@@ -153,472 +216,1197 @@ void CodeGenerator::_set_line(unsigned int p_line, std::string p_code)
 }
 
 /*
- * Assembly generation starts here.
+ * Register allocation, linear scan over the blocks in layout order.
  */
 
-void CodeGenerator::_generate_program()
+bool CodeGenerator::_compare_intervals(const Interval &p_a, const Interval &p_b)
 {
-	while (current_node.type == FUNCTION)
+	return p_a.start < p_b.start;
+}
+
+bool CodeGenerator::_spill_first(const Interval &p_a, const Interval &p_b)
+{
+	/* the least used by the profile, otherwise whichever lives the longest */
+	if (spill_weights.empty() || spill_weights[p_a.reg] == spill_weights[p_b.reg])
 	{
-		_generate_function();
+		return p_a.end > p_b.end;
 	}
+	return spill_weights[p_a.reg] < spill_weights[p_b.reg];
 }
 
-void CodeGenerator::_generate_function()
+void CodeGenerator::_allocate_registers(const IRGenerator::Function &p_function)
 {
-	_append_line("globl " + current_node.value);
-	_append_line(current_node.value + ":");
-	function_map[current_node.value] = 0;
+	registers.clear();
+	stack_slots.clear();
+	local_slots.clear();
+	frame_size = 0;
+
+	unsigned int block_count = p_function.blocks.size();
+	std::unordered_map<unsigned int, unsigned int> indices;
+	std::vector<unsigned int> block_start(block_count);
+	std::vector<unsigned int> block_end(block_count);
+	std::vector<std::set<int>> uses(block_count);
+	std::vector<std::set<int>> defs(block_count);
+	std::vector<unsigned int> calls;
+
+	unsigned int position = 0;
+	for (unsigned int i = 0; i < block_count; i++)
+	{
+		indices[p_function.blocks[i].id] = i;
+		block_start[i] = position;
+		for (const IRGenerator::Instruction &instruction : p_function.blocks[i].instructions)
+		{
+			for (int arg : instruction.args)
+			{
+				if (!defs[i].count(arg))
+				{
+					uses[i].insert(arg);
+				}
+			}
 
-	_advance();
+			if (instruction.dest >= 0)
+			{
+				defs[i].insert(instruction.dest);
+			}
 
-	// set up stack frame for this function
-	_append_line("  push %ebp");
-	_append_line("  movl %esp,%ebp");
+			if (instruction.op == IR_CALL)
+			{
+				calls.push_back(position);
+			}
+
+			/* only give locals that are still used a slot */
+			if ((instruction.op == IR_LOAD || instruction.op == IR_STORE) && !local_slots.count(instruction.name))
+			{
+				frame_size += 8;
+				local_slots[instruction.name] = frame_size;
+			}
+			position++;
+		}
+		block_end[i] = position - 1;
+	}
 
-	Scope scope;
-	scope.stack_offset = -16;
-	while (current_node.type == TYPE_IDENTIFIER)
+	std::vector<std::set<int>> live_in(block_count);
+	std::vector<std::set<int>> live_out(block_count);
+	bool updated = true;
+	while (updated)
 	{
-		Var var;
-		var.scope_level = scope.level;
-		var.stack_offset = scope.stack_offset;
-		scope.var_map[current_node.value] = var;
-		scope.stack_offset -= 8;
-		_advance();
+		updated = false;
+		for (int i = block_count - 1; i >= 0; i--)
+		{
+			std::set<int> out;
+			for (unsigned int target : p_function.blocks[i].instructions.back().targets)
+			{
+				const std::set<int> &in = live_in[indices[target]];
+				out.insert(in.begin(), in.end());
+			}
+
+			std::set<int> in = uses[i];
+			for (int reg : out)
+			{
+				if (!defs[i].count(reg))
+				{
+					in.insert(reg);
+				}
+			}
+
+			if (in != live_in[i] || out != live_out[i])
+			{
+				live_in[i] = in;
+				live_out[i] = out;
+				updated = true;
+			}
+		}
 	}
-	scope.stack_offset = 8;
 
-	if (current_node.type == CODE_BLOCK)
+	std::unordered_map<int, unsigned int> starts;
+	std::unordered_map<int, unsigned int> ends;
+	std::unordered_map<int, std::string> hints;
+	position = 0;
+	for (unsigned int i = 0; i < block_count; i++)
 	{
-		_generate_code_block(scope);
+		for (int reg : live_in[i])
+		{
+			_extend_interval(starts, ends, reg, block_start[i]);
+		}
+
+		for (int reg : live_out[i])
+		{
+			_extend_interval(starts, ends, reg, block_end[i]);
+		}
+
+		for (const IRGenerator::Instruction &instruction : p_function.blocks[i].instructions)
+		{
+			/* folded values are computed by the instruction using them */
+			if (selection.folded.count(instruction.dest))
+			{
+				position++;
+				continue;
+			}
+
+			if (instruction.dest >= 0)
+			{
+				_extend_interval(starts, ends, instruction.dest, position);
+			}
+
+			/* register arguments are moved into place by the prologue */
+			if (instruction.op == IR_PARAMETER)
+			{
+				_extend_interval(starts, ends, instruction.dest, 0);
+				if (instruction.value < (int)argument_registers.size())
+				{
+					hints[instruction.dest] = argument_registers[instruction.value];
+				}
+			}
+
+			std::vector<int> operands;
+			_operands(instruction, operands);
+			for (int arg : operands)
+			{
+				_extend_interval(starts, ends, arg, position);
+			}
+			position++;
+		}
 	}
-}
 
-void CodeGenerator::_generate_code_block(const Scope &p_scope)
-{
-	_advance();
-	Scope scope = p_scope;
-	scope.level += 1;
-	while (
-		   current_node.type != FUNCTION &&
-		   current_node.type != TK_BRACE_CLOSE &&
-		   current_node_offset + 1 < tree_vector.size())
+	/* with a profile, how often each value is touched */
+	spill_weights.clear();
+	for (const IRGenerator::Block &block : p_function.blocks)
 	{
-		if (current_node.type == DECLARATION)
+		if (!p_function.block_counts.count(block.id))
 		{
-			scope = _generate_declaration(scope);
 			continue;
 		}
 
-		if (current_node.type == TYPE_ASSIGNMENT_EXPRESSION)
+		unsigned long long count = p_function.block_counts.at(block.id);
+		for (const IRGenerator::Instruction &instruction : block.instructions)
 		{
-			_generate_assignment_expression(scope);
-			continue;
+			for (int arg : instruction.args)
+			{
+				spill_weights[arg] += count;
+			}
+
+			if (instruction.dest >= 0)
+			{
+				spill_weights[instruction.dest] += count;
+			}
 		}
+	}
 
-		_generate_statement(scope);
+	std::vector<Interval> intervals;
+	for (unsigned int reg = 0; reg < p_function.register_count; reg++)
+	{
+		/* constants are used as immediates */
+		if (starts.count(reg) && !selection.folded.count(reg) && !selection.constants.count(reg))
+		{
+			intervals.push_back({(int)reg, starts[reg], ends[reg]});
+		}
 	}
+	std::stable_sort(intervals.begin(), intervals.end(), _compare_intervals);
+
+	std::set<std::string> free_registers(caller_saved_registers.begin(), caller_saved_registers.end());
+	free_registers.insert(callee_saved_registers.begin(), callee_saved_registers.end());
 
-	if (current_node.type != FUNCTION)
+	std::unordered_map<std::string, unsigned int> pending_hints;
+	for (const std::pair<const int, std::string> &hint : hints)
 	{
-		_advance();
+		pending_hints[hint.second]++;
 	}
-}
 
-CodeGenerator::Scope CodeGenerator::_generate_declaration(const Scope &p_scope)
-{
-	_advance();
+	std::vector<Interval> active;
+	std::vector<int> spilled;
+	std::set<std::string> used_registers;
+	for (const Interval &interval : intervals)
+	{
+		if (hints.count(interval.reg))
+		{
+			pending_hints[hints[interval.reg]]--;
+		}
 
-	Scope scope = p_scope;
-	int vars = 0;
-	while (current_node.type == TK_IDENTIFIER)
+		for (int i = active.size() - 1; i >= 0; i--)
+		{
+			if (active[i].end < interval.start)
+			{
+				free_registers.insert(registers[active[i].reg]);
+				active.erase(active.begin() + i);
+			}
+		}
+
+		/* anything live over a call has to be in a callee saved register */
+		bool crosses_call = false;
+		for (unsigned int call : calls)
+		{
+			if (interval.start < call && call < interval.end)
+			{
+				crosses_call = true;
+			}
+		}
+
+		std::vector<std::string> candidates = callee_saved_registers;
+		if (!crosses_call)
+		{
+			candidates.insert(candidates.begin(), caller_saved_registers.begin(), caller_saved_registers.end());
+		}
+
+		/* parameters would rather stay where they arrive */
+		std::string chosen;
+		if (hints.count(interval.reg) && free_registers.count(hints[interval.reg])
+				&& std::find(candidates.begin(), candidates.end(), hints[interval.reg]) != candidates.end())
+		{
+			chosen = hints[interval.reg];
+		}
+
+		/* keep clear of registers that later parameters are hoping for */
+		for (unsigned int i = 0; i < candidates.size() && chosen.empty(); i++)
+		{
+			if (free_registers.count(candidates[i]) && !pending_hints[candidates[i]])
+			{
+				chosen = candidates[i];
+			}
+		}
+
+		for (unsigned int i = 0; i < candidates.size() && chosen.empty(); i++)
+		{
+			if (free_registers.count(candidates[i]))
+			{
+				chosen = candidates[i];
+			}
+		}
+
+		if (!chosen.empty())
+		{
+			registers[interval.reg] = chosen;
+			free_registers.erase(chosen);
+			used_registers.insert(chosen);
+			active.push_back(interval);
+			continue;
+		}
+
+		/* out of registers, spill whichever is the best to spill and has one we can use */
+		int longest = -1;
+		for (unsigned int i = 0; i < active.size(); i++)
+		{
+			if (std::find(candidates.begin(), candidates.end(), registers[active[i].reg]) == candidates.end())
+			{
+				continue;
+			}
+
+			if (longest == -1 || _spill_first(active[i], active[longest]))
+			{
+				longest = i;
+			}
+		}
+
+		if (longest == -1 || !_spill_first(active[longest], interval))
+		{
+			spilled.push_back(interval.reg);
+			continue;
+		}
+
+		registers[interval.reg] = registers[active[longest].reg];
+		registers.erase(active[longest].reg);
+		spilled.push_back(active[longest].reg);
+		active[longest] = interval;
+	}
+
+	saved_registers.clear();
+	for (const std::string &reg : callee_saved_registers)
 	{
-		if (
-			scope.var_map.count(current_node.value) &&
-			scope.var_map[current_node.value].scope_level == scope.level
-		) {
-			_error(current_node.value + " is already defined.");
+		if (used_registers.count(reg))
+		{
+			saved_registers.push_back(reg);
 		}
-		Var var;
-		var.scope_level = scope.level;
-		var.stack_offset = scope.stack_offset;
-		scope.var_map[current_node.value] = var;
-		scope.stack_offset += 8;
-		vars++;
-		_advance();
 	}
 
-	if (current_node.type == TYPE_EXPRESSION)
+	/* slots sit below the saved registers */
+	int saved_size = saved_registers.size() * 8;
+	for (std::pair<const std::string, int> &slot : local_slots)
 	{
-		_generate_expression(scope);
+		slot.second += saved_size;
 	}
 
-	for (int i = 0; i < vars; i++)
+	for (int reg : spilled)
 	{
-		_append_line("  pushl %eax");
+		frame_size += 8;
+		stack_slots[reg] = frame_size + saved_size;
 	}
+	frame_size += saved_size;
 
-	return scope;
+	/* keep the stack 16 byte aligned at calls */
+	if (frame_size % 16 != 0)
+	{
+		frame_size += 8;
+	}
 }
 
-void CodeGenerator::_generate_assignment_expression(const Scope &p_scope)
+void CodeGenerator::_operands(const IRGenerator::Instruction &p_instruction, std::vector<int> &r_operands)
 {
-	_advance();
+	for (int arg : p_instruction.args)
+	{
+		if (selection.folded.count(arg))
+		{
+			_operands(instruction_selector.definition(arg), r_operands);
+			continue;
+		}
+		r_operands.push_back(arg);
+	}
+}
 
-	std::string lvalue = current_node.value;
+std::string CodeGenerator::_quad(const std::string &p_register)
+{
+	return quad_registers.at(p_register);
+}
 
-	_advance();
-	_generate_expression(p_scope);
+std::string CodeGenerator::_slot(int p_offset)
+{
+	if (has_frame)
+	{
+		return std::to_string(-p_offset) + "(%rbp)";
+	}
 
-	int offset = p_scope.var_map.at(lvalue).stack_offset;
-	_append_line("  movl %eax,-" + std::to_string(offset) + "(%ebp)");
+	/*
+	 * Offsets are from where ebp would have been, just below the
+	 * return address. In the red zone rsp is still pointing at the
+	 * return address, leaving the word below it free for the push
+	 * and pop pairs that load constants. Otherwise the frame and
+	 * anything pushed since are below us.
+	 */
+	if (red_zone)
+	{
+		return std::to_string(-p_offset - 8) + "(%rsp)";
+	}
+	return std::to_string(frame_size + stack_adjust - p_offset) + "(%rsp)";
 }
 
-void CodeGenerator::_generate_statement(const Scope &p_scope)
+std::string CodeGenerator::_location(int p_register)
 {
-	if (current_node.type == TK_BRACE_OPEN)
+	if (selection.constants.count(p_register))
 	{
-		_generate_code_block(p_scope);
-		return;
+		return "$" + std::to_string(selection.constants.at(p_register));
 	}
 
-	if (current_node.type == TK_IF)
+	if (registers.count(p_register))
 	{
-		_generate_if_block(p_scope);
-		return;
+		return "%" + registers.at(p_register);
 	}
+	return _slot(stack_slots.at(p_register));
+}
 
-	if (current_node.type == TK_WHILE)
+std::string CodeGenerator::_load(int p_register, const std::string &p_scratch)
+{
+	if (registers.count(p_register))
 	{
-		unsigned int loop = loop_counter++;
+		return registers.at(p_register);
+	}
+	_append_line("  movl " + _location(p_register) + ",%" + p_scratch);
+	return p_scratch;
+}
 
-		_advance(); // WHILE
+void CodeGenerator::_move(int p_register, const std::string &p_destination)
+{
+	std::string source = _location(p_register);
+	if (source != "%" + p_destination)
+	{
+		_append_line("  movl " + source + ",%" + p_destination);
+	}
+}
 
-		_append_line("loop_start_" + std::to_string(loop) + ":");
-		_generate_expression(p_scope);
-		_append_line("  test %eax,%eax");
-		_append_line("  jz loop_end_" + std::to_string(loop));
+void CodeGenerator::_store(const std::string &p_source, int p_register)
+{
+	std::string destination = _location(p_register);
+	if (destination != "%" + p_source)
+	{
+		_append_line("  movl %" + p_source + "," + destination);
+	}
+}
 
-		_advance(); // ;
-		_advance(); // STATEMENT
+void CodeGenerator::_parallel_move(std::vector<std::pair<std::string, std::string>> p_moves)
+{
+	/*
+	 * Moves from source to destination that all happen at once,
+	 * write whatever is no longer needed as a source first and
+	 * break any cycles through eax.
+	 */
+	for (int i = p_moves.size() - 1; i >= 0; i--)
+	{
+		if (p_moves[i].first == p_moves[i].second)
+		{
+			p_moves.erase(p_moves.begin() + i);
+		}
+	}
 
-		if (current_node.type == TK_BRACE_OPEN)
+	while (!p_moves.empty())
+	{
+		bool moved = false;
+		for (unsigned int i = 0; i < p_moves.size(); i++)
 		{
-			_generate_code_block(p_scope);
+			bool blocked = false;
+			for (unsigned int j = 0; j < p_moves.size(); j++)
+			{
+				blocked |= (i != j && p_moves[j].first == p_moves[i].second);
+			}
+
+			if (blocked)
+			{
+				continue;
+			}
+
+			_append_line("  movl " + p_moves[i].first + "," + p_moves[i].second);
+			p_moves.erase(p_moves.begin() + i);
+			moved = true;
+			break;
 		}
-		else
+
+		if (moved)
 		{
-			_generate_statement(p_scope);
+			continue;
 		}
 
-		_append_line("  jmp loop_start_" + std::to_string(loop));
-		_append_line("loop_end_" + std::to_string(loop) + ":");
-		return;
+		std::string held = p_moves[0].second;
+		_append_line("  movl " + held + ",%eax");
+		for (std::pair<std::string, std::string> &move : p_moves)
+		{
+			if (move.first == held)
+			{
+				move.first = "%eax";
+			}
+		}
 	}
+}
 
-	if (current_node.type == TK_FOR)
+/*
+ * Assembly generation starts here.
+ */
+
+void CodeGenerator::_generate_profile_dump(const std::vector<IRGenerator::Function> &p_functions)
+{
+	unsigned int counters = 0;
+	for (const IRGenerator::Function &function : p_functions)
 	{
-		unsigned int loop = loop_counter++;
+		for (const IRGenerator::Block &block : function.blocks)
+		{
+			for (const IRGenerator::Instruction &instruction : block.instructions)
+			{
+				if (instruction.op == IR_PROFILE)
+				{
+					counters = std::max(counters, (unsigned int)instruction.value + 1);
+				}
+			}
+		}
+	}
+
+	/* open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644), write the counts and checksums then the counters, close */
+	_append_line("  movl %eax,%ebx");
+	_append_line("  leaq __profile_file(%rip),%rdi");
+	_append_line("  movl $577,%esi");
+	_append_line("  movl $420,%edx");
+	_append_line("  movl $2,%eax");
+	_append_line("  syscall");
+	_append_line("  movl %eax,%edi");
+	_append_line("  leaq __profile_size(%rip),%rsi");
+	_append_line("  movl $" + std::to_string(8 + p_functions.size() * 4) + ",%edx");
+	_append_line("  movl $1,%eax");
+	_append_line("  syscall");
+	_append_line("  leaq __profile_counters(%rip),%rsi");
+	_append_line("  movl $" + std::to_string(counters * 8) + ",%edx");
+	_append_line("  movl $1,%eax");
+	_append_line("  syscall");
+	_append_line("  movl $3,%eax");
+	_append_line("  syscall");
+	_append_line("  movl %ebx,%eax");
 
-		_advance(); // FOR
+	_append_line(".section .rodata");
+	_append_line("__profile_size:");
+	_append_line("  .long " + std::to_string(counters));
+	_append_line("  .long " + std::to_string(p_functions.size()));
+	for (const IRGenerator::Function &function : p_functions)
+	{
+		_append_line("  .long " + std::to_string(function.profile_checksum));
+	}
+	_append_line("__profile_file:");
+	_append_line("  .asciz \"" + options.profile_file + "\"");
+	_append_line(".section .bss");
+	_append_line("__profile_counters:");
+	_append_line("  .zero " + std::to_string(std::max(counters, 1u) * 8));
+	_append_line(".text");
+}
 
-		 // loop init
-		if (_peek() != TK_SEMICOLON)
+void CodeGenerator::_generate_program(const std::vector<IRGenerator::Function> &p_functions)
+{
+	for (const IRGenerator::Function &function : p_functions)
+	{
+		_generate_function(function);
+	}
+}
+
+void CodeGenerator::_generate_function(const IRGenerator::Function &p_function)
+{
+	selection = instruction_selector.select(p_function);
+	_allocate_registers(p_function);
+
+	/* only blocks that are jumped to need a label, those jumped back to are loop heads */
+	std::set<unsigned int> targeted;
+	std::set<unsigned int> loop_heads;
+	block_labels.clear();
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		block_labels[block.id] = block.label;
+		for (unsigned int target : block.instructions.back().targets)
 		{
-			_generate_expression(p_scope);
+			if (block_labels.count(target))
+			{
+				loop_heads.insert(target);
+			}
+			targeted.insert(target);
 		}
-		else
+	}
+
+	_append_line("globl " + p_function.name);
+	if (options.align_functions > 1)
+	{
+		_append_line(".p2align " + std::to_string(_log2(options.align_functions)));
+	}
+	_append_line(p_function.name + ":");
+
+	/* the prologue belongs to the first line with code */
+	for (const IRGenerator::Instruction &instruction : p_function.blocks[0].instructions)
+	{
+		if (instruction.line > 0)
 		{
-			_advance(); // EXPRESSION
+			_generate_location(instruction.line);
+			break;
 		}
-		_advance(); // ;
+	}
 
-		_append_line("loop_start_" + std::to_string(loop) + ":");
-		// loop condition, if empty make infinate
-		if (_peek() != TK_SEMICOLON)
+	/*
+	 * Leaf functions with a small frame keep everything in the
+	 * red zone below rsp and do not touch the stack at all.
+	 */
+	bool leaf = true;
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		for (const IRGenerator::Instruction &instruction : block.instructions)
 		{
-			_generate_expression(p_scope);
+			leaf &= instruction.op != IR_CALL;
 		}
-		else
+	}
+	red_zone = leaf && frame_size + 8 <= 128;
+	has_frame = !red_zone && !options.omit_frame_pointer;
+	stack_adjust = 0;
+
+	if (red_zone)
+	{
+		for (unsigned int i = 0; i < saved_registers.size(); i++)
 		{
-			_advance();
-			_append_line("  pushl $1");
-			_append_line("  popl %eax");
+			_append_line("  movq %" + _quad(saved_registers[i]) + "," + _slot((i + 1) * 8));
 		}
-		_append_line("  test %eax,%eax");
-		_append_line("  jz loop_end_" + std::to_string(loop));
-		_advance(); // ;
-
-		_advance(); // STATEMENT
-
-		if (current_node.type == TK_BRACE_OPEN)
+	}
+	else
+	{
+		// set up stack frame for this function
+		if (has_frame)
 		{
-			_generate_code_block(p_scope);
+			_append_line("  pushq %rbp");
+			_append_line("  movq %rsp,%rbp");
 		}
 		else
 		{
-			_generate_statement(p_scope);
+			/* keeps the same layout and alignment as having the frame */
+			_append_line("  pushq %rax");
 		}
 
-		// loop post
-		_advance(); // EXPRESSION
-		if (_peek() != TK_SEMICOLON)
+		for (const std::string &reg : saved_registers)
 		{
-			_generate_expression(p_scope);
+			_append_line("  pushq %" + _quad(reg));
 		}
-		else
+
+		for (int i = saved_registers.size() * 8; i < frame_size; i += 8)
 		{
-			_advance(); // EXPRESSION
+			_append_line("  pushq %rax");
 		}
-		_advance(); // ;
-
-		_append_line("  jmp loop_start_" + std::to_string(loop));
-		_append_line("loop_end_" + std::to_string(loop) + ":");
-		return;
 	}
 
-	if (current_node.type == TK_DO)
+	std::vector<std::pair<std::string, std::string>> parameters;
+	for (const IRGenerator::Instruction &instruction : p_function.blocks[0].instructions)
 	{
-		unsigned int loop = loop_counter++;
-
-		_advance(); // DO
-		_advance(); // STATEMENT
+		if (instruction.op == IR_PARAMETER && instruction.value < (int)argument_registers.size())
+		{
+			parameters.push_back({"%" + argument_registers[instruction.value], _location(instruction.dest)});
+		}
+	}
+	_parallel_move(parameters);
 
-		_append_line("loop_start_" + std::to_string(loop) + ":");
-		if (current_node.type == TK_BRACE_OPEN)
+	for (unsigned int i = 0; i < p_function.blocks.size(); i++)
+	{
+		const IRGenerator::Block &block = p_function.blocks[i];
+		if (i > 0 && targeted.count(block.id))
 		{
-			_generate_code_block(p_scope);
+			/* at most half a boundary of padding, it is run on the way into the loop */
+			if (loop_heads.count(block.id) && options.align_loops > 1)
+			{
+				_append_line(".p2align " + std::to_string(_log2(options.align_loops)) + ",," + std::to_string(options.align_loops / 2));
+			}
+			_append_line(block.label + ":");
 		}
-		else
+
+		int next_block = (i + 1 < p_function.blocks.size()) ? p_function.blocks[i + 1].id : -1;
+		for (const IRGenerator::Instruction &instruction : block.instructions)
 		{
-			_generate_statement(p_scope);
+			_generate_instruction(p_function, instruction, next_block);
 		}
-		_advance(); // WHILE
-		_generate_expression(p_scope);
-		_append_line("  test %eax,%eax");
-		_append_line("  jz loop_end_" + std::to_string(loop));
-		_advance(); // ;
+	}
+}
 
-		_append_line("  jmp loop_start_" + std::to_string(loop));
-		_append_line("loop_end_" + std::to_string(loop) + ":");
+void CodeGenerator::_generate_instruction(
+		const IRGenerator::Function &p_function,
+		const IRGenerator::Instruction &p_instruction,
+		int p_next_block
+) {
+	if (selection.folded.count(p_instruction.dest))
+	{
 		return;
 	}
+	_generate_location(p_instruction.line);
+
+	std::string target = "eax";
+	if (p_instruction.dest >= 0 && registers.count(p_instruction.dest))
+	{
+		target = registers.at(p_instruction.dest);
+	}
 
-	if (current_node.type == TK_RETURN)
+	switch (p_instruction.op)
 	{
-		_advance(); // RETURN
+		case IR_CONSTANT:
+		{
+			/* used as an immediate wherever it is needed */
+		} break;
+		case IR_PARAMETER:
+		{
+			/* register arguments were moved by the prologue */
+			if (p_instruction.value < (int)argument_registers.size())
+			{
+				break;
+			}
 
-		if (current_node.type == TYPE_EXPRESSION)
+			/* the rest are pushed right to left above the return address */
+			int offset = 16 + (p_instruction.value - argument_registers.size()) * 8;
+			_append_line("  movl " + _slot(-offset) + ",%" + target);
+			_store(target, p_instruction.dest);
+		} break;
+		case IR_LOAD:
 		{
-			_generate_expression(p_scope);
-		}
-		// restore stack frame
-		_append_line("  movl %ebp,%esp");
-		_append_line("  pop %ebp");
-		_append_line("  ret");
-		return;
+			int offset = local_slots.at(p_instruction.name);
+			_append_line("  movl " + _slot(offset) + ",%" + target);
+			_store(target, p_instruction.dest);
+		} break;
+		case IR_STORE:
+		{
+			int offset = local_slots.at(p_instruction.name);
+			std::string source = _load(p_instruction.args[0], "eax");
+			_append_line("  movl %" + source + "," + _slot(offset));
+		} break;
+		case IR_COPY:
+		{
+			if (registers.count(p_instruction.dest))
+			{
+				_move(p_instruction.args[0], target);
+				break;
+			}
+			_store(_load(p_instruction.args[0], "eax"), p_instruction.dest);
+		} break;
+		case TK_PLUS:
+		case TK_MINUS:
+		case TK_STAR:
+		case TK_DIVIDE:
+		case TK_MODULO:
+		case TK_EQUAL:
+		case TK_LESS_THAN:
+		{
+			_generate_selected(p_instruction);
+		} break;
+		case IR_CALL:
+		{
+			_generate_call(p_instruction);
+		} break;
+		case IR_PROFILE:
+		{
+			/* only ever at the start of a block, so the flags are free */
+			std::string offset = (p_instruction.value > 0) ? "+" + std::to_string(p_instruction.value * 8) : "";
+			_append_line("  incq __profile_counters" + offset + "(%rip)");
+		} break;
+		case IR_JUMP:
+		{
+			if ((int)p_instruction.targets[0] != p_next_block)
+			{
+				_append_line("  jmp " + block_labels.at(p_instruction.targets[0]));
+			}
+		} break;
+		case IR_BRANCH:
+		{
+			_generate_branch(p_instruction, p_next_block);
+		} break;
+		case IR_SWITCH:
+		{
+			_generate_switch(p_instruction);
+		} break;
+		case IR_RETURN:
+		{
+			if (!p_instruction.args.empty())
+			{
+				_move(p_instruction.args[0], "eax");
+			}
+			_generate_epilogue();
+		} break;
+		default:
+		{
+			_error("cannot generate '" + token_to_string.at(p_instruction.op) + "' in " + p_function.name);
+		} break;
 	}
-	_advance();
 }
 
-void CodeGenerator::_generate_if_block(const Scope &p_scope)
+void CodeGenerator::_generate_selected(const IRGenerator::Instruction &p_instruction)
 {
-	std::string end_if_label = "if_" + std::to_string(if_counter++);
+	const InstructionSelector::Match &match = selection.matches.at(p_instruction.dest)[InstructionSelector::NT_REG];
+	const InstructionSelector::Rule &rule = instruction_selector.rules[match.rule];
 
-	// keep track of current node id for nested conditionals
-	unsigned int node_id = current_node.id;
+	std::string target = "eax";
+	if (registers.count(p_instruction.dest))
+	{
+		target = registers.at(p_instruction.dest);
+	}
 
-	while (current_node.type == TK_IF || current_node.type == TK_ELSE)
+	int left = -1;
+	int right = -1;
+	if (rule.op != NONE)
 	{
-		unsigned int clause = if_clause_counter++;
+		left = instruction_selector.operand(p_instruction, match, 0);
+		right = instruction_selector.operand(p_instruction, match, 1);
+	}
 
-		// check if its just the else
-		if (current_node.type == TK_ELSE)
+	switch (rule.emitter)
+	{
+		case InstructionSelector::EMIT_LEA:
 		{
-			_advance(); // ELSE
-		}
+			Address address{"", "", 1, 0};
+			_reduce_address(p_instruction.dest, rule.operands[0], address);
 
-		if (current_node.type == TK_IF)
-		{
-			_advance(); // IF
-			_generate_expression(p_scope);
+			std::string operand = "(";
+			if (!address.base.empty())
+			{
+				operand += "%" + _quad(address.base);
+			}
 
-			_append_line("  test %eax,%eax");
-			_append_line("  jz if_clause_" + std::to_string(clause));
-			_advance(); // ;
-			_advance(); // STATEMENT
-		}
+			if (!address.index.empty())
+			{
+				operand += ",%" + _quad(address.index) + "," + std::to_string(address.scale);
+			}
+			operand += ")";
 
-		if (current_node.type == TK_BRACE_OPEN)
+			if (address.displacement != 0 || address.base.empty())
+			{
+				operand = std::to_string(address.displacement) + operand;
+			}
+			_append_line("  leal " + operand + ",%" + target);
+		} break;
+		case InstructionSelector::EMIT_SETCC:
 		{
-			_generate_code_block(p_scope);
-		}
-		else
+			std::string condition = _reduce_flags(p_instruction.dest);
+			_append_line("  set" + condition + " %al");
+			_append_line("  movzbl %al,%" + target);
+		} break;
+		case InstructionSelector::EMIT_ADD:
+		case InstructionSelector::EMIT_SUB:
+		case InstructionSelector::EMIT_IMUL:
 		{
-			_generate_statement(p_scope);
-		}
-
-		_append_line("  jz " + end_if_label);
-		_append_line("if_clause_" + std::to_string(clause) + ":");
+			/* two address form, so the right hand side must not share the result register */
+			if (rule.emitter != InstructionSelector::EMIT_SUB && _location(right) == "%" + target)
+			{
+				std::swap(left, right);
+			}
 
-		if (current_node.type == TK_ELSE)
-		{
-			// check if we are nested.
-			if (current_node.parent_id == node_id)
+			if (_location(right) == "%" + target)
 			{
-				continue;
+				target = "eax";
 			}
-		}
 
-		_append_line(end_if_label + ":");
+			_move(left, target);
+			std::string source = _load(right, "edx");
 
-		// nested if therefore need to return.
-		if (current_node.type == TK_ELSE)
+			std::string mnemonic = "addl";
+			if (rule.emitter == InstructionSelector::EMIT_SUB)
+			{
+				mnemonic = "subl";
+			}
+			else if (rule.emitter == InstructionSelector::EMIT_IMUL)
+			{
+				mnemonic = "imull";
+			}
+			_append_line("  " + mnemonic + " %" + source + ",%" + target);
+		} break;
+		case InstructionSelector::EMIT_ADD_IMMEDIATE:
+		case InstructionSelector::EMIT_SUB_IMMEDIATE:
 		{
-			return;
-		}
-	}
-}
-
-void CodeGenerator::_generate_expression(const Scope &p_scope)
-{
-	/*
-	 * Use a stack based system
-	 */
-	int pushed_count = 0;
-	std::string previous = "";
-	while (current_node.type != TK_SEMICOLON)
-	{
-		_advance();
-		if (current_node.type == TK_SEMICOLON)
+			std::string mnemonic = (rule.emitter == InstructionSelector::EMIT_ADD_IMMEDIATE) ? "addl" : "subl";
+			_move(left, target);
+			_append_line("  " + mnemonic + " " + _location(right) + ",%" + target);
+		} break;
+		case InstructionSelector::EMIT_INC:
+		case InstructionSelector::EMIT_DEC:
 		{
-			break;
-		}
+			std::string mnemonic = (rule.emitter == InstructionSelector::EMIT_INC) ? "incl" : "decl";
+			_move(left, target);
+			_append_line("  " + mnemonic + " %" + target);
+		} break;
+		case InstructionSelector::EMIT_SHL:
+		{
+			int shift = 0;
+			while ((1 << shift) < selection.constants.at(right))
+			{
+				shift++;
+			}
 
-		if (current_node.type == TK_CONSTANT)
+			_move(left, target);
+			if (shift > 0)
+			{
+				_append_line("  shll $" + std::to_string(shift) + ",%" + target);
+			}
+		} break;
+		case InstructionSelector::EMIT_IMUL_IMMEDIATE:
 		{
-			pushed_count++;
-			_append_line("  pushl $" + current_node.value);
-			continue;
-		}
+			std::string source = _load(left, "edx");
+			_append_line("  imull " + _location(right) + ",%" + source + ",%" + target);
+		} break;
+		case InstructionSelector::EMIT_IDIV:
+		{
+			if (selection.constants.count(right))
+			{
+				_error("division by zero in '" + token_to_string.at(p_instruction.op) + "'");
+			}
 
-		if (current_node.type == FUNCTION_CALL)
+			/* quotient in eax, remainder in edx */
+			_move(left, "eax");
+			_append_line("  cltd");
+			_append_line("  idivl " + _location(right));
+			target = (p_instruction.op == TK_DIVIDE) ? "eax" : "edx";
+		} break;
+		case InstructionSelector::EMIT_DIVIDE_SHIFT:
+		case InstructionSelector::EMIT_MODULO_SHIFT:
 		{
-			std::string function_name = current_node.value;
-			int arg_count = 0;
-			if (_peek() == TYPE_ARGUMENT_EXPRESSION_LIST)
+			int divisor = selection.constants.at(right);
+			int shift = 0;
+			while ((1 << shift) < divisor)
+			{
+				shift++;
+			}
+
+			if (shift == 0)
 			{
-				_advance(); // call
-				_advance(); // arg expression
-				_advance(); // (
-				while (current_node.type == TYPE_EXPRESSION)
+				if (rule.emitter == InstructionSelector::EMIT_DIVIDE_SHIFT)
 				{
-					arg_count++;
-					_generate_expression(p_scope);
-					_advance(); // ;
-					if (_peek() == TYPE_EXPRESSION)
-					{
-						_advance(); // )
-					}
-					_append_line("  pushl %eax");
+					_move(left, target);
+					break;
 				}
+				_append_line("  movl $0,%" + target);
+				break;
 			}
-			_append_line("  call " + function_name);
-			/* remove args, can be improved with add to esp */
-			while (arg_count > 0)
+
+			/* round towards zero by adding divisor - 1 to negative values */
+			_move(left, "eax");
+			if (shift > 1)
 			{
-				_append_line("  popl %ecx");
-				arg_count--;
+				_append_line("  sarl $31,%eax");
 			}
-			_append_line("  pushl %eax"); /* TODO return is in EAX so this can be removed. */
-			pushed_count++;
-			continue;
-		}
+			_append_line("  shrl $" + std::to_string(32 - shift) + ",%eax");
+			_move(left, "edx");
+			_append_line("  addl %eax,%edx");
 
-		if (current_node.type == TK_IDENTIFIER)
+			if (rule.emitter == InstructionSelector::EMIT_DIVIDE_SHIFT)
+			{
+				_append_line("  sarl $" + std::to_string(shift) + ",%edx");
+			}
+			else
+			{
+				_append_line("  andl $" + std::to_string(divisor - 1) + ",%edx");
+				_append_line("  subl %eax,%edx");
+			}
+			target = "edx";
+		} break;
+		case InstructionSelector::EMIT_DIVIDE_MULTIPLY:
+		case InstructionSelector::EMIT_MODULO_MULTIPLY:
 		{
-			if (!p_scope.var_map.count(current_node.value))
+			int divisor = selection.constants.at(right);
+			if (divisor == 1 || divisor == -1)
 			{
-				_error(current_node.value + " is not defined.");
+				if (rule.emitter == InstructionSelector::EMIT_MODULO_MULTIPLY)
+				{
+					_append_line("  movl $0,%" + target);
+					break;
+				}
+
+				_move(left, target);
+				if (divisor == -1)
+				{
+					_append_line("  negl %" + target);
+				}
+				break;
 			}
-			pushed_count++;
-			int offset = p_scope.var_map.at(current_node.value).stack_offset * -1;
-			_append_line("  movl " + std::to_string(offset) + "(%ebp),%eax");
-			_append_line("  pushl %eax");
-			previous = current_node.value;
-			continue;
-		}
 
-		_append_line("  popl %eax");
-		if (pushed_count > 1)
-		{
-			_append_line("  popl %ebx");
-		}
+			int multiplier = 0;
+			int shift = 0;
+			_division_magic(divisor, multiplier, shift);
 
-		switch (current_node.type)
-		{
-			case TK_ASSIGN:
-			{
-				int offset = p_scope.var_map.at(previous).stack_offset;
-				_append_line("  movl %eax,-" + std::to_string(offset) + "(%ebp)");
-			} break;
-			case TK_POST_INCREMENT:
-			{
-				_append_line("  incl %eax");
-			} break;
-			case TK_POST_DECREMENT:
+			/* the high half of the product lands in edx */
+			std::string value = _load(left, "edx");
+			_append_line("  movl $" + std::to_string(multiplier) + ",%eax");
+			_append_line("  imull %" + value);
+			if (divisor > 0 && multiplier < 0)
 			{
-				_append_line("  decl %eax");
-			} break;
-			case TK_PLUS:
-			{
-				_append_line("  addl %ebx,%eax");
-			} break;
-			case TK_MINUS:
+				_append_line("  addl %" + _load(left, "eax") + ",%edx");
+			}
+			else if (divisor < 0 && multiplier > 0)
 			{
-				/* this is a hack - TODO: refactor */
-				_append_line("  subl %eax,%ebx");
-				_append_line("  pushl %ebx");
-				_append_line("  popl %eax");
-			} break;
-			case TK_EQUAL:
+				_append_line("  subl %" + _load(left, "eax") + ",%edx");
+			}
+
+			if (shift > 0)
 			{
-				/* this is a hack - TODO: refactor */
-				_append_line("  cmp %ebx,%eax");
-				_append_line("  jz comp_clause_eq_" + std::to_string(comp_clause_counter));
-				_append_line("  pushl $0");
-				_append_line("  popl %eax");
-				_append_line("  jmp comp_clause_end_" + std::to_string(comp_clause_counter));
-				_append_line("comp_clause_eq_" + std::to_string(comp_clause_counter) + ":");
-				_append_line("  pushl $1");
-				_append_line("  popl %eax");
-				_append_line("comp_clause_end_" + std::to_string(comp_clause_counter) + ":");
-				comp_clause_counter++;
-			} break;
-			case TK_LESS_THAN:
+				_append_line("  sarl $" + std::to_string(shift) + ",%edx");
+			}
+
+			/* plus one when negative, to round towards zero */
+			_append_line("  movl %edx,%eax");
+			_append_line("  shrl $31,%eax");
+			_append_line("  addl %eax,%edx");
+
+			if (rule.emitter == InstructionSelector::EMIT_DIVIDE_MULTIPLY)
 			{
-				/* ditto. */
-				_append_line("  cmp %ebx,%eax");
-				_append_line("  jle comp_clause_eq_" + std::to_string(comp_clause_counter));
-				_append_line("  pushl $1");
-				_append_line("  popl %eax");
-				_append_line("  jmp comp_clause_end_" + std::to_string(comp_clause_counter));
-				_append_line("comp_clause_eq_" + std::to_string(comp_clause_counter) + ":");
-				_append_line("  pushl $0");
-				_append_line("  popl %eax");
-				_append_line("comp_clause_end_" + std::to_string(comp_clause_counter) + ":");
-				comp_clause_counter++;
-			} break;
-			case TK_STAR:
+				target = "edx";
+				break;
+			}
+
+			_append_line("  imull $" + std::to_string(divisor) + ",%edx,%edx");
+			_move(left, target);
+			_append_line("  subl %edx,%" + target);
+		} break;
+		default:
+		{
+			_error("cannot select '" + token_to_string.at(p_instruction.op) + "'");
+		} break;
+	}
+	_store(target, p_instruction.dest);
+}
+
+void CodeGenerator::_generate_branch(const IRGenerator::Instruction &p_instruction, int p_next_block)
+{
+	unsigned int true_block = p_instruction.targets[0];
+	unsigned int false_block = p_instruction.targets[1];
+
+	/* compares folded into the branch jump on their flags */
+	std::string condition = "nz";
+	std::string negated = "z";
+	if (selection.folded.count(p_instruction.args[0]))
+	{
+		condition = _reduce_flags(p_instruction.args[0]);
+		negated = negated_conditions.at(condition);
+	}
+	else
+	{
+		std::string value = _load(p_instruction.args[0], "eax");
+		_append_line("  testl %" + value + ",%" + value);
+	}
+
+	if ((int)false_block == p_next_block)
+	{
+		_append_line("  j" + condition + " " + block_labels.at(true_block));
+		return;
+	}
+
+	_append_line("  j" + negated + " " + block_labels.at(false_block));
+	if ((int)true_block != p_next_block)
+	{
+		_append_line("  jmp " + block_labels.at(true_block));
+	}
+}
+
+void CodeGenerator::_generate_switch(const IRGenerator::Instruction &p_instruction)
+{
+	/*
+	 * Bias the value down to zero so one unsigned compare catches
+	 * both ends of the range, then jump through a table of offsets
+	 * from the table itself. Keeps the table position independent.
+	 */
+	std::string table = "switch_table_" + std::to_string(table_counter++);
+	unsigned int entries = p_instruction.targets.size() - 1;
+
+	_move(p_instruction.args[0], "eax");
+	if (p_instruction.value != 0)
+	{
+		_append_line("  subl $" + std::to_string(p_instruction.value) + ",%eax");
+	}
+	_append_line("  cmpl $" + std::to_string(entries - 1) + ",%eax");
+	_append_line("  ja " + block_labels.at(p_instruction.targets[0]));
+	_append_line("  leaq " + table + "(%rip),%rdx");
+	_append_line("  movslq (%rdx,%rax,4),%rax");
+	_append_line("  addq %rdx,%rax");
+	_append_line("  jmp *%rax");
+
+	_append_line(".section .rodata");
+	_append_line(table + ":");
+	for (unsigned int i = 1; i < p_instruction.targets.size(); i++)
+	{
+		_append_line("  .long " + block_labels.at(p_instruction.targets[i]) + "-" + table);
+	}
+	_append_line(".text");
+}
+
+void CodeGenerator::_generate_location(int p_line)
+{
+	if (p_line > 0 && p_line != source_line)
+	{
+		_append_line(".loc 1 " + std::to_string(p_line));
+		source_line = p_line;
+	}
+}
+
+void CodeGenerator::_reduce_address(int p_value, InstructionSelector::NonTerminal p_goal, Address &r_address)
+{
+	const InstructionSelector::Match &match = selection.matches.at(p_value)[p_goal];
+	const InstructionSelector::Rule &rule = instruction_selector.rules[match.rule];
+	const IRGenerator::Instruction &instruction = instruction_selector.definition(p_value);
+
+	int left = instruction_selector.operand(instruction, match, 0);
+	int right = instruction_selector.operand(instruction, match, 1);
+	int sign = (instruction.op == TK_MINUS) ? -1 : 1;
+	switch (rule.emitter)
+	{
+		case InstructionSelector::EMIT_INDEX:
+		{
+			r_address.index = _load(left, "edx");
+			r_address.scale = selection.constants.at(right);
+		} break;
+		case InstructionSelector::EMIT_INDEX_DISPLACEMENT:
+		{
+			_reduce_address(left, InstructionSelector::NT_INDEX, r_address);
+			r_address.displacement = _add_displacement(r_address.displacement, sign, selection.constants.at(right));
+		} break;
+		case InstructionSelector::EMIT_BASE_OFFSET:
+		{
+			r_address.base = _load(left, "eax");
+			_reduce_address(right, InstructionSelector::NT_OFFSET, r_address);
+		} break;
+		case InstructionSelector::EMIT_BASE_INDEX:
+		{
+			r_address.base = _load(left, "eax");
+			if (rule.operands[1] == InstructionSelector::NT_INDEX)
 			{
-				_append_line("  mull %ebx,%eax");
-			} break;
-		}
+				_reduce_address(right, InstructionSelector::NT_INDEX, r_address);
+				break;
+			}
+			r_address.index = _load(right, "edx");
+		} break;
+		case InstructionSelector::EMIT_BASE_DISPLACEMENT:
+		{
+			r_address.base = _load(left, "eax");
+			r_address.displacement = _add_displacement(r_address.displacement, sign, selection.constants.at(right));
+		} break;
+		case InstructionSelector::EMIT_ADDRESS_DISPLACEMENT:
+		{
+			_reduce_address(left, InstructionSelector::NT_ADDRESS, r_address);
+			r_address.displacement = _add_displacement(r_address.displacement, sign, selection.constants.at(right));
+		} break;
+	}
+}
+
+std::string CodeGenerator::_reduce_flags(int p_value)
+{
+	const InstructionSelector::Match &match = selection.matches.at(p_value)[InstructionSelector::NT_FLAGS];
+	const InstructionSelector::Rule &rule = instruction_selector.rules[match.rule];
+	const IRGenerator::Instruction &instruction = instruction_selector.definition(p_value);
+
+	int left = instruction_selector.operand(instruction, match, 0);
+	int right = instruction_selector.operand(instruction, match, 1);
+	std::string value = _load(left, "eax");
+	switch (rule.emitter)
+	{
+		case InstructionSelector::EMIT_CMP:
+		{
+			_append_line("  cmpl %" + _load(right, "edx") + ",%" + value);
+		} break;
+		case InstructionSelector::EMIT_CMP_IMMEDIATE:
+		{
+			_append_line("  cmpl " + _location(right) + ",%" + value);
+		} break;
+		case InstructionSelector::EMIT_TEST:
+		{
+			/* against zero only the sign is needed for less than */
+			_append_line("  testl %" + value + ",%" + value);
+			return (instruction.op == TK_EQUAL) ? "e" : "s";
+		} break;
+	}
+	return (instruction.op == TK_EQUAL) ? "e" : "l";
+}
+
+void CodeGenerator::_generate_call(const IRGenerator::Instruction &p_instruction)
+{
+	unsigned int stack_arguments = 0;
+	if (p_instruction.args.size() > argument_registers.size())
+	{
+		stack_arguments = p_instruction.args.size() - argument_registers.size();
+	}
+
+	/* keep the stack 16 byte aligned */
+	if (stack_arguments % 2 != 0)
+	{
+		_append_line("  pushq %rax");
+		stack_arguments++;
+		stack_adjust += 8;
+	}
+
+	for (int i = p_instruction.args.size() - 1; i >= (int)argument_registers.size(); i--)
+	{
+		_append_line("  pushq %" + _quad(_load(p_instruction.args[i], "eax")));
+		stack_adjust += 8;
+	}
+
+	std::vector<std::pair<std::string, std::string>> arguments;
+	for (unsigned int i = 0; i < p_instruction.args.size() && i < argument_registers.size(); i++)
+	{
+		arguments.push_back({_location(p_instruction.args[i]), "%" + argument_registers[i]});
+	}
+	_parallel_move(arguments);
+
+	_append_line("  call " + p_instruction.name);
+
+	/* remove args, can be improved with add to esp */
+	for (unsigned int i = 0; i < stack_arguments; i++)
+	{
+		_append_line("  popq %rdx");
+	}
+	stack_adjust = 0;
+	_store("eax", p_instruction.dest);
+}
 
-		_append_line("  pushl %eax");
+void CodeGenerator::_generate_epilogue()
+{
+	for (unsigned int i = 0; i < saved_registers.size(); i++)
+	{
+		_append_line("  movq " + _slot((i + 1) * 8) + ",%" + _quad(saved_registers[i]));
+	}
+
+	// restore stack frame
+	if (has_frame)
+	{
+		_append_line("  movq %rbp,%rsp");
+		_append_line("  popq %rbp");
+	}
+	else if (!red_zone)
+	{
+		/* frame plus the padding in place of ebp */
+		for (int i = 0; i <= frame_size; i += 8)
+		{
+			_append_line("  popq %rdx");
+		}
 	}
-	_append_line("  popl %eax");
+	_append_line("  ret");
 }
 
 CodeGenerator::CodeGenerator()
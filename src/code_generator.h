@@ -34,66 +34,158 @@
 #include <unordered_map>
 
 #include "tokens.h"
-#include "symantic_analysier.h"
+#include "options.h"
+#include "ir_generator.h"
+#include "instruction_selector.h"
 
 class CodeGenerator
 {
 private:
-
-	std::vector<SymanticAnalysier::Node> _create_list(
-			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_root,
-			unsigned int parent_id = 0
-	);
-
 	void _error(std::string p_error);
 	void _warn(std::string p_warning);
 
-	struct Var {
-		unsigned int scope_level = 0;
-		int stack_offset = 0;
+	/*
+	 * System V AMD64, eax and edx are kept free as scratch registers.
+	 * Caller saved registers are tried first as they cost nothing to use.
+	 */
+	const std::vector<std::string> caller_saved_registers
+	{
+		"esi",
+		"edi",
+		"ecx",
+		"r8d",
+		"r9d",
+		"r10d",
+		"r11d"
 	};
 
-	struct Scope {
-		unsigned int level = 0;
-		int stack_offset = 8;
-		std::unordered_map<std::string, Var> var_map;
+	/* preserved across calls, saved in the prologue when used. */
+	const std::vector<std::string> callee_saved_registers
+	{
+		"ebx",
+		"r12d",
+		"r13d",
+		"r14d",
+		"r15d"
 	};
 
-	std::unordered_map<std::string, unsigned int> function_map;
+	/* ints are 32 bit, but saves, pushes and pointers use the whole register. */
+	const std::unordered_map<std::string, std::string> quad_registers
+	{
+		{"eax", "rax"},
+		{"ebx", "rbx"},
+		{"ecx", "rcx"},
+		{"edx", "rdx"},
+		{"esi", "rsi"},
+		{"edi", "rdi"},
+		{"r8d", "r8"},
+		{"r9d", "r9"},
+		{"r10d", "r10"},
+		{"r11d", "r11"},
+		{"r12d", "r12"},
+		{"r13d", "r13"},
+		{"r14d", "r14"},
+		{"r15d", "r15"}
+	};
 
-	unsigned int if_counter;
-	unsigned int if_clause_counter;
+	/* the first six integer arguments, the rest go on the stack. */
+	const std::vector<std::string> argument_registers
+	{
+		"edi",
+		"esi",
+		"edx",
+		"ecx",
+		"r8d",
+		"r9d"
+	};
 
-	unsigned int loop_counter;
+	/* jcc and setcc suffixes, for branching on the false block */
+	const std::unordered_map<std::string, std::string> negated_conditions
+	{
+		{"e", "ne"},
+		{"l", "ge"},
+		{"s", "ns"}
+	};
+
+	struct Interval {
+		int reg;
+		unsigned int start;
+		unsigned int end;
+	};
 
-	unsigned int comp_clause_counter;
+	/* registers are the 32 bit names, base and index are empty when there is none */
+	struct Address {
+		std::string base;
+		std::string index;
+		int scale;
+		int displacement;
+	};
+
+	InstructionSelector instruction_selector;
+	InstructionSelector::Selection selection;
+
+	std::unordered_map<int, std::string> registers;
+	std::unordered_map<int, int> stack_slots;
+	std::unordered_map<std::string, int> local_slots;
+	std::unordered_map<unsigned int, std::string> block_labels;
+	std::vector<std::string> saved_registers;
+	int frame_size;
+
+	/* times each register is used or defined, by the profile */
+	std::unordered_map<int, unsigned long long> spill_weights;
+
+	/* without a frame pointer slots are found through rsp, which moves as we push */
+	Options options;
+	bool has_frame;
+	bool red_zone;
+	int stack_adjust;
 
 	unsigned int last_line;
-	std::vector<std::string> code;
+	unsigned int table_counter;
 
-	unsigned int current_node_offset;
-	std::vector<SymanticAnalysier::Node> tree_vector;
-	SymanticAnalysier::Node current_node;
+	/* the source line of the last .loc, the assembler turns them into the line table */
+	int source_line;
+	std::vector<std::string> code;
 
-	void _advance();
-	Token _peek();
 	void _append_line(std::string p_code);
 	void _set_line(unsigned int p_line, std::string p_code);
 
-	void _generate_program();
-	void _generate_function();
-
-	void _generate_code_block(const Scope &p_scope);
-	Scope _generate_declaration(const Scope &p_scope);
-	void _generate_assignment_expression(const Scope &p_scope);
-	void _generate_statement(const Scope &p_scope);
-	void _generate_if_block(const Scope &p_scope);
-	void _generate_expression(const Scope &p_scope);
+	static bool _compare_intervals(const Interval &p_a, const Interval &p_b);
+	bool _spill_first(const Interval &p_a, const Interval &p_b);
+	void _allocate_registers(const IRGenerator::Function &p_function);
+	void _operands(const IRGenerator::Instruction &p_instruction, std::vector<int> &r_operands);
+
+	std::string _quad(const std::string &p_register);
+	std::string _slot(int p_offset);
+	std::string _location(int p_register);
+	std::string _load(int p_register, const std::string &p_scratch);
+	void _move(int p_register, const std::string &p_destination);
+	void _store(const std::string &p_source, int p_register);
+	void _parallel_move(std::vector<std::pair<std::string, std::string>> p_moves);
+
+	void _generate_profile_dump(const std::vector<IRGenerator::Function> &p_functions);
+	void _generate_program(const std::vector<IRGenerator::Function> &p_functions);
+	void _generate_function(const IRGenerator::Function &p_function);
+	void _generate_instruction(
+			const IRGenerator::Function &p_function,
+			const IRGenerator::Instruction &p_instruction,
+			int p_next_block
+	);
+	void _generate_location(int p_line);
+	void _generate_selected(const IRGenerator::Instruction &p_instruction);
+	void _generate_branch(const IRGenerator::Instruction &p_instruction, int p_next_block);
+	void _generate_switch(const IRGenerator::Instruction &p_instruction);
+	void _reduce_address(int p_value, InstructionSelector::NonTerminal p_goal, Address &r_address);
+	std::string _reduce_flags(int p_value);
+	void _generate_call(const IRGenerator::Instruction &p_instruction);
+	void _generate_epilogue();
 
 public:
 	void generate_code(
-			std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_root,
-			const std::string &p_output_file
+			const std::vector<IRGenerator::Function> &p_functions,
+			const std::string &p_source_file,
+			const std::string &p_output_file,
+			const Options &p_options
 	);
 
 	CodeGenerator();
@@ -28,16 +28,68 @@
 #include "compiler.h"
 
 
-void Compiler::compile(const std::string &p_file_path)
+void Compiler::set_options(const Options &p_options)
+{
+	options = p_options;
+}
+
+std::string Compiler::compile(const std::string &p_file_path)
+{
+	Options file_options;
+	const std::string assembly_file_name = _generate_assembly(p_file_path, file_options);
+
+	const std::string output_file_name = p_file_path.substr(0, p_file_path.find_last_of('.')) + (options.compile_only ? ".o" : "");
+	assembler.assemble(assembly_file_name, output_file_name, file_options);
+	return output_file_name;
+}
+
+int Compiler::run(const std::string &p_file_path)
+{
+	Options file_options;
+	const std::string assembly_file_name = _generate_assembly(p_file_path, file_options);
+	return assembler.run(assembly_file_name, file_options);
+}
+
+std::string Compiler::_generate_assembly(const std::string &p_file_path, Options &r_options)
 {
 	std::unique_ptr<TreeNode<Parser::Node>> parse_tree = parser.parse(p_file_path);
 	std::unique_ptr<TreeNode<SymanticAnalysier::Node>> ast = symantic_analysier.analyise(parse_tree);
-
-	const std::string assembly_file_name = p_file_path.substr(0, p_file_path.find_last_of('.')) + ".s";
-	code_generator.generate_code(ast, assembly_file_name);
+	std::vector<IRGenerator::Function> ir = ir_generator.generate(ast);
 
 	const std::string elf_file_name = p_file_path.substr(0, p_file_path.find_last_of('.'));
-	assembler.assemble(assembly_file_name, elf_file_name);
+
+	/* profiles are written to, and read from, the working directory */
+	r_options = options;
+	if ((options.profile_generate || options.profile_use) && options.profile_file.empty())
+	{
+		r_options.profile_file = elf_file_name.substr(elf_file_name.find_last_of('/') + 1) + ".profile";
+	}
+	optimiser.optimise(ir, r_options);
+
+	const std::string assembly_file_name = elf_file_name + ".s";
+	code_generator.generate_code(ir, p_file_path, assembly_file_name, r_options);
+	return assembly_file_name;
+}
+
+void Compiler::link(const std::vector<std::string> &p_files, const std::string &p_output_file)
+{
+	/* sources are compiled to objects first, objects are taken as they are */
+	Options link_options = options;
+	options.compile_only = true;
+
+	std::vector<std::string> objects;
+	for (const std::string &file : p_files)
+	{
+		if (file.substr(file.find_last_of('.') + 1) == "o")
+		{
+			objects.push_back(file);
+			continue;
+		}
+		objects.push_back(compile(file));
+	}
+	options = link_options;
+
+	linker.link(objects, p_output_file);
 }
 
 Compiler::Compiler()
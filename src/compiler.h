@@ -29,22 +29,38 @@
 #define COMPILER_H
 
 #include <string>
+#include <vector>
 
+#include "options.h"
 #include "parser.h"
 #include "symantic_analysier.h"
+#include "ir_generator.h"
+#include "optimiser.h"
 #include "code_generator.h"
 #include "assembler.h"
+#include "linker.h"
 
 class Compiler
 {
 private:
 	Parser parser;
 	SymanticAnalysier symantic_analysier;
+	IRGenerator ir_generator;
+	Optimiser optimiser;
 	CodeGenerator code_generator;
 	Assembler assembler;
+	Linker linker;
+
+	Options options;
+
+	/* the front end through to the .s file, with the options used for it */
+	std::string _generate_assembly(const std::string &p_file_path, Options &r_options);
 
 public:
-	void compile(const std::string &p_file_path);
+	void set_options(const Options &p_options);
+	std::string compile(const std::string &p_file_path);
+	int run(const std::string &p_file_path);
+	void link(const std::vector<std::string> &p_files, const std::string &p_output_file);
 
 	Compiler();
 };
@@ -0,0 +1,328 @@
+/*************************************************************************/
+/*  instruction_selector.cpp                                             */
+/*************************************************************************/
+/*                       The MIT License (MIT)                           */
+/*************************************************************************/
+/* Copyright (c) 2018 Paul Batty.                                        */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+
+#include "instruction_selector.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * Bottom up tree pattern matching over the IR. An instruction forms
+ * a tree with any operand that is used only by it, in the same block,
+ * and could be computed as part of it. Every tree is labelled with the
+ * cheapest rule for each non terminal, then covered from the root.
+ */
+
+InstructionSelector::Selection InstructionSelector::select(const IRGenerator::Function &p_function)
+{
+	selection = Selection();
+	definitions.clear();
+	definition_blocks.clear();
+	use_counts.clear();
+
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		for (const IRGenerator::Instruction &instruction : block.instructions)
+		{
+			if (instruction.dest >= 0)
+			{
+				definitions[instruction.dest] = &instruction;
+				definition_blocks[instruction.dest] = block.id;
+			}
+
+			if (instruction.op == IR_CONSTANT)
+			{
+				selection.constants[instruction.dest] = instruction.value;
+			}
+
+			for (int arg : instruction.args)
+			{
+				use_counts[arg]++;
+			}
+		}
+	}
+
+	/* backwards, so a tree is folded before its operands are visited as roots */
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		for (int i = block.instructions.size() - 1; i >= 0; i--)
+		{
+			const IRGenerator::Instruction &instruction = block.instructions[i];
+			if (instruction.op == IR_BRANCH)
+			{
+				std::vector<Match> matches(NT_COUNT, Match{-1, false, INFINITE_COST});
+				_match(instruction, block.id, matches);
+				_cover(instruction, matches[NT_STATEMENT], block.id);
+				continue;
+			}
+
+			if (is_selected(instruction.op) && !selection.folded.count(instruction.dest))
+			{
+				_label(instruction.dest);
+				_reduce(instruction.dest, NT_REG, block.id);
+			}
+		}
+	}
+	return selection;
+}
+
+bool InstructionSelector::is_selected(Token p_op)
+{
+	switch (p_op)
+	{
+		case TK_PLUS:
+		case TK_MINUS:
+		case TK_STAR:
+		case TK_DIVIDE:
+		case TK_MODULO:
+		case TK_EQUAL:
+		case TK_LESS_THAN:
+		{
+			return true;
+		} break;
+	}
+	return false;
+}
+
+int InstructionSelector::operand(
+		const IRGenerator::Instruction &p_instruction,
+		const Match &p_match,
+		unsigned int p_index
+) {
+	if (p_match.swapped)
+	{
+		p_index = p_instruction.args.size() - 1 - p_index;
+	}
+	return p_instruction.args[p_index];
+}
+
+const IRGenerator::Instruction &InstructionSelector::definition(int p_value)
+{
+	return *definitions.at(p_value);
+}
+
+bool InstructionSelector::_is_commutative(Token p_op)
+{
+	return p_op == TK_PLUS || p_op == TK_STAR || p_op == TK_EQUAL;
+}
+
+bool InstructionSelector::_is_foldable(int p_value, unsigned int p_block)
+{
+	if (!definitions.count(p_value) || !is_selected(definitions.at(p_value)->op))
+	{
+		return false;
+	}
+	return use_counts[p_value] == 1 && definition_blocks.at(p_value) == p_block;
+}
+
+bool InstructionSelector::_predicate(const Rule &p_rule, const std::vector<int> &p_operands)
+{
+	if (p_rule.predicate == ANY)
+	{
+		return true;
+	}
+
+	for (unsigned int i = 0; i < p_rule.operands.size(); i++)
+	{
+		if (p_rule.operands[i] != NT_IMM || !selection.constants.count(p_operands[i]))
+		{
+			continue;
+		}
+
+		int value = selection.constants.at(p_operands[i]);
+		switch (p_rule.predicate)
+		{
+			case ZERO:
+			{
+				return value == 0;
+			} break;
+			case NONZERO:
+			{
+				return value != 0;
+			} break;
+			case ONE:
+			{
+				return value == 1;
+			} break;
+			case SCALE:
+			{
+				return value == 1 || value == 2 || value == 4 || value == 8;
+			} break;
+			case POWER_OF_TWO:
+			{
+				return value > 0 && (value & (value - 1)) == 0;
+			} break;
+		}
+	}
+	return false;
+}
+
+std::vector<int> InstructionSelector::_operand_costs(int p_value, unsigned int p_block)
+{
+	std::vector<Match> matches(NT_COUNT, Match{-1, false, INFINITE_COST});
+	if (selection.constants.count(p_value))
+	{
+		matches[NT_IMM].cost = 0;
+		_close(matches);
+	}
+	else if (_is_foldable(p_value, p_block))
+	{
+		_label(p_value);
+		matches = selection.matches.at(p_value);
+	}
+	else
+	{
+		/* computed somewhere else, already in a register */
+		matches[NT_REG].cost = 0;
+	}
+
+	std::vector<int> costs;
+	for (const Match &match : matches)
+	{
+		costs.push_back(match.cost);
+	}
+	return costs;
+}
+
+void InstructionSelector::_close(std::vector<Match> &r_matches)
+{
+	bool updated = true;
+	while (updated)
+	{
+		updated = false;
+		for (unsigned int i = 0; i < rules.size(); i++)
+		{
+			const Rule &rule = rules[i];
+			if (rule.op != NONE)
+			{
+				continue;
+			}
+
+			int cost = rule.cost + r_matches[rule.operands[0]].cost;
+			if (cost < r_matches[rule.result].cost)
+			{
+				r_matches[rule.result] = Match{(int)i, false, cost};
+				updated = true;
+			}
+		}
+	}
+}
+
+void InstructionSelector::_match(
+		const IRGenerator::Instruction &p_instruction,
+		unsigned int p_block,
+		std::vector<Match> &r_matches
+) {
+	std::vector<std::vector<int>> operand_costs;
+	for (int arg : p_instruction.args)
+	{
+		operand_costs.push_back(_operand_costs(arg, p_block));
+	}
+
+	for (unsigned int i = 0; i < rules.size(); i++)
+	{
+		const Rule &rule = rules[i];
+		if (rule.op != p_instruction.op || rule.operands.size() != p_instruction.args.size())
+		{
+			continue;
+		}
+
+		for (int swapped = 0; swapped < 2; swapped++)
+		{
+			if (swapped && (!_is_commutative(rule.op) || p_instruction.args.size() != 2))
+			{
+				break;
+			}
+
+			Match match{(int)i, swapped != 0, rule.cost};
+			std::vector<int> operands;
+			for (unsigned int j = 0; j < rule.operands.size(); j++)
+			{
+				operands.push_back(operand(p_instruction, match, j));
+
+				unsigned int arg = swapped ? rule.operands.size() - 1 - j : j;
+				match.cost += operand_costs[arg][rule.operands[j]];
+			}
+
+			if (match.cost < r_matches[rule.result].cost && _predicate(rule, operands))
+			{
+				r_matches[rule.result] = match;
+			}
+		}
+	}
+	_close(r_matches);
+}
+
+void InstructionSelector::_label(int p_value)
+{
+	if (selection.matches.count(p_value))
+	{
+		return;
+	}
+
+	std::vector<Match> matches(NT_COUNT, Match{-1, false, INFINITE_COST});
+	_match(*definitions.at(p_value), definition_blocks.at(p_value), matches);
+	selection.matches[p_value] = matches;
+}
+
+void InstructionSelector::_cover(
+		const IRGenerator::Instruction &p_instruction,
+		const Match &p_match,
+		unsigned int p_block
+) {
+	const Rule &rule = rules[p_match.rule];
+	for (unsigned int i = 0; i < rule.operands.size(); i++)
+	{
+		/* registers are computed by their own instruction, constants wherever they are used */
+		int value = operand(p_instruction, p_match, i);
+		if (rule.operands[i] == NT_REG || selection.constants.count(value))
+		{
+			continue;
+		}
+
+		selection.folded.insert(value);
+		_reduce(value, rule.operands[i], p_block);
+	}
+}
+
+void InstructionSelector::_reduce(int p_value, NonTerminal p_goal, unsigned int p_block)
+{
+	const Match &match = selection.matches.at(p_value)[p_goal];
+	const Rule &rule = rules[match.rule];
+	if (rule.op == NONE)
+	{
+		_reduce(p_value, rule.operands[0], p_block);
+		return;
+	}
+	_cover(*definitions.at(p_value), match, p_block);
+}
+
+InstructionSelector::InstructionSelector()
+{
+
+}
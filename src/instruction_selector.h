@@ -0,0 +1,226 @@
+/*************************************************************************/
+/*  instruction_selector.h                                               */
+/*************************************************************************/
+/*                       The MIT License (MIT)                           */
+/*************************************************************************/
+/* Copyright (c) 2018 Paul Batty.                                        */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#ifndef INSTRUCTION_SELECTOR_H
+#define INSTRUCTION_SELECTOR_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <set>
+
+#include "tokens.h"
+#include "ir_generator.h"
+
+class InstructionSelector
+{
+public:
+	/*
+	 * What a value can be reduced to. REG is a value in a register,
+	 * the rest only exist as operands of whatever they are folded into.
+	 */
+	enum NonTerminal
+	{
+		NT_REG,
+		NT_IMM,
+		NT_INDEX,
+		NT_OFFSET,
+		NT_ADDRESS,
+		NT_FLAGS,
+		NT_STATEMENT,
+		NT_COUNT
+	};
+
+	/* checked against the constant of the rule's NT_IMM operand */
+	enum Predicate
+	{
+		ANY,
+		ZERO,
+		NONZERO,
+		ONE,
+		SCALE,
+		POWER_OF_TWO
+	};
+
+	enum Emitter
+	{
+		EMIT_LOAD_IMMEDIATE,
+		EMIT_LEA,
+		EMIT_SETCC,
+
+		EMIT_ADD,
+		EMIT_ADD_IMMEDIATE,
+		EMIT_INC,
+		EMIT_SUB,
+		EMIT_SUB_IMMEDIATE,
+		EMIT_DEC,
+		EMIT_IMUL,
+		EMIT_IMUL_IMMEDIATE,
+		EMIT_SHL,
+		EMIT_IDIV,
+		EMIT_DIVIDE_SHIFT,
+		EMIT_DIVIDE_MULTIPLY,
+		EMIT_MODULO_SHIFT,
+		EMIT_MODULO_MULTIPLY,
+
+		EMIT_INDEX,
+		EMIT_INDEX_DISPLACEMENT,
+		EMIT_BASE_OFFSET,
+		EMIT_BASE_INDEX,
+		EMIT_BASE_DISPLACEMENT,
+		EMIT_ADDRESS_DISPLACEMENT,
+
+		EMIT_CMP,
+		EMIT_CMP_IMMEDIATE,
+		EMIT_TEST,
+
+		EMIT_BRANCH_FLAGS,
+		EMIT_BRANCH
+	};
+
+	/*
+	 * result <- op(operands...), rules without an op are chain rules
+	 * that turn one non terminal into another. Costs are roughly the
+	 * encoded size in bytes.
+	 */
+	struct Rule
+	{
+		NonTerminal result;
+		Token op;
+		std::vector<NonTerminal> operands;
+		Predicate predicate;
+		int cost;
+		Emitter emitter;
+	};
+
+	/* swapped when a commutative op matched with its operands reversed */
+	struct Match
+	{
+		int rule;
+		bool swapped;
+		int cost;
+	};
+
+	struct Selection
+	{
+		/* best rule for every labelled value and non terminal */
+		std::unordered_map<int, std::vector<Match>> matches;
+
+		/* values computed as part of a later instruction */
+		std::set<int> folded;
+
+		std::unordered_map<int, int> constants;
+	};
+
+	const std::vector<Rule> rules
+	{
+		{NT_REG, NONE, {NT_IMM}, ANY, 5, EMIT_LOAD_IMMEDIATE},
+		{NT_REG, NONE, {NT_ADDRESS}, ANY, 4, EMIT_LEA},
+		{NT_REG, NONE, {NT_OFFSET}, ANY, 6, EMIT_LEA},
+		{NT_REG, NONE, {NT_FLAGS}, ANY, 6, EMIT_SETCC},
+
+		{NT_REG, TK_PLUS, {NT_REG, NT_REG}, ANY, 2, EMIT_ADD},
+		{NT_REG, TK_PLUS, {NT_REG, NT_IMM}, ONE, 2, EMIT_INC},
+		{NT_REG, TK_PLUS, {NT_REG, NT_IMM}, ANY, 6, EMIT_ADD_IMMEDIATE},
+		{NT_REG, TK_MINUS, {NT_REG, NT_REG}, ANY, 2, EMIT_SUB},
+		{NT_REG, TK_MINUS, {NT_REG, NT_IMM}, ONE, 2, EMIT_DEC},
+		{NT_REG, TK_MINUS, {NT_REG, NT_IMM}, ANY, 6, EMIT_SUB_IMMEDIATE},
+		{NT_REG, TK_STAR, {NT_REG, NT_REG}, ANY, 3, EMIT_IMUL},
+		{NT_REG, TK_STAR, {NT_REG, NT_IMM}, POWER_OF_TWO, 3, EMIT_SHL},
+		{NT_REG, TK_STAR, {NT_REG, NT_IMM}, ANY, 6, EMIT_IMUL_IMMEDIATE},
+
+		/* idiv is slow enough that either of the sequences avoiding it win */
+		{NT_REG, TK_DIVIDE, {NT_REG, NT_REG}, ANY, 40, EMIT_IDIV},
+		{NT_REG, TK_DIVIDE, {NT_REG, NT_IMM}, POWER_OF_TWO, 12, EMIT_DIVIDE_SHIFT},
+		{NT_REG, TK_DIVIDE, {NT_REG, NT_IMM}, NONZERO, 20, EMIT_DIVIDE_MULTIPLY},
+		{NT_REG, TK_MODULO, {NT_REG, NT_REG}, ANY, 40, EMIT_IDIV},
+		{NT_REG, TK_MODULO, {NT_REG, NT_IMM}, POWER_OF_TWO, 14, EMIT_MODULO_SHIFT},
+		{NT_REG, TK_MODULO, {NT_REG, NT_IMM}, NONZERO, 24, EMIT_MODULO_MULTIPLY},
+
+		/* a + b*4 + c in a single lea */
+		{NT_INDEX, TK_STAR, {NT_REG, NT_IMM}, SCALE, 0, EMIT_INDEX},
+		{NT_OFFSET, TK_PLUS, {NT_INDEX, NT_IMM}, ANY, 0, EMIT_INDEX_DISPLACEMENT},
+		{NT_OFFSET, TK_MINUS, {NT_INDEX, NT_IMM}, ANY, 0, EMIT_INDEX_DISPLACEMENT},
+		{NT_ADDRESS, TK_PLUS, {NT_REG, NT_OFFSET}, ANY, 0, EMIT_BASE_OFFSET},
+		{NT_ADDRESS, TK_PLUS, {NT_REG, NT_REG}, ANY, 0, EMIT_BASE_INDEX},
+		{NT_ADDRESS, TK_PLUS, {NT_REG, NT_INDEX}, ANY, 0, EMIT_BASE_INDEX},
+		{NT_ADDRESS, TK_PLUS, {NT_REG, NT_IMM}, ANY, 0, EMIT_BASE_DISPLACEMENT},
+		{NT_ADDRESS, TK_MINUS, {NT_REG, NT_IMM}, ANY, 0, EMIT_BASE_DISPLACEMENT},
+		{NT_ADDRESS, TK_PLUS, {NT_ADDRESS, NT_IMM}, ANY, 0, EMIT_ADDRESS_DISPLACEMENT},
+		{NT_ADDRESS, TK_MINUS, {NT_ADDRESS, NT_IMM}, ANY, 0, EMIT_ADDRESS_DISPLACEMENT},
+
+		{NT_FLAGS, TK_EQUAL, {NT_REG, NT_REG}, ANY, 2, EMIT_CMP},
+		{NT_FLAGS, TK_EQUAL, {NT_REG, NT_IMM}, ZERO, 2, EMIT_TEST},
+		{NT_FLAGS, TK_EQUAL, {NT_REG, NT_IMM}, ANY, 6, EMIT_CMP_IMMEDIATE},
+		{NT_FLAGS, TK_LESS_THAN, {NT_REG, NT_REG}, ANY, 2, EMIT_CMP},
+		{NT_FLAGS, TK_LESS_THAN, {NT_REG, NT_IMM}, ZERO, 2, EMIT_TEST},
+		{NT_FLAGS, TK_LESS_THAN, {NT_REG, NT_IMM}, ANY, 6, EMIT_CMP_IMMEDIATE},
+
+		{NT_STATEMENT, IR_BRANCH, {NT_FLAGS}, ANY, 6, EMIT_BRANCH_FLAGS},
+		{NT_STATEMENT, IR_BRANCH, {NT_REG}, ANY, 8, EMIT_BRANCH}
+	};
+
+	Selection select(const IRGenerator::Function &p_function);
+
+	bool is_selected(Token p_op);
+
+	/* the operand of p_instruction matched by the rule's p_index'th operand */
+	int operand(const IRGenerator::Instruction &p_instruction, const Match &p_match, unsigned int p_index);
+
+	const IRGenerator::Instruction &definition(int p_value);
+
+	InstructionSelector();
+
+private:
+	const int INFINITE_COST = 1 << 24;
+
+	Selection selection;
+	std::unordered_map<int, const IRGenerator::Instruction *> definitions;
+	std::unordered_map<int, unsigned int> definition_blocks;
+	std::unordered_map<int, unsigned int> use_counts;
+
+	bool _is_commutative(Token p_op);
+	bool _is_foldable(int p_value, unsigned int p_block);
+	bool _predicate(const Rule &p_rule, const std::vector<int> &p_operands);
+
+	std::vector<int> _operand_costs(int p_value, unsigned int p_block);
+	void _close(std::vector<Match> &r_matches);
+	void _match(
+			const IRGenerator::Instruction &p_instruction,
+			unsigned int p_block,
+			std::vector<Match> &r_matches
+	);
+	void _label(int p_value);
+	void _cover(
+			const IRGenerator::Instruction &p_instruction,
+			const Match &p_match,
+			unsigned int p_block
+	);
+	void _reduce(int p_value, NonTerminal p_goal, unsigned int p_block);
+};
+
+#endif // INSTRUCTION_SELECTOR_H
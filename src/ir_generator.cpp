@@ -0,0 +1,1136 @@
+/*************************************************************************/
+/*  ir_generator.cpp                                                     */
+/*************************************************************************/
+/*                       The MIT License (MIT)                           */
+/*************************************************************************/
+/* Copyright (c) 2018 Paul Batty.                                        */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "ir_generator.h"
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "./data_structures/tree_node.h"
+
+std::vector<IRGenerator::Function> IRGenerator::generate(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_root
+) {
+	if_counter = 0;
+	loop_counter = 0;
+	switch_counter = 0;
+	logical_counter = 0;
+	unreachable_counter = 0;
+
+	std::vector<Function> functions;
+
+	if (p_root->get_data().type != TYPE_PROGRAM)
+	{
+		_error("expected program, but found: '" + token_to_string.at(p_root->get_data().type) + "'");
+	}
+
+	for (const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &child : p_root->get_children())
+	{
+		if (child->get_data().type != FUNCTION)
+		{
+			continue;
+		}
+
+		/* skip forward declarations */
+		if (child->get_children().empty() || child->get_children().back()->get_data().type != CODE_BLOCK)
+		{
+			continue;
+		}
+
+		_generate_function(child);
+		functions.push_back(function);
+	}
+
+	std::cout << "-----------------------------------------------" << std::endl;
+	for (const Function &function : functions)
+	{
+		print_function(function);
+	}
+	std::cout << "-----------------------------------------------" << std::endl;
+
+	return functions;
+}
+
+IRGenerator::Instruction IRGenerator::make_instruction(
+		Token p_op,
+		int p_dest,
+		std::vector<int> p_args,
+		int p_value,
+		std::string p_name
+) {
+	Instruction instruction;
+	instruction.op = p_op;
+	instruction.dest = p_dest;
+	instruction.args = p_args;
+	instruction.value = p_value;
+	instruction.name = p_name;
+	instruction.line = 0;
+	return instruction;
+}
+
+bool IRGenerator::is_terminator(Token p_op)
+{
+	return p_op == IR_JUMP || p_op == IR_BRANCH || p_op == IR_SWITCH || p_op == IR_RETURN;
+}
+
+void IRGenerator::print_function(const Function &p_function)
+{
+	std::cout << "function " << p_function.name << ":" << std::endl;
+	for (const Block &block : p_function.blocks)
+	{
+		std::cout << block.label << ":" << std::endl;
+		for (const Instruction &instruction : block.instructions)
+		{
+			std::cout << "  ";
+			if (instruction.dest >= 0)
+			{
+				std::cout << "%" << instruction.dest << " = ";
+			}
+			std::cout << token_to_string.at(instruction.op);
+
+			if (
+				instruction.op == IR_CONSTANT  ||
+				instruction.op == IR_PARAMETER ||
+				instruction.op == IR_SWITCH    ||
+				(instruction.op == IR_BRANCH && instruction.value != 0)
+			) {
+				std::cout << " " << instruction.value;
+			}
+
+			if (!instruction.name.empty())
+			{
+				std::cout << " " << instruction.name;
+			}
+
+			if (instruction.op == IR_PHI)
+			{
+				for (unsigned int i = 0; i < instruction.args.size(); i++)
+				{
+					for (const Block &incoming : p_function.blocks)
+					{
+						if (incoming.id == instruction.targets[i])
+						{
+							std::cout << " [%" << instruction.args[i] << ", " << incoming.label << "]";
+						}
+					}
+				}
+				std::cout << std::endl;
+				continue;
+			}
+
+			for (int arg : instruction.args)
+			{
+				std::cout << " %" << arg;
+			}
+
+			for (unsigned int target : instruction.targets)
+			{
+				for (const Block &target_block : p_function.blocks)
+				{
+					if (target_block.id == target)
+					{
+						std::cout << " " << target_block.label;
+					}
+				}
+			}
+			std::cout << std::endl;
+		}
+	}
+}
+
+void IRGenerator::_error(std::string p_error)
+{
+	std::cout << "error: " << p_error << std::endl;
+	exit(0);
+}
+
+void IRGenerator::_warn(std::string p_warning)
+{
+	std::cout << "warning: " << p_warning << std::endl;
+}
+
+unsigned int IRGenerator::_create_block(std::string p_label)
+{
+	unsigned int id = function.block_count++;
+	pending_blocks[id] = p_label;
+	return id;
+}
+
+void IRGenerator::_begin_block(unsigned int p_id)
+{
+	Block block;
+	block.id = p_id;
+	block.label = pending_blocks.at(p_id);
+	pending_blocks.erase(p_id);
+
+	function.blocks.push_back(block);
+	current_block = function.blocks.size() - 1;
+}
+
+bool IRGenerator::_is_terminated()
+{
+	const std::vector<Instruction> &instructions = function.blocks[current_block].instructions;
+	return !instructions.empty() && is_terminator(instructions.back().op);
+}
+
+int IRGenerator::_emit(
+		Token p_op,
+		std::vector<int> p_args,
+		int p_value,
+		std::string p_name
+) {
+	/* anything after a jump or return can never be reached. */
+	if (_is_terminated())
+	{
+		_begin_block(_create_block("unreachable_" + std::to_string(unreachable_counter++)));
+	}
+
+	int dest = -1;
+	if (p_op != IR_STORE && !is_terminator(p_op))
+	{
+		dest = function.register_count++;
+	}
+
+	function.blocks[current_block].instructions.push_back(
+		make_instruction(p_op, dest, p_args, p_value, p_name)
+	);
+	function.blocks[current_block].instructions.back().line = current_line;
+	return dest;
+}
+
+void IRGenerator::_emit_jump(unsigned int p_target)
+{
+	if (_is_terminated())
+	{
+		return;
+	}
+	_emit(IR_JUMP);
+	function.blocks[current_block].instructions.back().targets.push_back(p_target);
+}
+
+void IRGenerator::_emit_branch(int p_condition, unsigned int p_true, unsigned int p_false, int p_hint)
+{
+	/* empty conditions are always true, ie for (;;) */
+	if (p_condition < 0)
+	{
+		_emit_jump(p_true);
+		return;
+	}
+
+	_emit(IR_BRANCH, {p_condition}, p_hint);
+	function.blocks[current_block].instructions.back().targets.push_back(p_true);
+	function.blocks[current_block].instructions.back().targets.push_back(p_false);
+}
+
+std::string IRGenerator::_declare_local(const std::string &p_name)
+{
+	Scope &scope = scopes.back();
+	if (scope.var_map.count(p_name) && scope.var_map[p_name].scope_level == scope.level)
+	{
+		_error(p_name + " is already defined.");
+	}
+
+	/* shadowed variables get their own local */
+	std::string local = p_name;
+	unsigned int count = 0;
+	while (std::find(function.locals.begin(), function.locals.end(), local) != function.locals.end())
+	{
+		local = p_name + "." + std::to_string(++count);
+	}
+	function.locals.push_back(local);
+
+	Var var;
+	var.scope_level = scope.level;
+	var.local = local;
+	scope.var_map[p_name] = var;
+	return local;
+}
+
+std::string IRGenerator::_lookup_local(const std::string &p_name)
+{
+	if (!scopes.back().var_map.count(p_name))
+	{
+		_error(p_name + " is not defined.");
+	}
+	return scopes.back().var_map.at(p_name).local;
+}
+
+void IRGenerator::_push_scope()
+{
+	Scope scope = scopes.back();
+	scope.level += 1;
+	scopes.push_back(scope);
+}
+
+void IRGenerator::_pop_scope()
+{
+	scopes.pop_back();
+}
+
+/*
+ * IR generation starts here.
+ */
+
+void IRGenerator::_generate_function(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	function = Function();
+	function.name = p_node->get_data().value;
+	current_line = p_node->get_data().line;
+	function.parameter_count = 0;
+	function.register_count = 0;
+	function.block_count = 0;
+
+	pending_blocks.clear();
+	loops.clear();
+	switches.clear();
+	scopes.clear();
+	scopes.push_back(Scope());
+
+	_begin_block(_create_block(function.name));
+
+	for (const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &child : p_node->get_children())
+	{
+		if (child->get_data().type == TYPE_IDENTIFIER)
+		{
+			std::string local = _declare_local(child->get_data().value);
+			int value = _emit(IR_PARAMETER, {}, function.parameter_count++);
+			_emit(IR_STORE, {value}, 0, local);
+			continue;
+		}
+
+		if (child->get_data().type == CODE_BLOCK)
+		{
+			_push_scope();
+			_generate_statements(child);
+			_pop_scope();
+		}
+	}
+
+	/* falling off the end returns 0 */
+	if (!_is_terminated())
+	{
+		int value = _emit(IR_CONSTANT, {}, 0);
+		_emit(IR_RETURN, {value});
+	}
+}
+
+void IRGenerator::_generate_statements(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	for (const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &child : p_node->get_children())
+	{
+		current_line = (child->get_data().line > 0) ? child->get_data().line : current_line;
+		switch (child->get_data().type)
+		{
+			case TK_BRACE_OPEN:
+			{
+				_push_scope();
+			} break;
+			case TK_BRACE_CLOSE:
+			{
+				_pop_scope();
+			} break;
+			case DECLARATION:
+			{
+				_generate_declaration(child);
+			} break;
+			case TYPE_ASSIGNMENT_EXPRESSION:
+			{
+				_generate_assignment_expression(child);
+			} break;
+			case TYPE_STATEMENT:
+			{
+				_generate_statements(child);
+			} break;
+			case TK_IF:
+			{
+				_generate_if_block(child);
+			} break;
+			case TK_SWITCH:
+			{
+				_generate_switch(child);
+			} break;
+			case TK_CASE:
+			case TK_DEFAULT:
+			{
+				_generate_case(child);
+			} break;
+			case TK_WHILE:
+			{
+				_generate_while(child);
+			} break;
+			case TK_DO:
+			{
+				_generate_do(child);
+			} break;
+			case TK_FOR:
+			{
+				_generate_for(child);
+			} break;
+			case TK_RETURN:
+			{
+				_generate_return(child);
+			} break;
+			case TK_BREAK:
+			case TK_CONTINUE:
+			{
+				_generate_loop_jump(child);
+			} break;
+			case TK_GOTO:
+			{
+				_warn("goto is not supported, ignoring.");
+			} break;
+		}
+	}
+}
+
+void IRGenerator::_generate_declaration(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	std::vector<std::string> vars;
+	int value = -1;
+	for (const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &child : p_node->get_children())
+	{
+		if (child->get_data().type == TK_IDENTIFIER)
+		{
+			vars.push_back(_declare_local(child->get_data().value));
+			continue;
+		}
+
+		if (child->get_data().type == TYPE_EXPRESSION)
+		{
+			value = _generate_expression(child);
+		}
+	}
+
+	if (value < 0)
+	{
+		return;
+	}
+
+	for (const std::string &var : vars)
+	{
+		_emit(IR_STORE, {value}, 0, var);
+	}
+}
+
+void IRGenerator::_generate_assignment_expression(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	const std::list<std::unique_ptr<TreeNode<SymanticAnalysier::Node>>> &children = p_node->get_children();
+
+	std::string local = _lookup_local(children.front()->get_data().value);
+	int value = _generate_expression(children.back());
+	if (value < 0)
+	{
+		_error("expected expression in assignment to " + children.front()->get_data().value);
+	}
+	_emit(IR_STORE, {value}, 0, local);
+}
+
+void IRGenerator::_generate_if_block(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	std::string id = std::to_string(if_counter++);
+
+	const std::list<std::unique_ptr<TreeNode<SymanticAnalysier::Node>>> &children = p_node->get_children();
+	std::list<std::unique_ptr<TreeNode<SymanticAnalysier::Node>>>::const_iterator child = children.begin();
+
+	unsigned int then_block = _create_block("if_then_" + id);
+	unsigned int end_block = _create_block("if_end_" + id);
+	unsigned int else_block = end_block;
+
+	bool has_else = children.back()->get_data().type == TK_ELSE;
+	if (has_else)
+	{
+		else_block = _create_block("if_else_" + id);
+	}
+
+	_generate_condition(*child, then_block, else_block);
+	++child;
+
+	_begin_block(then_block);
+	_generate_statements(*child);
+	_emit_jump(end_block);
+
+	if (has_else)
+	{
+		_begin_block(else_block);
+		_generate_statements(children.back());
+		_emit_jump(end_block);
+	}
+
+	_begin_block(end_block);
+}
+
+void IRGenerator::_generate_switch(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	std::string id = std::to_string(switch_counter++);
+
+	int value = _generate_expression(p_node->get_children().front());
+	if (value < 0)
+	{
+		_error("expected expression in switch");
+	}
+
+	unsigned int end_block = _create_block("switch_end_" + id);
+
+	/* every label needs its block before the dispatch can jump to it */
+	switches.push_back(Switch());
+	switches.back().test_count = 0;
+
+	std::vector<Case> cases;
+	int default_block = -1;
+	_collect_cases(p_node->get_children().back(), id, cases, default_block);
+
+	std::sort(cases.begin(), cases.end(), _compare_cases);
+	for (unsigned int i = 1; i < cases.size(); i++)
+	{
+		if (cases[i].value == cases[i - 1].value)
+		{
+			_error("duplicate case value " + std::to_string(cases[i].value));
+		}
+	}
+
+	if (default_block < 0)
+	{
+		default_block = end_block;
+	}
+
+	if (cases.empty())
+	{
+		_emit_jump(default_block);
+	}
+	else
+	{
+		_generate_case_tree(value, cases, 0, cases.size(), default_block, id);
+	}
+
+	/* break leaves the switch, continue still belongs to the enclosing loop */
+	unsigned int continue_block = loops.empty() ? end_block : loops.back().continue_block;
+	loops.push_back({continue_block, end_block});
+	_generate_statements(p_node->get_children().back());
+	loops.pop_back();
+	switches.pop_back();
+	_emit_jump(end_block);
+
+	_begin_block(end_block);
+}
+
+void IRGenerator::_collect_cases(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node,
+		const std::string &p_id,
+		std::vector<Case> &r_cases,
+		int &r_default
+) {
+	for (const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &child : p_node->get_children())
+	{
+		SymanticAnalysier::Node node = child->get_data();
+
+		/* nested switches own their labels */
+		if (node.type == TK_SWITCH)
+		{
+			continue;
+		}
+
+		if (node.type == TK_CASE)
+		{
+			unsigned int block = _create_block("switch_case_" + p_id + "_" + std::to_string(r_cases.size()));
+			switches.back().labels[node.id] = block;
+			r_cases.push_back({_evaluate_constant(child->get_children().front()), block});
+		}
+		else if (node.type == TK_DEFAULT)
+		{
+			if (r_default >= 0)
+			{
+				_error("multiple default labels in one switch");
+			}
+			r_default = _create_block("switch_default_" + p_id);
+			switches.back().labels[node.id] = r_default;
+		}
+		_collect_cases(child, p_id, r_cases, r_default);
+	}
+}
+
+int IRGenerator::_evaluate_constant(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	/* case labels and hints, the same postfix walk as expressions but with numbers */
+	std::vector<long long> stack;
+	for (const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &child : p_node->get_children())
+	{
+		SymanticAnalysier::Node node = child->get_data();
+		if (node.type == TK_SEMICOLON)
+		{
+			break;
+		}
+
+		if (node.type == TK_CONSTANT)
+		{
+			stack.push_back(std::stoi(node.value));
+			continue;
+		}
+
+		if (stack.size() < 2)
+		{
+			_error("expected an integer constant expression");
+		}
+		long long right = stack.back();
+		stack.pop_back();
+		long long left = stack.back();
+		stack.pop_back();
+
+		switch (node.type)
+		{
+			case TK_PLUS:
+			{
+				stack.push_back((int)(left + right));
+			} break;
+			case TK_MINUS:
+			{
+				stack.push_back((int)(left - right));
+			} break;
+			case TK_STAR:
+			{
+				stack.push_back((int)(left * right));
+			} break;
+			case TK_DIVIDE:
+			case TK_MODULO:
+			{
+				if (right == 0)
+				{
+					_error("division by zero in constant expression");
+				}
+				stack.push_back((int)((node.type == TK_DIVIDE) ? left / right : left % right));
+			} break;
+			case TK_EQUAL:
+			{
+				stack.push_back(left == right);
+			} break;
+			case TK_LESS_THAN:
+			{
+				stack.push_back(left < right);
+			} break;
+			default:
+			{
+				_error("expected an integer constant expression");
+			} break;
+		}
+	}
+
+	if (stack.size() != 1)
+	{
+		_error("expected an integer constant expression");
+	}
+	return stack.back();
+}
+
+bool IRGenerator::_compare_cases(const Case &p_a, const Case &p_b)
+{
+	return p_a.value < p_b.value;
+}
+
+void IRGenerator::_generate_case_tree(
+		int p_value,
+		const std::vector<Case> &p_cases,
+		unsigned int p_begin,
+		unsigned int p_end,
+		unsigned int p_default,
+		const std::string &p_id
+) {
+	unsigned int count = p_end - p_begin;
+	long long range = (long long)p_cases[p_end - 1].value - p_cases[p_begin].value + 1;
+
+	/* targets[0] is taken when out of range, targets[1 + i] for the lowest case + i */
+	if (count >= jump_table_minimum && range <= (long long)count * jump_table_density)
+	{
+		int lowest = p_cases[p_begin].value;
+		_emit(IR_SWITCH, {p_value}, lowest);
+
+		std::vector<unsigned int> &targets = function.blocks[current_block].instructions.back().targets;
+		targets.assign(range + 1, p_default);
+		for (unsigned int i = p_begin; i < p_end; i++)
+		{
+			targets[1 + p_cases[i].value - lowest] = p_cases[i].block;
+		}
+		return;
+	}
+
+	if (count <= linear_case_maximum)
+	{
+		for (unsigned int i = p_begin; i < p_end; i++)
+		{
+			unsigned int next_block = p_default;
+			if (i + 1 < p_end)
+			{
+				next_block = _create_block("switch_test_" + p_id + "_" + std::to_string(switches.back().test_count++));
+			}
+
+			int constant = _emit(IR_CONSTANT, {}, p_cases[i].value);
+			_emit_branch(_emit(TK_EQUAL, {p_value, constant}), p_cases[i].block, next_block);
+
+			if (i + 1 < p_end)
+			{
+				_begin_block(next_block);
+			}
+		}
+		return;
+	}
+
+	/* split on the middle case, each half may still be dense enough for a table */
+	unsigned int middle = p_begin + count / 2;
+	unsigned int low_block = _create_block("switch_test_" + p_id + "_" + std::to_string(switches.back().test_count++));
+	unsigned int high_block = _create_block("switch_test_" + p_id + "_" + std::to_string(switches.back().test_count++));
+
+	int constant = _emit(IR_CONSTANT, {}, p_cases[middle].value);
+	_emit_branch(_emit(TK_LESS_THAN, {p_value, constant}), low_block, high_block);
+
+	_begin_block(low_block);
+	_generate_case_tree(p_value, p_cases, p_begin, middle, p_default, p_id);
+
+	_begin_block(high_block);
+	_generate_case_tree(p_value, p_cases, middle, p_end, p_default, p_id);
+}
+
+void IRGenerator::_generate_case(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	if (switches.empty() || !switches.back().labels.count(p_node->get_data().id))
+	{
+		_warn("'" + p_node->get_data().value + "' outside of a switch, ignoring.");
+		_generate_statements(p_node->get_children().back());
+		return;
+	}
+
+	/* falls through from the case before */
+	unsigned int block = switches.back().labels.at(p_node->get_data().id);
+	_emit_jump(block);
+	_begin_block(block);
+	_generate_statements(p_node->get_children().back());
+}
+
+void IRGenerator::_generate_while(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	/*
+	 * Rotated, the condition is tested once on entry then again at
+	 * the bottom, so each iteration is a single conditional jump back.
+	 */
+	std::string id = std::to_string(loop_counter++);
+
+	unsigned int body_block = _create_block("loop_body_" + id);
+	unsigned int condition_block = _create_block("loop_condition_" + id);
+	unsigned int end_block = _create_block("loop_end_" + id);
+
+	_generate_condition(p_node->get_children().front(), body_block, end_block);
+
+	_begin_block(body_block);
+	loops.push_back({condition_block, end_block});
+	_generate_statements(p_node->get_children().back());
+	loops.pop_back();
+	_emit_jump(condition_block);
+
+	_begin_block(condition_block);
+	_generate_condition(p_node->get_children().front(), body_block, end_block);
+
+	_begin_block(end_block);
+}
+
+void IRGenerator::_generate_do(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	std::string id = std::to_string(loop_counter++);
+
+	unsigned int start_block = _create_block("loop_start_" + id);
+	unsigned int condition_block = _create_block("loop_condition_" + id);
+	unsigned int end_block = _create_block("loop_end_" + id);
+
+	_emit_jump(start_block);
+	_begin_block(start_block);
+	loops.push_back({condition_block, end_block});
+	_generate_statements(p_node->get_children().front());
+	loops.pop_back();
+	_emit_jump(condition_block);
+
+	/* WHILE holds the condition */
+	_begin_block(condition_block);
+	_generate_condition(p_node->get_children().back()->get_children().front(), start_block, end_block);
+
+	_begin_block(end_block);
+}
+
+void IRGenerator::_generate_for(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	std::string id = std::to_string(loop_counter++);
+
+	const std::list<std::unique_ptr<TreeNode<SymanticAnalysier::Node>>> &children = p_node->get_children();
+	std::list<std::unique_ptr<TreeNode<SymanticAnalysier::Node>>>::const_iterator child = children.begin();
+
+	unsigned int body_block = _create_block("loop_body_" + id);
+	unsigned int post_block = _create_block("loop_post_" + id);
+	unsigned int end_block = _create_block("loop_end_" + id);
+
+	// loop init
+	_generate_expression(*child);
+	++child;
+
+	/* rotated like while, the post block tests the condition again */
+	const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &condition = *child;
+	_generate_condition(condition, body_block, end_block);
+	++child;
+
+	_begin_block(body_block);
+	loops.push_back({post_block, end_block});
+	_generate_statements(*child);
+	loops.pop_back();
+	_emit_jump(post_block);
+	++child;
+
+	// loop post, wrapped in an extra expression
+	_begin_block(post_block);
+	if (child != children.end() && !(*child)->get_children().empty())
+	{
+		_generate_expression((*child)->get_children().front());
+	}
+	_generate_condition(condition, body_block, end_block);
+
+	_begin_block(end_block);
+}
+
+void IRGenerator::_generate_return(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	int value = -1;
+	if (!p_node->get_children().empty())
+	{
+		value = _generate_expression(p_node->get_children().front());
+	}
+
+	if (value < 0)
+	{
+		_emit(IR_RETURN);
+		return;
+	}
+	_emit(IR_RETURN, {value});
+}
+
+void IRGenerator::_generate_loop_jump(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	Token type = p_node->get_data().type;
+	if (loops.empty())
+	{
+		_warn("'" + p_node->get_data().value + "' outside of a loop, ignoring.");
+		return;
+	}
+	_emit_jump(type == TK_BREAK ? loops.back().break_block : loops.back().continue_block);
+}
+
+int IRGenerator::_generate_expression(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+) {
+	Postfix postfix;
+	std::vector<int> roots;
+	_build_postfix(p_node, postfix, roots);
+
+	int value = -1;
+	for (int root : roots)
+	{
+		value = _generate_operand(postfix, root).reg;
+	}
+	return value;
+}
+
+void IRGenerator::_generate_condition(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node,
+		unsigned int p_true,
+		unsigned int p_false,
+		int p_hint
+) {
+	Postfix postfix;
+	std::vector<int> roots;
+	_build_postfix(p_node, postfix, roots);
+
+	/* empty conditions are always true, ie for (;;) */
+	if (roots.empty())
+	{
+		_emit_jump(p_true);
+		return;
+	}
+
+	for (unsigned int i = 0; i + 1 < roots.size(); i++)
+	{
+		_generate_operand(postfix, roots[i]);
+	}
+	_generate_jumping_code(postfix, roots.back(), p_true, p_false, p_hint);
+}
+
+void IRGenerator::_build_postfix(
+		const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node,
+		Postfix &r_postfix,
+		std::vector<int> &r_roots
+) {
+	/*
+	 * Expressions are in postfix order, so a stack of where each
+	 * operand starts gives the span of every sub expression. Anything
+	 * left on the stack at the end is evaluated in order.
+	 */
+	std::vector<int> stack;
+	for (const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &child : p_node->get_children())
+	{
+		SymanticAnalysier::Node node = child->get_data();
+		if (node.type == TK_SEMICOLON)
+		{
+			break;
+		}
+
+		int index = r_postfix.nodes.size();
+		r_postfix.nodes.push_back(child.get());
+
+		switch (node.type)
+		{
+			case TK_CONSTANT:
+			case TK_IDENTIFIER:
+			case FUNCTION_CALL:
+			{
+				stack.push_back(index);
+			} break;
+			case TK_POST_INCREMENT:
+			case TK_POST_DECREMENT:
+			{
+				if (stack.empty())
+				{
+					_error("expected operand for '" + node.value + "'");
+				}
+			} break;
+			case TK_ASSIGN:
+			case TK_PLUS:
+			case TK_MINUS:
+			case TK_STAR:
+			case TK_DIVIDE:
+			case TK_MODULO:
+			case TK_EQUAL:
+			case TK_LESS_THAN:
+			case TK_AND:
+			case TK_OR:
+			{
+				if (stack.size() < 2)
+				{
+					_error("expected two operands for '" + node.value + "'");
+				}
+				stack.pop_back();
+			} break;
+			default:
+			{
+				_error("unsupported operator '" + node.value + "'");
+			} break;
+		}
+		r_postfix.starts.push_back(stack.back());
+	}
+
+	r_roots.clear();
+	for (unsigned int i = 0; i < stack.size(); i++)
+	{
+		/* each root ends just before the next one starts */
+		r_roots.push_back((i + 1 < stack.size()) ? stack[i + 1] - 1 : (int)r_postfix.nodes.size() - 1);
+	}
+}
+
+IRGenerator::Operand IRGenerator::_generate_operand(const Postfix &p_postfix, int p_end)
+{
+	TreeNode<SymanticAnalysier::Node> *child = p_postfix.nodes[p_end];
+	SymanticAnalysier::Node node = child->get_data();
+
+	/* the right operand ends just before the operator, the left just before that starts */
+	int right = p_end - 1;
+	int left = (right >= 0) ? p_postfix.starts[right] - 1 : -1;
+
+	switch (node.type)
+	{
+		case TK_CONSTANT:
+		{
+			return {_emit(IR_CONSTANT, {}, std::stoi(node.value)), ""};
+		} break;
+		case TK_IDENTIFIER:
+		{
+			std::string local = _lookup_local(node.value);
+			return {_emit(IR_LOAD, {}, 0, local), local};
+		} break;
+		case FUNCTION_CALL:
+		{
+			std::vector<int> args;
+			for (const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &list : child->get_children())
+			{
+				for (const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &arg : list->get_children())
+				{
+					if (arg->get_data().type == TYPE_EXPRESSION)
+					{
+						args.push_back(_generate_expression(arg));
+					}
+				}
+			}
+
+			/* only a hint for branches, as a value it is just the first argument */
+			if (node.value == "__builtin_expect")
+			{
+				if (args.size() != 2)
+				{
+					_error("__builtin_expect takes two arguments");
+				}
+				return {args[0], ""};
+			}
+			return {_emit(IR_CALL, args, 0, node.value), ""};
+		} break;
+		case TK_POST_INCREMENT:
+		case TK_POST_DECREMENT:
+		{
+			Operand operand = _generate_operand(p_postfix, right);
+			if (operand.local.empty())
+			{
+				_error("lvalue required as operand of '" + node.value + "'");
+			}
+
+			/* stores the new value, but the expression is the old one */
+			int one = _emit(IR_CONSTANT, {}, 1);
+			Token op = (node.type == TK_POST_INCREMENT) ? TK_PLUS : TK_MINUS;
+			_emit(IR_STORE, {_emit(op, {operand.reg, one})}, 0, operand.local);
+			return {operand.reg, ""};
+		} break;
+		case TK_AND:
+		case TK_OR:
+		{
+			/* only as a value does the result need to exist, the branches store it */
+			std::string id = std::to_string(logical_counter++);
+			unsigned int true_block = _create_block("logical_true_" + id);
+			unsigned int false_block = _create_block("logical_false_" + id);
+			unsigned int end_block = _create_block("logical_end_" + id);
+
+			std::string local = ".logical" + id;
+			function.locals.push_back(local);
+
+			_generate_jumping_code(p_postfix, p_end, true_block, false_block);
+
+			_begin_block(true_block);
+			_emit(IR_STORE, {_emit(IR_CONSTANT, {}, 1)}, 0, local);
+			_emit_jump(end_block);
+
+			_begin_block(false_block);
+			_emit(IR_STORE, {_emit(IR_CONSTANT, {}, 0)}, 0, local);
+			_emit_jump(end_block);
+
+			_begin_block(end_block);
+			return {_emit(IR_LOAD, {}, 0, local), ""};
+		} break;
+	}
+
+	Operand left_operand = _generate_operand(p_postfix, left);
+	Operand right_operand = _generate_operand(p_postfix, right);
+
+	if (node.type == TK_ASSIGN)
+	{
+		if (left_operand.local.empty())
+		{
+			_error("lvalue required as left operand of assignment.");
+		}
+		_emit(IR_STORE, {right_operand.reg}, 0, left_operand.local);
+		return {right_operand.reg, ""};
+	}
+	return {_emit(node.type, {left_operand.reg, right_operand.reg}), ""};
+}
+
+void IRGenerator::_generate_jumping_code(
+		const Postfix &p_postfix,
+		int p_end,
+		unsigned int p_true,
+		unsigned int p_false,
+		int p_hint
+) {
+	/*
+	 * && and || become branches straight to where the condition
+	 * leads, the right side is only reached when it decides the result.
+	 */
+	SymanticAnalysier::Node node = p_postfix.nodes[p_end]->get_data();
+	Token type = node.type;
+	if (type == FUNCTION_CALL && node.value == "__builtin_expect")
+	{
+		std::vector<const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> *> args;
+		for (const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &list : p_postfix.nodes[p_end]->get_children())
+		{
+			for (const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &arg : list->get_children())
+			{
+				if (arg->get_data().type == TYPE_EXPRESSION)
+				{
+					args.push_back(&arg);
+				}
+			}
+		}
+
+		if (args.size() != 2)
+		{
+			_error("__builtin_expect takes two arguments");
+		}
+
+		/* the branch is the same, only the likely side changes */
+		int hint = _evaluate_constant(*args[1]) ? 1 : -1;
+		_generate_condition(*args[0], p_true, p_false, hint);
+		return;
+	}
+
+	if (type != TK_AND && type != TK_OR)
+	{
+		_emit_branch(_generate_operand(p_postfix, p_end).reg, p_true, p_false, p_hint);
+		return;
+	}
+
+	int right = p_end - 1;
+	int left = p_postfix.starts[right] - 1;
+
+	std::string id = std::to_string(logical_counter++);
+	if (type == TK_AND)
+	{
+		unsigned int right_block = _create_block("and_right_" + id);
+		_generate_jumping_code(p_postfix, left, right_block, p_false, p_hint);
+		_begin_block(right_block);
+	}
+	else
+	{
+		unsigned int right_block = _create_block("or_right_" + id);
+		_generate_jumping_code(p_postfix, left, p_true, right_block, p_hint);
+		_begin_block(right_block);
+	}
+	_generate_jumping_code(p_postfix, right, p_true, p_false, p_hint);
+}
+
+IRGenerator::IRGenerator()
+{
+
+}
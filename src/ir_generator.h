@@ -0,0 +1,295 @@
+/*************************************************************************/
+/*  ir_generator.h                                                       */
+/*************************************************************************/
+/*                       The MIT License (MIT)                           */
+/*************************************************************************/
+/* Copyright (c) 2018 Paul Batty.                                        */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#ifndef IR_GENERATOR_H
+#define IR_GENERATOR_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "tokens.h"
+#include "symantic_analysier.h"
+
+class IRGenerator
+{
+public:
+
+	/*
+	 * Three address code, every value lives in a virtual register
+	 * that is only ever assigned once. Locals are kept in memory and
+	 * accessed through IR_LOAD and IR_STORE until the optimiser
+	 * promotes them.
+	 *
+	 * op is either one of the IR tokens or an operator token, ie TK_PLUS.
+	 * An IR_PHI takes args[i] when entered from block targets[i].
+	 * The value of an IR_BRANCH is 1 when targets[0] is the likely
+	 * side, -1 when targets[1] is and 0 when it is not known.
+	 * An IR_PROFILE adds one to counter value.
+	 */
+	struct Instruction
+	{
+		Token op;
+		int dest;
+		std::vector<int> args;
+		int value;
+		std::string name;
+		std::vector<unsigned int> targets;
+
+		/* the source line it came from, 0 when it is not known */
+		int line;
+	};
+
+	struct Block
+	{
+		unsigned int id;
+		std::string label;
+		std::vector<Instruction> instructions;
+	};
+
+	struct Function
+	{
+		std::string name;
+		std::vector<std::string> locals;
+		unsigned int parameter_count;
+		unsigned int register_count;
+		unsigned int block_count;
+
+		/* in layout order, the first block is the entry. */
+		std::vector<Block> blocks;
+
+		/* times each block ran, by id, only filled in from a profile */
+		std::unordered_map<unsigned int, unsigned long long> block_counts;
+
+		/* the shape its profile counters were laid out for, only set when instrumented */
+		unsigned int profile_checksum = 0;
+	};
+
+	static Instruction make_instruction(
+			Token p_op,
+			int p_dest = -1,
+			std::vector<int> p_args = std::vector<int>(),
+			int p_value = 0,
+			std::string p_name = ""
+	);
+
+	static bool is_terminator(Token p_op);
+
+	static void print_function(const Function &p_function);
+
+private:
+	void _error(std::string p_error);
+	void _warn(std::string p_warning);
+
+	struct Var {
+		unsigned int scope_level = 0;
+		std::string local;
+	};
+
+	struct Scope {
+		unsigned int level = 0;
+		std::unordered_map<std::string, Var> var_map;
+	};
+
+	struct Loop {
+		unsigned int continue_block;
+		unsigned int break_block;
+	};
+
+	struct Operand {
+		int reg;
+		std::string local;
+	};
+
+	/* an expression in postfix order, starts[i] is where the operand ending at i begins */
+	struct Postfix {
+		std::vector<TreeNode<SymanticAnalysier::Node> *> nodes;
+		std::vector<int> starts;
+	};
+
+	struct Case {
+		int value;
+		unsigned int block;
+	};
+
+	/* blocks for the case and default labels of a switch body, by node id */
+	struct Switch {
+		std::unordered_map<unsigned int, unsigned int> labels;
+		unsigned int test_count;
+	};
+
+	/*
+	 * A switch indexes a table when there are enough cases and
+	 * at most a third of the entries fall through to default,
+	 * otherwise it is a binary search down to a few compares.
+	 */
+	const unsigned int jump_table_minimum = 4;
+	const unsigned int jump_table_density = 3;
+	const unsigned int linear_case_maximum = 3;
+
+	unsigned int if_counter;
+	unsigned int loop_counter;
+	unsigned int switch_counter;
+	unsigned int logical_counter;
+	unsigned int unreachable_counter;
+
+	Function function;
+	unsigned int current_block;
+
+	/* of the statement or expression being generated, given to everything emitted */
+	int current_line;
+	std::unordered_map<unsigned int, std::string> pending_blocks;
+
+	std::vector<Scope> scopes;
+	std::vector<Loop> loops;
+	std::vector<Switch> switches;
+
+	unsigned int _create_block(std::string p_label);
+	void _begin_block(unsigned int p_id);
+	bool _is_terminated();
+
+	int _emit(
+			Token p_op,
+			std::vector<int> p_args = std::vector<int>(),
+			int p_value = 0,
+			std::string p_name = ""
+	);
+	void _emit_jump(unsigned int p_target);
+	void _emit_branch(int p_condition, unsigned int p_true, unsigned int p_false, int p_hint = 0);
+
+	std::string _declare_local(const std::string &p_name);
+	std::string _lookup_local(const std::string &p_name);
+	void _push_scope();
+	void _pop_scope();
+
+	void _generate_function(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	void _generate_statements(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	void _generate_declaration(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	void _generate_assignment_expression(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	void _generate_if_block(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	void _generate_switch(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	void _collect_cases(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node,
+			const std::string &p_id,
+			std::vector<Case> &r_cases,
+			int &r_default
+	);
+
+	int _evaluate_constant(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	static bool _compare_cases(const Case &p_a, const Case &p_b);
+
+	void _generate_case_tree(
+			int p_value,
+			const std::vector<Case> &p_cases,
+			unsigned int p_begin,
+			unsigned int p_end,
+			unsigned int p_default,
+			const std::string &p_id
+	);
+
+	void _generate_case(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	void _generate_while(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	void _generate_do(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	void _generate_for(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	void _generate_return(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	void _generate_loop_jump(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	int _generate_expression(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node
+	);
+
+	void _generate_condition(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node,
+			unsigned int p_true,
+			unsigned int p_false,
+			int p_hint = 0
+	);
+
+	void _build_postfix(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_node,
+			Postfix &r_postfix,
+			std::vector<int> &r_roots
+	);
+
+	Operand _generate_operand(const Postfix &p_postfix, int p_end);
+
+	void _generate_jumping_code(
+			const Postfix &p_postfix,
+			int p_end,
+			unsigned int p_true,
+			unsigned int p_false,
+			int p_hint = 0
+	);
+
+public:
+	std::vector<Function> generate(
+			const std::unique_ptr<TreeNode<SymanticAnalysier::Node>> &p_root
+	);
+
+	IRGenerator();
+};
+
+#endif // IR_GENERATOR_H
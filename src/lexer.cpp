@@ -48,6 +48,11 @@ void Lexer::clear()
 	column = 0;
 	offset = -1;
 	code_size = 0;
+
+	/* anything but eof, so the next file can be read */
+	token_data.token = NONE;
+	token_data.value = "";
+	token_data.line = 0;
 }
 
 void Lexer::append_code(const std::string &p_code)
@@ -203,7 +208,7 @@ Token Lexer::advance()
 					_get_next_char();
 					return _push_token(TK_ASSIGN_DIVIDE, "/=");
 				}
-				_push_token(TK_DIVIDE, "/");
+				return _push_token(TK_DIVIDE, "/");
 			} break;
 			case '+':
 			{
@@ -0,0 +1,558 @@
+/*************************************************************************/
+/*  linker.cpp                                                           */
+/*************************************************************************/
+/*                       The MIT License (MIT)                           */
+/*************************************************************************/
+/* Copyright (c) 2018 Paul Batty.                                        */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "linker.h"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <set>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+void Linker::link(const std::vector<std::string> &p_files, const std::string &p_output_file)
+{
+	objects.clear();
+	symbols.clear();
+	symbol_objects.clear();
+	functions.clear();
+	for (const std::string &file : p_files)
+	{
+		_load_object(file);
+	}
+
+	_layout();
+	_resolve_symbols();
+	_relocate();
+	_write(p_output_file);
+}
+
+void Linker::_load_object(const std::string &p_file)
+{
+	Object object;
+	object.name = p_file;
+
+	std::ifstream stream(p_file, std::ios::binary);
+	if (!stream)
+	{
+		_error("could not open '" + p_file + "'");
+	}
+	object.image.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+
+	const Elf64_Ehdr *header = (const Elf64_Ehdr *)object.image.data();
+	if (
+		object.image.size() < sizeof(Elf64_Ehdr) ||
+		memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+		header->e_ident[EI_CLASS] != ELFCLASS64 ||
+		header->e_type != ET_REL ||
+		header->e_machine != EM_X86_64
+	) {
+		_error("'" + p_file + "' is not an x86-64 relocatable object");
+	}
+
+	if (header->e_shoff + header->e_shnum * sizeof(Elf64_Shdr) > object.image.size())
+	{
+		_error("'" + p_file + "' is truncated");
+	}
+
+	object.section_addresses.assign(header->e_shnum, 0);
+	object.section_groups.assign(header->e_shnum, -1);
+	object.section_offsets.assign(header->e_shnum, 0);
+	for (unsigned int i = 0; i < header->e_shnum; i++)
+	{
+		const Elf64_Shdr &section = _section(object, i);
+		if (section.sh_type != SHT_NOBITS && section.sh_offset + section.sh_size > object.image.size())
+		{
+			_error("'" + p_file + "' is truncated");
+		}
+	}
+	objects.push_back(object);
+}
+
+void Linker::_layout()
+{
+	/* each input section is placed after the last one in its group, at its own alignment */
+	/* a group starts on the largest alignment of the sections in it */
+	unsigned long group_alignments[GROUP_MAX];
+	for (unsigned int group = 0; group < GROUP_MAX; group++)
+	{
+		groups[group].clear();
+		group_sizes[group] = 0;
+		group_alignments[group] = 1;
+	}
+
+	for (Object &object : objects)
+	{
+		for (unsigned int i = 0; i < object.section_groups.size(); i++)
+		{
+			const Elf64_Shdr &section = _section(object, i);
+			const char *names = (const char *)object.image.data() + _section(object, _header(object).e_shstrndx).sh_offset;
+
+			int group = -1;
+			if (!(section.sh_flags & SHF_ALLOC))
+			{
+				for (unsigned int debug = GROUP_DEBUG_ABBREV; debug < GROUP_MAX; debug++)
+				{
+					group = (debug_sections[debug - GROUP_DEBUG_ABBREV] == names + section.sh_name) ? debug : group;
+				}
+			}
+			else if (section.sh_type == SHT_NOBITS)
+			{
+				group = GROUP_BSS;
+			}
+			else if (section.sh_flags & SHF_EXECINSTR)
+			{
+				group = GROUP_TEXT;
+			}
+			else if (section.sh_flags & SHF_WRITE)
+			{
+				group = GROUP_DATA;
+			}
+			else
+			{
+				group = GROUP_RODATA;
+			}
+
+			if (group < 0)
+			{
+				continue;
+			}
+
+			unsigned long align = std::max(section.sh_addralign, (Elf64_Xword)1);
+			unsigned long offset = (group_sizes[group] + align - 1) & ~(align - 1);
+			group_alignments[group] = std::max(group_alignments[group], align);
+			object.section_groups[i] = group;
+			object.section_offsets[i] = offset;
+			group_sizes[group] = offset + section.sh_size;
+
+			if (group != GROUP_BSS)
+			{
+				const unsigned char *data = object.image.data() + section.sh_offset;
+				groups[group].resize(offset, 0x00);
+				groups[group].insert(groups[group].end(), data, data + section.sh_size);
+			}
+		}
+	}
+
+	/*
+	 * The headers share the first page with text. Rodata and data each
+	 * start on a fresh page, in the file as well as in memory, so every
+	 * segment is mapped with only its own permissions.
+	 */
+	bool writable = group_sizes[GROUP_DATA] + group_sizes[GROUP_BSS] > 0;
+	unsigned int segments = 1 + (group_sizes[GROUP_RODATA] > 0 ? 1 : 0) + (writable ? 1 : 0);
+	group_offsets[GROUP_TEXT] = sizeof(Elf64_Ehdr) + sizeof(Elf64_Phdr) * segments;
+	group_offsets[GROUP_TEXT] = (group_offsets[GROUP_TEXT] + group_alignments[GROUP_TEXT] - 1) & ~(group_alignments[GROUP_TEXT] - 1);
+
+	unsigned long end = group_offsets[GROUP_TEXT] + group_sizes[GROUP_TEXT];
+	group_offsets[GROUP_RODATA] = (end + page_size - 1) & ~(page_size - 1);
+	if (group_sizes[GROUP_RODATA] > 0)
+	{
+		end = group_offsets[GROUP_RODATA] + group_sizes[GROUP_RODATA];
+	}
+	group_offsets[GROUP_DATA] = (end + page_size - 1) & ~(page_size - 1);
+	group_offsets[GROUP_BSS] = (group_offsets[GROUP_DATA] + group_sizes[GROUP_DATA] + group_alignments[GROUP_BSS] - 1) & ~(group_alignments[GROUP_BSS] - 1);
+
+	for (unsigned int group = 0; group < GROUP_MAX; group++)
+	{
+		group_addresses[group] = (group < GROUP_DEBUG_ABBREV) ? base_address + group_offsets[group] : 0;
+	}
+
+	for (Object &object : objects)
+	{
+		for (unsigned int i = 0; i < object.section_groups.size(); i++)
+		{
+			if (object.section_groups[i] >= 0)
+			{
+				object.section_addresses[i] = group_addresses[object.section_groups[i]] + object.section_offsets[i];
+			}
+		}
+	}
+}
+
+void Linker::_resolve_symbols()
+{
+	for (const Object &object : objects)
+	{
+		for (unsigned int i = 0; i < object.section_groups.size(); i++)
+		{
+			const Elf64_Shdr &section = _section(object, i);
+			if (section.sh_type != SHT_SYMTAB)
+			{
+				continue;
+			}
+
+			const Elf64_Sym *table = (const Elf64_Sym *)(object.image.data() + section.sh_offset);
+			const char *strings = (const char *)object.image.data() + _section(object, section.sh_link).sh_offset;
+			for (unsigned int j = section.sh_info; j < section.sh_size / sizeof(Elf64_Sym); j++)
+			{
+				const Elf64_Sym &symbol = table[j];
+				if (symbol.st_shndx == SHN_UNDEF || ELF64_ST_BIND(symbol.st_info) == STB_LOCAL)
+				{
+					continue;
+				}
+
+				std::string name = strings + symbol.st_name;
+				if (symbols.count(name))
+				{
+					_error("multiple definition of '" + name + "' in '" + symbol_objects[name] + "' and '" + object.name + "'");
+				}
+
+				unsigned long address = 0;
+				_symbol_address(object, symbol, strings, address);
+				symbols[name] = address;
+				symbol_objects[name] = object.name;
+
+				if (ELF64_ST_TYPE(symbol.st_info) == STT_FUNC)
+				{
+					functions[name] = Elf64_Sym{0, symbol.st_info, 0, 0, address, symbol.st_size};
+				}
+			}
+		}
+	}
+
+	if (!symbols.count("_start"))
+	{
+		_error("undefined reference to '_start', nothing defines main");
+	}
+}
+
+void Linker::_relocate()
+{
+	/* report every undefined symbol once, where it was first used */
+	std::set<std::string> undefined;
+	for (const Object &object : objects)
+	{
+		for (unsigned int i = 0; i < object.section_groups.size(); i++)
+		{
+			const Elf64_Shdr &section = _section(object, i);
+			if (section.sh_type != SHT_RELA || object.section_groups[section.sh_info] < 0)
+			{
+				continue;
+			}
+
+			int group = object.section_groups[section.sh_info];
+			if (group == GROUP_BSS)
+			{
+				_error("relocation against .bss in '" + object.name + "'");
+			}
+
+			const Elf64_Shdr &symbol_section = _section(object, section.sh_link);
+			const Elf64_Sym *table = (const Elf64_Sym *)(object.image.data() + symbol_section.sh_offset);
+			const char *strings = (const char *)object.image.data() + _section(object, symbol_section.sh_link).sh_offset;
+
+			const Elf64_Rela *relocations = (const Elf64_Rela *)(object.image.data() + section.sh_offset);
+			for (unsigned int j = 0; j < section.sh_size / sizeof(Elf64_Rela); j++)
+			{
+				const Elf64_Rela &relocation = relocations[j];
+				const Elf64_Sym &symbol = table[ELF64_R_SYM(relocation.r_info)];
+
+				unsigned long address = 0;
+				if (!_symbol_address(object, symbol, strings, address))
+				{
+					std::string name = strings + symbol.st_name;
+					if (!undefined.count(name))
+					{
+						undefined.insert(name);
+						std::cout << "linker: " << object.name << ": error: undefined reference to '" << name << "'" << std::endl;
+					}
+					continue;
+				}
+
+				unsigned long offset = object.section_offsets[section.sh_info] + relocation.r_offset;
+				unsigned long place = object.section_addresses[section.sh_info] + relocation.r_offset;
+				long value = address + relocation.r_addend;
+				unsigned int size = 4;
+				switch (ELF64_R_TYPE(relocation.r_info))
+				{
+					case R_X86_64_NONE:
+					{
+						continue;
+					} break;
+					case R_X86_64_PC32:
+					case R_X86_64_PLT32:
+					{
+						value -= place;
+						if (value != (int)value)
+						{
+							_error("relocation to '" + std::string(strings + symbol.st_name) + "' is out of range in '" + object.name + "'");
+						}
+					} break;
+					case R_X86_64_32:
+					{
+						if (value != (long)(unsigned int)value)
+						{
+							_error("relocation to '" + std::string(strings + symbol.st_name) + "' is out of range in '" + object.name + "'");
+						}
+					} break;
+					case R_X86_64_32S:
+					{
+						if (value != (int)value)
+						{
+							_error("relocation to '" + std::string(strings + symbol.st_name) + "' is out of range in '" + object.name + "'");
+						}
+					} break;
+					case R_X86_64_64:
+					{
+						size = 8;
+					} break;
+					default:
+					{
+						_error("unsupported relocation type " + std::to_string(ELF64_R_TYPE(relocation.r_info)) + " in '" + object.name + "'");
+					} break;
+				}
+
+				if (offset + size > groups[group].size())
+				{
+					_error("relocation outside of its section in '" + object.name + "'");
+				}
+				memcpy(groups[group].data() + offset, &value, size);
+			}
+		}
+	}
+
+	if (!undefined.empty())
+	{
+		exit(0);
+	}
+}
+
+void Linker::_write(const std::string &p_output_file)
+{
+	std::vector<Elf64_Phdr> program_headers;
+
+	/* text from the start of the file, so the headers are mapped with it */
+	Elf64_Phdr text_header = Elf64_Phdr();
+	text_header.p_type = PT_LOAD;
+	text_header.p_flags = PF_R | PF_X;
+	text_header.p_offset = 0;
+	text_header.p_vaddr = base_address;
+	text_header.p_paddr = base_address;
+	text_header.p_filesz = group_offsets[GROUP_TEXT] + group_sizes[GROUP_TEXT];
+	text_header.p_memsz = text_header.p_filesz;
+	text_header.p_align = page_size;
+	program_headers.push_back(text_header);
+
+	if (group_sizes[GROUP_RODATA] > 0)
+	{
+		Elf64_Phdr rodata_header = text_header;
+		rodata_header.p_flags = PF_R;
+		rodata_header.p_offset = group_offsets[GROUP_RODATA];
+		rodata_header.p_vaddr = group_addresses[GROUP_RODATA];
+		rodata_header.p_paddr = group_addresses[GROUP_RODATA];
+		rodata_header.p_filesz = group_sizes[GROUP_RODATA];
+		rodata_header.p_memsz = group_sizes[GROUP_RODATA];
+		program_headers.push_back(rodata_header);
+	}
+
+	/* data then bss */
+	unsigned long size = text_header.p_filesz;
+	if (group_sizes[GROUP_DATA] + group_sizes[GROUP_BSS] > 0)
+	{
+		Elf64_Phdr data_header = text_header;
+		data_header.p_flags = PF_R | PF_W;
+		data_header.p_offset = group_offsets[GROUP_DATA];
+		data_header.p_vaddr = group_addresses[GROUP_DATA];
+		data_header.p_paddr = group_addresses[GROUP_DATA];
+		data_header.p_filesz = group_sizes[GROUP_DATA];
+		data_header.p_memsz = group_addresses[GROUP_BSS] + group_sizes[GROUP_BSS] - group_addresses[GROUP_DATA];
+		program_headers.push_back(data_header);
+	}
+	for (const Elf64_Phdr &program_header : program_headers)
+	{
+		size = std::max(size, (unsigned long)(program_header.p_offset + program_header.p_filesz));
+	}
+
+	Elf64_Ehdr header = Elf64_Ehdr();
+	memcpy(header.e_ident, ELFMAG, SELFMAG);
+	header.e_ident[EI_CLASS] = ELFCLASS64;
+	header.e_ident[EI_DATA] = ELFDATA2LSB;
+	header.e_ident[EI_VERSION] = EV_CURRENT;
+	header.e_ident[EI_OSABI] = ELFOSABI_NONE;
+	header.e_type = ET_EXEC;
+	header.e_machine = EM_X86_64;
+	header.e_version = EV_CURRENT;
+	header.e_entry = symbols.at("_start");
+	header.e_phoff = sizeof(Elf64_Ehdr);
+	header.e_ehsize = sizeof(Elf64_Ehdr);
+	header.e_phentsize = sizeof(Elf64_Phdr);
+	header.e_phnum = program_headers.size();
+	header.e_shentsize = sizeof(Elf64_Shdr);
+
+	std::vector<unsigned char> image(size, 0x00);
+	memcpy(image.data() + sizeof(Elf64_Ehdr), program_headers.data(), program_headers.size() * sizeof(Elf64_Phdr));
+	for (unsigned int group = GROUP_TEXT; group < GROUP_BSS; group++)
+	{
+		std::copy(groups[group].begin(), groups[group].end(), image.begin() + group_offsets[group]);
+	}
+
+	/* nothing loads the sections, they are there for perf and gdb */
+	section_headers.clear();
+	section_names.assign(1, 0x00);
+	_add_section("", SHT_NULL, 0, 0, 0, 0, 0);
+	unsigned int text_section = _add_section(".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, group_addresses[GROUP_TEXT], group_offsets[GROUP_TEXT], group_sizes[GROUP_TEXT], 16);
+	if (group_sizes[GROUP_RODATA] > 0)
+	{
+		_add_section(".rodata", SHT_PROGBITS, SHF_ALLOC, group_addresses[GROUP_RODATA], group_offsets[GROUP_RODATA], group_sizes[GROUP_RODATA], 8);
+	}
+	if (group_sizes[GROUP_DATA] > 0)
+	{
+		_add_section(".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, group_addresses[GROUP_DATA], group_offsets[GROUP_DATA], group_sizes[GROUP_DATA], 8);
+	}
+	if (group_sizes[GROUP_BSS] > 0)
+	{
+		_add_section(".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE, group_addresses[GROUP_BSS], group_offsets[GROUP_BSS], group_sizes[GROUP_BSS], 8);
+	}
+
+	std::vector<unsigned char> strings(1, 0x00);
+	std::vector<unsigned char> symbol_table(sizeof(Elf64_Sym), 0x00);
+	for (std::pair<const std::string, Elf64_Sym> &function : functions)
+	{
+		function.second.st_name = strings.size();
+		function.second.st_shndx = text_section;
+		strings.insert(strings.end(), function.first.begin(), function.first.end());
+		strings.push_back(0x00);
+
+		const unsigned char *bytes = (const unsigned char *)&function.second;
+		symbol_table.insert(symbol_table.end(), bytes, bytes + sizeof(Elf64_Sym));
+	}
+
+	image.resize((image.size() + 7) & ~7ul, 0x00);
+	unsigned int symbol_section = _add_section(".symtab", SHT_SYMTAB, 0, 0, image.size(), symbol_table.size(), 8, sizeof(Elf64_Sym));
+	section_headers[symbol_section].sh_link = symbol_section + 1;
+	section_headers[symbol_section].sh_info = 1;
+	image.insert(image.end(), symbol_table.begin(), symbol_table.end());
+	_add_section(".strtab", SHT_STRTAB, 0, 0, image.size(), strings.size(), 1);
+	image.insert(image.end(), strings.begin(), strings.end());
+
+	for (unsigned int group = GROUP_DEBUG_ABBREV; group < GROUP_MAX; group++)
+	{
+		if (group_sizes[group] > 0)
+		{
+			_add_section(debug_sections[group - GROUP_DEBUG_ABBREV], SHT_PROGBITS, 0, 0, image.size(), group_sizes[group], 1);
+			image.insert(image.end(), groups[group].begin(), groups[group].end());
+		}
+	}
+
+	header.e_shstrndx = _add_section(".shstrtab", SHT_STRTAB, 0, 0, image.size(), 0, 1);
+	section_headers[header.e_shstrndx].sh_size = section_names.size();
+	image.insert(image.end(), section_names.begin(), section_names.end());
+
+	image.resize((image.size() + 7) & ~7ul, 0x00);
+	header.e_shoff = image.size();
+	header.e_shnum = section_headers.size();
+	const unsigned char *bytes = (const unsigned char *)section_headers.data();
+	image.insert(image.end(), bytes, bytes + section_headers.size() * sizeof(Elf64_Shdr));
+	memcpy(image.data(), &header, sizeof(Elf64_Ehdr));
+
+	int file = open(p_output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0755);
+	if (file < 0 || write(file, image.data(), image.size()) != (ssize_t)image.size())
+	{
+		_error("could not write '" + p_output_file + "'");
+	}
+	close(file);
+}
+
+unsigned int Linker::_add_section(
+		const std::string &p_name,
+		Elf64_Word p_type,
+		Elf64_Xword p_flags,
+		unsigned long p_address,
+		unsigned long p_offset,
+		unsigned long p_size,
+		Elf64_Xword p_align,
+		Elf64_Xword p_entry_size
+) {
+	Elf64_Shdr section = Elf64_Shdr();
+	section.sh_name = p_name.empty() ? 0 : section_names.size();
+	section.sh_type = p_type;
+	section.sh_flags = p_flags;
+	section.sh_addr = p_address;
+	section.sh_offset = p_offset;
+	section.sh_size = p_size;
+	section.sh_addralign = p_align;
+	section.sh_entsize = p_entry_size;
+
+	if (!p_name.empty())
+	{
+		section_names.insert(section_names.end(), p_name.begin(), p_name.end());
+		section_names.push_back(0x00);
+	}
+	section_headers.push_back(section);
+	return section_headers.size() - 1;
+}
+
+const Elf64_Ehdr &Linker::_header(const Object &p_object)
+{
+	return *(const Elf64_Ehdr *)p_object.image.data();
+}
+
+const Elf64_Shdr &Linker::_section(const Object &p_object, unsigned int p_index)
+{
+	const Elf64_Ehdr &header = _header(p_object);
+	if (p_index >= header.e_shnum)
+	{
+		_error("bad section index in '" + p_object.name + "'");
+	}
+	return *(const Elf64_Shdr *)(p_object.image.data() + header.e_shoff + p_index * sizeof(Elf64_Shdr));
+}
+
+bool Linker::_symbol_address(const Object &p_object, const Elf64_Sym &p_symbol, const char *p_strings, unsigned long &r_address)
+{
+	/* locals, ie section symbols, are relative to where their section was put, globals are looked up */
+	if (p_symbol.st_shndx == SHN_ABS)
+	{
+		r_address = p_symbol.st_value;
+		return true;
+	}
+
+	if (p_symbol.st_shndx != SHN_UNDEF && p_symbol.st_shndx < p_object.section_addresses.size())
+	{
+		r_address = p_object.section_addresses[p_symbol.st_shndx] + p_symbol.st_value;
+		return true;
+	}
+
+	std::string name = p_strings + p_symbol.st_name;
+	if (symbols.count(name))
+	{
+		r_address = symbols.at(name);
+		return true;
+	}
+	return false;
+}
+
+void Linker::_error(const std::string &p_error)
+{
+	std::cout << "linker: error: " << p_error << std::endl;
+	exit(0);
+}
+
+Linker::Linker()
+{
+}
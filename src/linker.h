@@ -0,0 +1,125 @@
+/*************************************************************************/
+/*  linker.h                                                             */
+/*************************************************************************/
+/*                       The MIT License (MIT)                           */
+/*************************************************************************/
+/* Copyright (c) 2018 Paul Batty.                                        */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#ifndef LINKER_H
+#define LINKER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <elf.h>
+
+#include "options.h"
+
+/*
+ * Links relocatable objects from the assembler into one executable,
+ * laid out the same way the assembler lays out a single file.
+ */
+class Linker
+{
+private:
+	const unsigned long base_address = 0x40000000;
+	const unsigned long page_size = 0x1000;
+
+	/*
+	 * text is R+X, rodata R and data then bss RW, each segment on pages
+	 * of its own. The debug groups are not loaded, their addresses are
+	 * offsets into them.
+	 */
+	enum Group
+	{
+		GROUP_TEXT,
+		GROUP_RODATA,
+		GROUP_DATA,
+		GROUP_BSS,
+		GROUP_DEBUG_ABBREV,
+		GROUP_DEBUG_INFO,
+		GROUP_DEBUG_LINE,
+		GROUP_MAX
+	};
+
+	const std::string debug_sections[GROUP_MAX - GROUP_DEBUG_ABBREV] = {".debug_abbrev", ".debug_info", ".debug_line"};
+
+	struct Object
+	{
+		std::string name;
+		std::vector<unsigned char> image;
+
+		/* by section index, 0 for anything that is not loaded */
+		std::vector<unsigned long> section_addresses;
+		std::vector<int> section_groups;
+		std::vector<unsigned long> section_offsets;
+	};
+
+	std::vector<Object> objects;
+
+	std::vector<unsigned char> groups[GROUP_MAX];
+	unsigned long group_sizes[GROUP_MAX];
+	unsigned long group_addresses[GROUP_MAX];
+
+	/* where each group starts in the file, bss has none */
+	unsigned long group_offsets[GROUP_MAX];
+
+	std::unordered_map<std::string, unsigned long> symbols;
+	std::unordered_map<std::string, std::string> symbol_objects;
+
+	/* for the output symbol table, by name with their final address */
+	std::map<std::string, Elf64_Sym> functions;
+
+	std::vector<Elf64_Shdr> section_headers;
+	std::vector<unsigned char> section_names;
+
+	void _load_object(const std::string &p_file);
+	void _layout();
+	void _resolve_symbols();
+	void _relocate();
+	void _write(const std::string &p_output_file);
+	unsigned int _add_section(
+			const std::string &p_name,
+			Elf64_Word p_type,
+			Elf64_Xword p_flags,
+			unsigned long p_address,
+			unsigned long p_offset,
+			unsigned long p_size,
+			Elf64_Xword p_align,
+			Elf64_Xword p_entry_size = 0
+	);
+
+	const Elf64_Ehdr &_header(const Object &p_object);
+	const Elf64_Shdr &_section(const Object &p_object, unsigned int p_index);
+	bool _symbol_address(const Object &p_object, const Elf64_Sym &p_symbol, const char *p_strings, unsigned long &r_address);
+
+	void _error(const std::string &p_error);
+
+public:
+	void link(const std::vector<std::string> &p_files, const std::string &p_output_file);
+
+	Linker();
+};
+
+#endif // LINKER_H
@@ -40,13 +40,147 @@ int main(int argc, char *argv[])
 	}
 
 	std::vector<std::string> input_files;
+	std::string output_file;
+	Options options;
 
 	for (int i = 1;  i < argc; i++)
 	{
-		input_files.push_back(argv[i]);
+		std::string argument = argv[i];
+		if (argument.find("-") != 0)
+		{
+			input_files.push_back(argument);
+			continue;
+		}
+
+		if (argument == "-fomit-frame-pointer")
+		{
+			options.omit_frame_pointer = true;
+			continue;
+		}
+
+		if (argument == "-fno-ipa-cp")
+		{
+			options.propagate_calls = false;
+			continue;
+		}
+
+		if (argument == "-fmmap-output")
+		{
+			options.mmap_output = true;
+			continue;
+		}
+
+		if (argument == "--run")
+		{
+			options.run = true;
+			continue;
+		}
+
+		if (argument == "--perf-map")
+		{
+			options.perf_map = true;
+			continue;
+		}
+
+		if (argument == "-c")
+		{
+			options.compile_only = true;
+			continue;
+		}
+
+		if (argument == "-o")
+		{
+			if (i + 1 >= argc)
+			{
+				std::cout << "Error: -o needs a file name." << std::endl;
+				return 0;
+			}
+			output_file = argv[++i];
+			continue;
+		}
+
+		if (argument.find("-falign-functions=") == 0 || argument.find("-falign-loops=") == 0)
+		{
+			std::string value = argument.substr(argument.find('=') + 1);
+			unsigned int alignment = (value.find_first_not_of("0123456789") == std::string::npos && value.size() < 5) ? std::stoi(value) : 0;
+			if (alignment == 0 || alignment > 4096 || (alignment & (alignment - 1)) != 0)
+			{
+				std::cout << "Error: " << argument.substr(0, argument.find('=')) << " needs a power of two up to 4096." << std::endl;
+				return 0;
+			}
+
+			(argument.find("-falign-functions=") == 0 ? options.align_functions : options.align_loops) = alignment;
+			continue;
+		}
+
+		/* both take an optional =file, otherwise it is named after the program */
+		if (argument.find("-fprofile-generate") == 0 || argument.find("-fprofile-use") == 0)
+		{
+			std::string flag = argument.substr(0, argument.find('='));
+			if (flag != "-fprofile-generate" && flag != "-fprofile-use")
+			{
+				std::cout << "Error: Unknown option '" << argument << "'." << std::endl;
+				return 0;
+			}
+
+			options.profile_generate = flag == "-fprofile-generate";
+			options.profile_use = flag == "-fprofile-use";
+			if (argument.find('=') != std::string::npos)
+			{
+				options.profile_file = argument.substr(argument.find('=') + 1);
+			}
+			continue;
+		}
+
+		std::cout << "Error: Unknown option '" << argument << "'." << std::endl;
+		return 0;
+	}
+
+	/* several files, any objects or a named output are linked into one executable */
+	bool link = input_files.size() > 1 || !output_file.empty();
+	for (const std::string &file : input_files)
+	{
+		link |= file.substr(file.find_last_of('.') + 1) == "o";
+	}
+	link &= !options.compile_only && !input_files.empty();
+
+	/* every object would count into its own copy of the counters */
+	if ((options.compile_only || link) && options.profile_generate)
+	{
+		std::cout << "Error: -fprofile-generate can only be used on a single source file." << std::endl;
+		return 0;
+	}
+
+	/* the program runs in pcc and pcc exits with its result, so there is only ever one */
+	if (options.run && (options.compile_only || link || input_files.size() != 1))
+	{
+		std::cout << "Error: --run takes a single source file." << std::endl;
+		return 0;
+	}
+
+	if (options.perf_map && !options.run)
+	{
+		std::cout << "Error: --perf-map needs --run." << std::endl;
+		return 0;
 	}
 
 	Compiler compiler;
+	compiler.set_options(options);
+	if (options.run)
+	{
+		return compiler.run(input_files[0]);
+	}
+
+	if (link)
+	{
+		if (output_file.empty())
+		{
+			output_file = input_files[0].substr(0, input_files[0].find_last_of('.'));
+		}
+		compiler.link(input_files, output_file);
+		return 0;
+	}
+
 	for (std::string file : input_files)
 	{
 		compiler.compile(file);
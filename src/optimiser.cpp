@@ -0,0 +1,2393 @@
+/*************************************************************************/
+/*  optimiser.cpp                                                        */
+/*************************************************************************/
+/*                       The MIT License (MIT)                           */
+/*************************************************************************/
+/* Copyright (c) 2018 Paul Batty.                                        */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "optimiser.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <climits>
+
+void Optimiser::optimise(std::vector<IRGenerator::Function> &p_functions, const Options &p_options)
+{
+	options = p_options;
+	program.clear();
+	program_indices.clear();
+	clones.clear();
+	for (const IRGenerator::Function &function : p_functions)
+	{
+		program[function.name] = function;
+		program_indices[function.name] = _block_indices(function);
+	}
+	_find_pure_functions();
+
+	/* clones are added to the end, and optimised in turn */
+	for (unsigned int i = 0; i < p_functions.size(); i++)
+	{
+		std::vector<IRGenerator::Function> new_clones;
+		IRGenerator::Function &function = p_functions[i];
+		_run_passes(function);
+		if (options.propagate_calls && _propagate_calls(function, new_clones))
+		{
+			_run_passes(function);
+		}
+
+		bool changed = _unroll_loops(function);
+		changed |= _promote_locals(function);
+		if (changed)
+		{
+			_run_passes(function);
+		}
+
+		if (_close_loops(function))
+		{
+			_run_passes(function);
+		}
+		_leave_ssa(function);
+
+		p_functions.insert(p_functions.end(), new_clones.begin(), new_clones.end());
+	}
+
+	/* counters are numbered the same way whether they are being made or read back */
+	unsigned int counter = 0;
+	if (options.profile_use)
+	{
+		_load_profile();
+	}
+
+	/* a profile of some other program would put its counts on the wrong branches */
+	bool matches = profile_checksums.size() == p_functions.size();
+	for (unsigned int i = 0; matches && i < p_functions.size(); i++)
+	{
+		matches = profile_checksums[i] == _profile_checksum(p_functions[i]);
+	}
+
+	if (!profile.empty() && !matches)
+	{
+		std::cout << "warning: profile '" << options.profile_file << "' does not match this program" << std::endl;
+		profile.clear();
+	}
+
+	for (IRGenerator::Function &function : p_functions)
+	{
+		if (options.profile_generate)
+		{
+			function.profile_checksum = _profile_checksum(function);
+			_instrument(function, counter);
+		}
+		else if (!profile.empty())
+		{
+			_apply_profile(function, counter);
+		}
+		_place_blocks(function);
+	}
+
+	std::cout << "-----------------------------------------------" << std::endl;
+	for (const IRGenerator::Function &function : p_functions)
+	{
+		IRGenerator::print_function(function);
+	}
+	std::cout << "-----------------------------------------------" << std::endl;
+}
+
+void Optimiser::_run_passes(IRGenerator::Function &p_function)
+{
+	/* each pass can expose more work for the others, run until nothing changes. */
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		changed |= _fold_constants(p_function);
+		changed |= _eliminate_common_subexpressions(p_function);
+		changed |= _simplify_cfg(p_function);
+		changed |= _eliminate_dead_stores(p_function);
+		changed |= _eliminate_dead_code(p_function);
+	}
+}
+
+std::unordered_map<unsigned int, unsigned int> Optimiser::_block_indices(
+		const IRGenerator::Function &p_function
+) {
+	std::unordered_map<unsigned int, unsigned int> indices;
+	for (unsigned int i = 0; i < p_function.blocks.size(); i++)
+	{
+		indices[p_function.blocks[i].id] = i;
+	}
+	return indices;
+}
+
+std::unordered_map<unsigned int, std::vector<unsigned int>> Optimiser::_predecessors(
+		const IRGenerator::Function &p_function
+) {
+	std::unordered_map<unsigned int, std::vector<unsigned int>> predecessors;
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		predecessors[block.id];
+		for (unsigned int target : block.instructions.back().targets)
+		{
+			predecessors[target].push_back(block.id);
+		}
+	}
+	return predecessors;
+}
+
+void Optimiser::_postorder(
+		const IRGenerator::Function &p_function,
+		std::unordered_map<unsigned int, unsigned int> &p_indices,
+		unsigned int p_block,
+		std::set<unsigned int> &r_visited,
+		std::vector<unsigned int> &r_order
+) {
+	r_visited.insert(p_block);
+	for (unsigned int target : p_function.blocks[p_indices[p_block]].instructions.back().targets)
+	{
+		if (!r_visited.count(target))
+		{
+			_postorder(p_function, p_indices, target, r_visited, r_order);
+		}
+	}
+	r_order.push_back(p_block);
+}
+
+std::vector<unsigned int> Optimiser::_reverse_postorder(const IRGenerator::Function &p_function)
+{
+	std::unordered_map<unsigned int, unsigned int> indices = _block_indices(p_function);
+	std::set<unsigned int> visited;
+	std::vector<unsigned int> order;
+	_postorder(p_function, indices, p_function.blocks[0].id, visited, order);
+	std::reverse(order.begin(), order.end());
+	return order;
+}
+
+std::unordered_map<unsigned int, unsigned int> Optimiser::_immediate_dominators(
+		const IRGenerator::Function &p_function
+) {
+	/*
+	 * Iterative dominators as in Cooper, Harvey and Kennedy,
+	 * the entry block is its own immediate dominator.
+	 */
+	std::vector<unsigned int> order = _reverse_postorder(p_function);
+	std::unordered_map<unsigned int, std::vector<unsigned int>> predecessors = _predecessors(p_function);
+
+	std::unordered_map<unsigned int, unsigned int> rpo_number;
+	for (unsigned int i = 0; i < order.size(); i++)
+	{
+		rpo_number[order[i]] = i;
+	}
+
+	std::unordered_map<unsigned int, unsigned int> dominators;
+	dominators[order[0]] = order[0];
+
+	bool updated = true;
+	while (updated)
+	{
+		updated = false;
+		for (unsigned int i = 1; i < order.size(); i++)
+		{
+			unsigned int block = order[i];
+			bool found = false;
+			unsigned int dominator = 0;
+			for (unsigned int predecessor : predecessors[block])
+			{
+				if (!dominators.count(predecessor))
+				{
+					continue;
+				}
+
+				if (!found)
+				{
+					dominator = predecessor;
+					found = true;
+					continue;
+				}
+
+				/* walk both up the tree until they meet */
+				unsigned int other = predecessor;
+				while (dominator != other)
+				{
+					while (rpo_number[dominator] > rpo_number[other])
+					{
+						dominator = dominators[dominator];
+					}
+
+					while (rpo_number[other] > rpo_number[dominator])
+					{
+						other = dominators[other];
+					}
+				}
+			}
+
+			if (!dominators.count(block) || dominators[block] != dominator)
+			{
+				dominators[block] = dominator;
+				updated = true;
+			}
+		}
+	}
+	return dominators;
+}
+
+std::unordered_map<unsigned int, std::set<unsigned int>> Optimiser::_dominance_frontiers(
+		const IRGenerator::Function &p_function,
+		std::unordered_map<unsigned int, unsigned int> &p_dominators
+) {
+	std::unordered_map<unsigned int, std::set<unsigned int>> frontiers;
+	std::unordered_map<unsigned int, std::vector<unsigned int>> predecessors = _predecessors(p_function);
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		if (!p_dominators.count(block.id) || predecessors[block.id].size() < 2)
+		{
+			continue;
+		}
+
+		for (unsigned int predecessor : predecessors[block.id])
+		{
+			if (!p_dominators.count(predecessor))
+			{
+				continue;
+			}
+
+			unsigned int runner = predecessor;
+			while (runner != p_dominators[block.id])
+			{
+				frontiers[runner].insert(block.id);
+				runner = p_dominators[runner];
+			}
+		}
+	}
+	return frontiers;
+}
+
+void Optimiser::_local_liveness(
+		const IRGenerator::Function &p_function,
+		std::vector<std::set<std::string>> &r_live_in,
+		std::vector<std::set<std::string>> &r_live_out
+) {
+	std::unordered_map<unsigned int, unsigned int> indices = _block_indices(p_function);
+	unsigned int block_count = p_function.blocks.size();
+
+	std::vector<std::set<std::string>> uses(block_count);
+	std::vector<std::set<std::string>> defs(block_count);
+	for (unsigned int i = 0; i < block_count; i++)
+	{
+		for (const IRGenerator::Instruction &instruction : p_function.blocks[i].instructions)
+		{
+			if (instruction.op == IR_LOAD && !defs[i].count(instruction.name))
+			{
+				uses[i].insert(instruction.name);
+			}
+
+			if (instruction.op == IR_STORE)
+			{
+				defs[i].insert(instruction.name);
+			}
+		}
+	}
+
+	r_live_in.assign(block_count, std::set<std::string>());
+	r_live_out.assign(block_count, std::set<std::string>());
+	bool updated = true;
+	while (updated)
+	{
+		updated = false;
+		for (int i = block_count - 1; i >= 0; i--)
+		{
+			std::set<std::string> out;
+			for (unsigned int target : p_function.blocks[i].instructions.back().targets)
+			{
+				const std::set<std::string> &in = r_live_in[indices[target]];
+				out.insert(in.begin(), in.end());
+			}
+
+			std::set<std::string> in = uses[i];
+			for (const std::string &local : out)
+			{
+				if (!defs[i].count(local))
+				{
+					in.insert(local);
+				}
+			}
+
+			if (in != r_live_in[i] || out != r_live_out[i])
+			{
+				r_live_in[i] = in;
+				r_live_out[i] = out;
+				updated = true;
+			}
+		}
+	}
+}
+
+void Optimiser::_replace_uses(IRGenerator::Function &p_function, int p_from, int p_to)
+{
+	for (IRGenerator::Block &block : p_function.blocks)
+	{
+		for (IRGenerator::Instruction &instruction : block.instructions)
+		{
+			for (int &arg : instruction.args)
+			{
+				if (arg == p_from)
+				{
+					arg = p_to;
+				}
+			}
+		}
+	}
+}
+
+bool Optimiser::_has_phis(const IRGenerator::Function &p_function, unsigned int p_block)
+{
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		if (block.id == p_block)
+		{
+			return block.instructions.front().op == IR_PHI;
+		}
+	}
+	return false;
+}
+
+void Optimiser::_remove_phi_incoming(IRGenerator::Function &p_function, unsigned int p_block, unsigned int p_predecessor)
+{
+	for (IRGenerator::Block &block : p_function.blocks)
+	{
+		if (block.id != p_block)
+		{
+			continue;
+		}
+
+		for (IRGenerator::Instruction &instruction : block.instructions)
+		{
+			if (instruction.op != IR_PHI)
+			{
+				break;
+			}
+
+			for (int i = instruction.targets.size() - 1; i >= 0; i--)
+			{
+				if (instruction.targets[i] == p_predecessor)
+				{
+					instruction.args.erase(instruction.args.begin() + i);
+					instruction.targets.erase(instruction.targets.begin() + i);
+				}
+			}
+		}
+	}
+}
+
+void Optimiser::_rename_phi_incoming(
+		IRGenerator::Function &p_function,
+		unsigned int p_block,
+		unsigned int p_from,
+		unsigned int p_to
+) {
+	for (IRGenerator::Block &block : p_function.blocks)
+	{
+		if (block.id != p_block)
+		{
+			continue;
+		}
+
+		for (IRGenerator::Instruction &instruction : block.instructions)
+		{
+			if (instruction.op != IR_PHI)
+			{
+				break;
+			}
+
+			for (unsigned int &target : instruction.targets)
+			{
+				if (target == p_from)
+				{
+					target = p_to;
+				}
+			}
+		}
+	}
+}
+
+bool Optimiser::_evaluate(Token p_op, int p_left, int p_right, int &r_result)
+{
+	/* wrap around rather than overflow */
+	unsigned int left = p_left;
+	unsigned int right = p_right;
+	switch (p_op)
+	{
+		case TK_PLUS:
+		{
+			r_result = left + right;
+		} break;
+		case TK_MINUS:
+		{
+			r_result = left - right;
+		} break;
+		case TK_STAR:
+		{
+			r_result = left * right;
+		} break;
+		case TK_DIVIDE:
+		case TK_MODULO:
+		{
+			/* leave division by zero to fault at run time, as it would have */
+			if (p_right == 0)
+			{
+				return false;
+			}
+
+			/* the one quotient that does not fit, wraps like the multiply */
+			if (p_left == INT_MIN && p_right == -1)
+			{
+				r_result = (p_op == TK_DIVIDE) ? INT_MIN : 0;
+				break;
+			}
+			r_result = (p_op == TK_DIVIDE) ? p_left / p_right : p_left % p_right;
+		} break;
+		case TK_EQUAL:
+		{
+			r_result = p_left == p_right;
+		} break;
+		case TK_LESS_THAN:
+		{
+			r_result = p_left < p_right;
+		} break;
+		default:
+		{
+			return false;
+		} break;
+	}
+	return true;
+}
+
+bool Optimiser::_is_commutative(Token p_op)
+{
+	return p_op == TK_PLUS || p_op == TK_STAR || p_op == TK_EQUAL;
+}
+
+void Optimiser::_find_pure_functions()
+{
+	pure_functions.clear();
+	for (const std::pair<const std::string, IRGenerator::Function> &function : program)
+	{
+		pure_functions.insert(function.first);
+	}
+
+	/* anything that calls an impure function is impure too */
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (const std::pair<const std::string, IRGenerator::Function> &function : program)
+		{
+			if (!pure_functions.count(function.first))
+			{
+				continue;
+			}
+
+			for (const IRGenerator::Block &block : function.second.blocks)
+			{
+				for (const IRGenerator::Instruction &instruction : block.instructions)
+				{
+					if (instruction.op == IR_CALL && !pure_functions.count(instruction.name))
+					{
+						pure_functions.erase(function.first);
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+}
+
+bool Optimiser::_propagate_calls(
+		IRGenerator::Function &p_function,
+		std::vector<IRGenerator::Function> &r_clones
+) {
+	std::unordered_map<int, int> constants;
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		for (const IRGenerator::Instruction &instruction : block.instructions)
+		{
+			if (instruction.op == IR_CONSTANT)
+			{
+				constants[instruction.dest] = instruction.value;
+			}
+		}
+	}
+
+	bool changed = false;
+	for (IRGenerator::Block &block : p_function.blocks)
+	{
+		for (IRGenerator::Instruction &instruction : block.instructions)
+		{
+			if (instruction.op != IR_CALL || !program.count(instruction.name))
+			{
+				continue;
+			}
+
+			std::vector<int> args;
+			for (int arg : instruction.args)
+			{
+				if (constants.count(arg))
+				{
+					args.push_back(constants[arg]);
+				}
+			}
+
+			/* with every argument known, a pure call is just its result */
+			int result = 0;
+			unsigned int steps = 0;
+			if (
+				args.size() == instruction.args.size() &&
+				pure_functions.count(instruction.name) &&
+				_interpret(instruction.name, args, 0, steps, result)
+			) {
+				instruction = IRGenerator::make_instruction(IR_CONSTANT, instruction.dest, {}, result);
+				constants[instruction.dest] = result;
+				changed = true;
+				continue;
+			}
+
+			if (args.empty())
+			{
+				continue;
+			}
+
+			std::string clone = _clone_function(instruction.name, instruction.args, constants, r_clones);
+			if (clone.empty())
+			{
+				continue;
+			}
+
+			std::vector<int> remaining;
+			for (int arg : instruction.args)
+			{
+				if (!constants.count(arg))
+				{
+					remaining.push_back(arg);
+				}
+			}
+			instruction.name = clone;
+			instruction.args = remaining;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+std::string Optimiser::_clone_function(
+		const std::string &p_name,
+		const std::vector<int> &p_args,
+		std::unordered_map<int, int> &p_constants,
+		std::vector<IRGenerator::Function> &r_clones
+) {
+	std::string key = p_name;
+	for (int arg : p_args)
+	{
+		key += p_constants.count(arg) ? " " + std::to_string(p_constants[arg]) : " _";
+	}
+
+	if (clones.count(key))
+	{
+		return clones[key];
+	}
+
+	const IRGenerator::Function &function = program.at(p_name);
+	unsigned int size = 0;
+	for (const IRGenerator::Block &block : function.blocks)
+	{
+		size += block.instructions.size();
+	}
+
+	if (clones.size() >= clone_limit || size > clone_size_limit)
+	{
+		return "";
+	}
+
+	/* constant parameters become constants, the rest are renumbered */
+	IRGenerator::Function clone = function;
+	clone.name = p_name + "_constprop_" + std::to_string(clones.size());
+	clone.parameter_count = 0;
+	for (IRGenerator::Block &block : clone.blocks)
+	{
+		block.label = (&block == &clone.blocks[0]) ? clone.name : clone.name + "_" + block.label;
+		for (IRGenerator::Instruction &instruction : block.instructions)
+		{
+			if (instruction.op != IR_PARAMETER)
+			{
+				continue;
+			}
+
+			if (instruction.value < (int)p_args.size() && p_constants.count(p_args[instruction.value]))
+			{
+				instruction = IRGenerator::make_instruction(IR_CONSTANT, instruction.dest, {}, p_constants[p_args[instruction.value]]);
+				continue;
+			}
+			instruction.value = clone.parameter_count++;
+		}
+	}
+
+	clones[key] = clone.name;
+	program[clone.name] = clone;
+	program_indices[clone.name] = _block_indices(clone);
+	if (pure_functions.count(p_name))
+	{
+		pure_functions.insert(clone.name);
+	}
+	r_clones.push_back(clone);
+	return clone.name;
+}
+
+bool Optimiser::_interpret(
+		const std::string &p_name,
+		const std::vector<int> &p_args,
+		unsigned int p_depth,
+		unsigned int &r_steps,
+		int &r_result
+) {
+	/*
+	 * Runs the function as generated. Anything that would be
+	 * undefined or fault at run time, or takes too long, gives up
+	 * and leaves the call to happen for real.
+	 */
+	if (p_depth > interpreter_depth_limit)
+	{
+		return false;
+	}
+
+	const IRGenerator::Function &function = program.at(p_name);
+	std::unordered_map<unsigned int, unsigned int> &indices = program_indices.at(p_name);
+	std::vector<int> registers(function.register_count, 0);
+	std::vector<bool> defined(function.register_count, false);
+	std::unordered_map<std::string, int> locals;
+
+	unsigned int previous = 0;
+	unsigned int current = function.blocks[0].id;
+	while (true)
+	{
+		const IRGenerator::Block &block = function.blocks[indices.at(current)];
+		for (const IRGenerator::Instruction &instruction : block.instructions)
+		{
+			if (++r_steps > interpreter_step_limit)
+			{
+				return false;
+			}
+
+			std::vector<int> args;
+			for (int arg : instruction.args)
+			{
+				if (instruction.op != IR_PHI && !defined[arg])
+				{
+					return false;
+				}
+				args.push_back(registers[arg]);
+			}
+
+			int value = 0;
+			switch (instruction.op)
+			{
+				case IR_CONSTANT:
+				{
+					value = instruction.value;
+				} break;
+				case IR_PARAMETER:
+				{
+					if (instruction.value >= (int)p_args.size())
+					{
+						return false;
+					}
+					value = p_args[instruction.value];
+				} break;
+				case IR_LOAD:
+				{
+					/* not set yet, as in int i; for (i = 0; ...), it stays undefined and only fails if used */
+					if (!locals.count(instruction.name))
+					{
+						continue;
+					}
+					value = locals[instruction.name];
+				} break;
+				case IR_STORE:
+				{
+					locals[instruction.name] = args[0];
+				} break;
+				case IR_COPY:
+				{
+					value = args[0];
+				} break;
+				case IR_PHI:
+				{
+					unsigned int incoming = std::find(instruction.targets.begin(), instruction.targets.end(), previous) - instruction.targets.begin();
+					if (incoming >= instruction.targets.size() || !defined[instruction.args[incoming]])
+					{
+						return false;
+					}
+					value = registers[instruction.args[incoming]];
+				} break;
+				case IR_CALL:
+				{
+					if (!pure_functions.count(instruction.name) || !_interpret(instruction.name, args, p_depth + 1, r_steps, value))
+					{
+						return false;
+					}
+				} break;
+				case IR_JUMP:
+				{
+					previous = current;
+					current = instruction.targets[0];
+				} break;
+				case IR_BRANCH:
+				{
+					previous = current;
+					current = args[0] ? instruction.targets[0] : instruction.targets[1];
+				} break;
+				case IR_SWITCH:
+				{
+					long long index = (long long)args[0] - instruction.value + 1;
+					if (index < 1 || index >= (long long)instruction.targets.size())
+					{
+						index = 0;
+					}
+					previous = current;
+					current = instruction.targets[index];
+				} break;
+				case IR_RETURN:
+				{
+					if (args.empty())
+					{
+						return false;
+					}
+					r_result = args[0];
+					return true;
+				} break;
+				default:
+				{
+					if (args.size() != 2 || !_evaluate(instruction.op, args[0], args[1], value))
+					{
+						return false;
+					}
+				} break;
+			}
+
+			if (instruction.dest >= 0)
+			{
+				registers[instruction.dest] = value;
+				defined[instruction.dest] = true;
+			}
+		}
+	}
+}
+
+bool Optimiser::_fold_constants(IRGenerator::Function &p_function)
+{
+	std::unordered_map<int, int> constants;
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		for (const IRGenerator::Instruction &instruction : block.instructions)
+		{
+			if (instruction.op == IR_CONSTANT)
+			{
+				constants[instruction.dest] = instruction.value;
+			}
+		}
+	}
+
+	bool changed = false;
+	std::unordered_map<int, int> identities;
+	for (IRGenerator::Block &block : p_function.blocks)
+	{
+		for (IRGenerator::Instruction &instruction : block.instructions)
+		{
+			if (instruction.op == IR_BRANCH && constants.count(instruction.args[0]))
+			{
+				unsigned int target = constants[instruction.args[0]] ? instruction.targets[0] : instruction.targets[1];
+				unsigned int dropped = constants[instruction.args[0]] ? instruction.targets[1] : instruction.targets[0];
+				if (dropped != target)
+				{
+					_remove_phi_incoming(p_function, dropped, block.id);
+				}
+				instruction = IRGenerator::make_instruction(IR_JUMP);
+				instruction.targets.push_back(target);
+				changed = true;
+				continue;
+			}
+
+			if (instruction.op == IR_SWITCH && constants.count(instruction.args[0]))
+			{
+				/* out of range, including below the lowest case, goes to targets[0] */
+				long long index = (long long)constants[instruction.args[0]] - instruction.value + 1;
+				if (index < 1 || index >= (long long)instruction.targets.size())
+				{
+					index = 0;
+				}
+
+				unsigned int target = instruction.targets[index];
+				std::set<unsigned int> dropped(instruction.targets.begin(), instruction.targets.end());
+				dropped.erase(target);
+				for (unsigned int block_id : dropped)
+				{
+					_remove_phi_incoming(p_function, block_id, block.id);
+				}
+				instruction = IRGenerator::make_instruction(IR_JUMP);
+				instruction.targets.push_back(target);
+				changed = true;
+				continue;
+			}
+
+			if (instruction.args.size() != 2 || instruction.op == IR_PHI)
+			{
+				continue;
+			}
+
+			if (!constants.count(instruction.args[0]) || !constants.count(instruction.args[1]))
+			{
+				changed |= _fold_identity(instruction, constants, identities);
+				continue;
+			}
+
+			int result = 0;
+			if (!_evaluate(instruction.op, constants[instruction.args[0]], constants[instruction.args[1]], result))
+			{
+				continue;
+			}
+			instruction = IRGenerator::make_instruction(IR_CONSTANT, instruction.dest, {}, result);
+			constants[instruction.dest] = result;
+			changed = true;
+		}
+	}
+
+	/* the instructions left behind are dead */
+	for (const std::pair<const int, int> &identity : identities)
+	{
+		_replace_uses(p_function, identity.first, identity.second);
+		changed = true;
+	}
+	return changed;
+}
+
+bool Optimiser::_fold_identity(
+		IRGenerator::Instruction &p_instruction,
+		std::unordered_map<int, int> &p_constants,
+		std::unordered_map<int, int> &r_identities
+) {
+	/* x + 0, x - 0, x * 1 and x / 1 are x, x * 0 is 0 */
+	int left = p_instruction.args[0];
+	int right = p_instruction.args[1];
+	if (p_constants.count(left) && _is_commutative(p_instruction.op))
+	{
+		std::swap(left, right);
+	}
+
+	if (!p_constants.count(right))
+	{
+		return false;
+	}
+
+	int constant = p_constants[right];
+	bool additive = p_instruction.op == TK_PLUS || p_instruction.op == TK_MINUS;
+	bool multiplicative = p_instruction.op == TK_STAR || p_instruction.op == TK_DIVIDE;
+	if ((additive && constant == 0) || (multiplicative && constant == 1))
+	{
+		r_identities[p_instruction.dest] = left;
+		return false;
+	}
+
+	if (p_instruction.op != TK_STAR || constant != 0)
+	{
+		return false;
+	}
+	p_instruction = IRGenerator::make_instruction(IR_CONSTANT, p_instruction.dest, {}, 0);
+	p_constants[p_instruction.dest] = 0;
+	return true;
+}
+
+bool Optimiser::_eliminate_common_subexpressions(IRGenerator::Function &p_function)
+{
+	std::unordered_map<unsigned int, unsigned int> indices = _block_indices(p_function);
+	std::unordered_map<unsigned int, unsigned int> dominators = _immediate_dominators(p_function);
+
+	std::unordered_map<unsigned int, std::vector<unsigned int>> children;
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		if (dominators.count(block.id) && block.id != p_function.blocks[0].id)
+		{
+			children[dominators[block.id]].push_back(block.id);
+		}
+	}
+
+	std::unordered_map<int, int> replacements;
+	_number_values(p_function, indices, children, p_function.blocks[0].id, {}, replacements);
+
+	if (replacements.empty())
+	{
+		return false;
+	}
+
+	/* uses outside the dominator walk, i.e. in unreachable blocks */
+	for (IRGenerator::Block &block : p_function.blocks)
+	{
+		for (IRGenerator::Instruction &instruction : block.instructions)
+		{
+			for (int &arg : instruction.args)
+			{
+				if (replacements.count(arg))
+				{
+					arg = replacements[arg];
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void Optimiser::_number_values(
+		IRGenerator::Function &p_function,
+		std::unordered_map<unsigned int, unsigned int> &p_indices,
+		std::unordered_map<unsigned int, std::vector<unsigned int>> &p_children,
+		unsigned int p_block,
+		std::unordered_map<std::string, int> p_available,
+		std::unordered_map<int, int> &r_replacements
+) {
+	/*
+	 * Pure values are available in every block they dominate.
+	 * Locals can change on any path, so loads are only reused
+	 * within a block and are forwarded from the last store.
+	 */
+	std::unordered_map<std::string, int> loads;
+
+	std::vector<IRGenerator::Instruction> &instructions = p_function.blocks[p_indices[p_block]].instructions;
+	for (unsigned int i = 0; i < instructions.size(); i++)
+	{
+		IRGenerator::Instruction &instruction = instructions[i];
+		for (int &arg : instruction.args)
+		{
+			if (r_replacements.count(arg))
+			{
+				arg = r_replacements[arg];
+			}
+		}
+
+		if (instruction.op == IR_STORE)
+		{
+			loads[instruction.name] = instruction.args[0];
+			continue;
+		}
+
+		if (instruction.op == IR_LOAD)
+		{
+			if (loads.count(instruction.name))
+			{
+				r_replacements[instruction.dest] = loads[instruction.name];
+				instructions.erase(instructions.begin() + i--);
+				continue;
+			}
+			loads[instruction.name] = instruction.dest;
+			continue;
+		}
+
+		/* phis are tied to their block, only fold those that always see the same value */
+		if (instruction.op == IR_PHI)
+		{
+			int value = -1;
+			bool same = true;
+			for (int arg : instruction.args)
+			{
+				if (arg == instruction.dest || arg == value)
+				{
+					continue;
+				}
+				same &= (value == -1);
+				value = arg;
+			}
+
+			if (same && value != -1)
+			{
+				r_replacements[instruction.dest] = value;
+				instructions.erase(instructions.begin() + i--);
+			}
+			continue;
+		}
+
+		/* calls to pure functions with the same arguments give the same result */
+		if (
+			instruction.dest < 0 ||
+			instruction.op == IR_PARAMETER ||
+			(instruction.op == IR_CALL && !pure_functions.count(instruction.name))
+		) {
+			continue;
+		}
+
+		std::vector<int> args = instruction.args;
+		if (_is_commutative(instruction.op))
+		{
+			std::sort(args.begin(), args.end());
+		}
+
+		std::string key = token_to_string.at(instruction.op) + " " + std::to_string(instruction.value) + " " + instruction.name;
+		for (int arg : args)
+		{
+			key += " %" + std::to_string(arg);
+		}
+
+		if (p_available.count(key))
+		{
+			r_replacements[instruction.dest] = p_available[key];
+			instructions.erase(instructions.begin() + i--);
+			continue;
+		}
+		p_available[key] = instruction.dest;
+	}
+
+	for (unsigned int child : p_children[p_block])
+	{
+		_number_values(p_function, p_indices, p_children, child, p_available, r_replacements);
+	}
+}
+
+bool Optimiser::_promote_locals(IRGenerator::Function &p_function)
+{
+	/*
+	 * mem2reg, as nothing can take the address of a local every one
+	 * of them is turned into SSA values. Phis are only placed where
+	 * the local is still live.
+	 */
+	_remove_unreachable_blocks(p_function);
+
+	std::set<std::string> locals;
+	std::unordered_map<std::string, std::set<unsigned int>> definitions;
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		for (const IRGenerator::Instruction &instruction : block.instructions)
+		{
+			if (instruction.op == IR_LOAD || instruction.op == IR_STORE)
+			{
+				locals.insert(instruction.name);
+			}
+
+			if (instruction.op == IR_STORE)
+			{
+				definitions[instruction.name].insert(block.id);
+			}
+		}
+	}
+
+	if (locals.empty())
+	{
+		return false;
+	}
+
+	std::vector<std::set<std::string>> live_in;
+	std::vector<std::set<std::string>> live_out;
+	_local_liveness(p_function, live_in, live_out);
+
+	std::unordered_map<unsigned int, unsigned int> indices = _block_indices(p_function);
+	std::unordered_map<unsigned int, unsigned int> dominators = _immediate_dominators(p_function);
+	std::unordered_map<unsigned int, std::set<unsigned int>> frontiers = _dominance_frontiers(p_function, dominators);
+
+	std::unordered_map<std::string, std::vector<int>> stacks;
+	for (const std::string &local : locals)
+	{
+		std::set<unsigned int> placed;
+		std::set<unsigned int> defined = definitions[local];
+		std::vector<unsigned int> worklist(defined.begin(), defined.end());
+		while (!worklist.empty())
+		{
+			unsigned int block = worklist.back();
+			worklist.pop_back();
+
+			for (unsigned int frontier : frontiers[block])
+			{
+				if (placed.count(frontier) || !live_in[indices[frontier]].count(local))
+				{
+					continue;
+				}
+
+				std::vector<IRGenerator::Instruction> &instructions = p_function.blocks[indices[frontier]].instructions;
+				instructions.insert(instructions.begin(), IRGenerator::make_instruction(IR_PHI, p_function.register_count++, {}, 0, local));
+				placed.insert(frontier);
+
+				if (!defined.count(frontier))
+				{
+					defined.insert(frontier);
+					worklist.push_back(frontier);
+				}
+			}
+		}
+
+		/* reading a local before it is written gives zero */
+		int undefined = p_function.register_count++;
+		std::vector<IRGenerator::Instruction> &entry = p_function.blocks[0].instructions;
+		entry.insert(entry.begin(), IRGenerator::make_instruction(IR_CONSTANT, undefined));
+		stacks[local].push_back(undefined);
+	}
+
+	std::unordered_map<unsigned int, std::vector<unsigned int>> children;
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		if (block.id != p_function.blocks[0].id)
+		{
+			children[dominators[block.id]].push_back(block.id);
+		}
+	}
+
+	std::unordered_map<int, int> replacements;
+	_rename_locals(p_function, indices, children, p_function.blocks[0].id, stacks, replacements);
+
+	for (IRGenerator::Block &block : p_function.blocks)
+	{
+		for (IRGenerator::Instruction &instruction : block.instructions)
+		{
+			for (int &arg : instruction.args)
+			{
+				if (replacements.count(arg))
+				{
+					arg = replacements[arg];
+				}
+			}
+		}
+	}
+	p_function.locals.clear();
+	return true;
+}
+
+void Optimiser::_rename_locals(
+		IRGenerator::Function &p_function,
+		std::unordered_map<unsigned int, unsigned int> &p_indices,
+		std::unordered_map<unsigned int, std::vector<unsigned int>> &p_children,
+		unsigned int p_block,
+		std::unordered_map<std::string, std::vector<int>> p_stacks,
+		std::unordered_map<int, int> &r_replacements
+) {
+	std::vector<IRGenerator::Instruction> &instructions = p_function.blocks[p_indices[p_block]].instructions;
+	for (unsigned int i = 0; i < instructions.size(); i++)
+	{
+		IRGenerator::Instruction &instruction = instructions[i];
+		for (int &arg : instruction.args)
+		{
+			if (r_replacements.count(arg))
+			{
+				arg = r_replacements[arg];
+			}
+		}
+
+		switch (instruction.op)
+		{
+			case IR_PHI:
+			{
+				p_stacks[instruction.name].push_back(instruction.dest);
+			} break;
+			case IR_LOAD:
+			{
+				r_replacements[instruction.dest] = p_stacks[instruction.name].back();
+				instructions.erase(instructions.begin() + i--);
+			} break;
+			case IR_STORE:
+			{
+				p_stacks[instruction.name].push_back(instruction.args[0]);
+				instructions.erase(instructions.begin() + i--);
+			} break;
+		}
+	}
+
+	std::set<unsigned int> successors;
+	for (unsigned int target : instructions.back().targets)
+	{
+		if (!successors.insert(target).second)
+		{
+			continue;
+		}
+
+		for (IRGenerator::Instruction &phi : p_function.blocks[p_indices[target]].instructions)
+		{
+			if (phi.op != IR_PHI)
+			{
+				break;
+			}
+			phi.args.push_back(p_stacks[phi.name].back());
+			phi.targets.push_back(p_block);
+		}
+	}
+
+	for (unsigned int child : p_children[p_block])
+	{
+		_rename_locals(p_function, p_indices, p_children, child, p_stacks, r_replacements);
+	}
+}
+
+void Optimiser::_leave_ssa(IRGenerator::Function &p_function)
+{
+	/*
+	 * Each phi gets its own temporary that every predecessor
+	 * copies into, the phi then becomes a copy of it. As the
+	 * temporaries are unique this is safe on critical edges
+	 * and for phis that read each other.
+	 *
+	 * When neither can happen the predecessors copy straight
+	 * into the phi instead.
+	 */
+	std::unordered_map<unsigned int, unsigned int> indices = _block_indices(p_function);
+	for (IRGenerator::Block &block : p_function.blocks)
+	{
+		std::set<int> phis;
+		bool critical = false;
+		for (unsigned int i = 0; block.instructions[i].op == IR_PHI; i++)
+		{
+			phis.insert(block.instructions[i].dest);
+			for (unsigned int predecessor : block.instructions[i].targets)
+			{
+				critical |= p_function.blocks[indices[predecessor]].instructions.back().targets.size() > 1;
+			}
+		}
+
+		bool direct = !critical;
+		for (unsigned int i = 0; block.instructions[i].op == IR_PHI; i++)
+		{
+			for (int arg : block.instructions[i].args)
+			{
+				direct &= !phis.count(arg);
+			}
+		}
+
+		/* copies can land in this block too, so work on a copy of the phi */
+		for (unsigned int i = 0; block.instructions[i].op == IR_PHI; i++)
+		{
+			IRGenerator::Instruction phi = block.instructions[i];
+			int temporary = direct ? phi.dest : p_function.register_count++;
+			for (unsigned int j = 0; j < phi.args.size(); j++)
+			{
+				std::vector<IRGenerator::Instruction> &instructions = p_function.blocks[indices[phi.targets[j]]].instructions;
+				instructions.insert(instructions.end() - 1, IRGenerator::make_instruction(IR_COPY, temporary, {phi.args[j]}));
+			}
+
+			if (direct)
+			{
+				block.instructions.erase(block.instructions.begin() + i--);
+				continue;
+			}
+			block.instructions[i] = IRGenerator::make_instruction(IR_COPY, phi.dest, {temporary});
+		}
+	}
+}
+
+void Optimiser::_load_profile()
+{
+	profile.clear();
+	profile_checksums.clear();
+
+	std::ifstream file(options.profile_file, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "warning: cannot open profile '" << options.profile_file << "'" << std::endl;
+		return;
+	}
+
+	unsigned int count = 0;
+	unsigned int functions = 0;
+	file.read((char *)&count, sizeof(count));
+	file.read((char *)&functions, sizeof(functions));
+	if (file && functions <= count)
+	{
+		profile_checksums.resize(functions);
+		file.read((char *)profile_checksums.data(), functions * sizeof(unsigned int));
+		profile.resize(count);
+		file.read((char *)profile.data(), count * sizeof(unsigned long long));
+	}
+
+	if (!file || functions > count)
+	{
+		std::cout << "warning: profile '" << options.profile_file << "' is truncated" << std::endl;
+		profile.clear();
+		profile_checksums.clear();
+	}
+}
+
+unsigned int Optimiser::_profile_checksum(const IRGenerator::Function &p_function)
+{
+	/* FNV-1a over the name and every block's id and successors, which is what the counters follow */
+	std::string shape = p_function.name;
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		const IRGenerator::Instruction &terminator = block.instructions.back();
+		shape += ":" + std::to_string(block.id) + "," + std::to_string(terminator.op);
+		for (unsigned int target : terminator.targets)
+		{
+			shape += "," + std::to_string(target);
+		}
+	}
+
+	unsigned int hash = 2166136261u;
+	for (char c : shape)
+	{
+		hash = (hash ^ (unsigned char)c) * 16777619u;
+	}
+
+	/* kept positive for .long */
+	return hash & 0x7FFFFFFF;
+}
+
+void Optimiser::_instrument(IRGenerator::Function &p_function, unsigned int &r_counter)
+{
+	/* the taken side gets a block of its own, the other side is the block count less that */
+	unsigned int block_count = p_function.blocks.size();
+	for (unsigned int i = 0; i < block_count; i++)
+	{
+		IRGenerator::Block &block = p_function.blocks[i];
+		block.instructions.insert(block.instructions.begin(), IRGenerator::make_instruction(IR_PROFILE, -1, {}, r_counter++));
+
+		IRGenerator::Instruction &terminator = block.instructions.back();
+		if (terminator.op != IR_BRANCH)
+		{
+			continue;
+		}
+
+		IRGenerator::Block edge;
+		edge.id = p_function.block_count++;
+		edge.label = block.label + "_taken";
+		edge.instructions.push_back(IRGenerator::make_instruction(IR_PROFILE, -1, {}, r_counter++));
+		edge.instructions.push_back(IRGenerator::make_instruction(IR_JUMP));
+		edge.instructions.back().targets.push_back(terminator.targets[0]);
+		terminator.targets[0] = edge.id;
+		p_function.blocks.push_back(edge);
+	}
+}
+
+void Optimiser::_apply_profile(IRGenerator::Function &p_function, unsigned int &r_counter)
+{
+	/* measured behaviour beats any hint from the source */
+	for (IRGenerator::Block &block : p_function.blocks)
+	{
+		if (r_counter >= profile.size())
+		{
+			return;
+		}
+
+		unsigned long long count = profile[r_counter++];
+		p_function.block_counts[block.id] = count;
+
+		IRGenerator::Instruction &terminator = block.instructions.back();
+		if (terminator.op != IR_BRANCH || r_counter >= profile.size())
+		{
+			continue;
+		}
+
+		unsigned long long taken = profile[r_counter++];
+		if (count == 0 || taken > count)
+		{
+			continue;
+		}
+		unsigned long long not_taken = count - taken;
+		terminator.value = (taken > not_taken) ? 1 : (taken < not_taken) ? -1 : 0;
+	}
+}
+
+bool Optimiser::_close_loops(IRGenerator::Function &p_function)
+{
+	/* a closed loop still leads to the same exit, so the predecessors of the others hold */
+	std::unordered_map<unsigned int, std::vector<unsigned int>> predecessors = _predecessors(p_function);
+
+	bool changed = false;
+	for (unsigned int i = 0; i < p_function.blocks.size(); i++)
+	{
+		changed |= _close_loop(p_function, i, predecessors);
+	}
+	return changed;
+}
+
+bool Optimiser::_close_loop(
+		IRGenerator::Function &p_function,
+		unsigned int p_block,
+		std::unordered_map<unsigned int, std::vector<unsigned int>> &p_predecessors
+) {
+	/*
+	 * A single block loop, in SSA, where every phi only ever has
+	 * an affine function of the iteration added to it, and one of
+	 * them counts from a constant up to a constant. The values that
+	 * leave the loop are worked out directly and the loop goes.
+	 */
+	const IRGenerator::Block &loop = p_function.blocks[p_block];
+	const IRGenerator::Instruction &terminator = loop.instructions.back();
+	if (terminator.op != IR_BRANCH || terminator.targets[0] != loop.id || terminator.targets[1] == loop.id)
+	{
+		return false;
+	}
+
+	std::vector<unsigned int> &entries = p_predecessors[loop.id];
+	if (entries.size() != 2 || std::count(entries.begin(), entries.end(), loop.id) != 1)
+	{
+		return false;
+	}
+
+	ClosedLoop closed;
+	closed.block = p_block;
+	for (unsigned int i = 0; i < loop.instructions.size(); i++)
+	{
+		const IRGenerator::Instruction &instruction = loop.instructions[i];
+		switch (instruction.op)
+		{
+			case IR_PHI:
+			{
+				unsigned int back = (instruction.targets[0] == loop.id) ? 0 : 1;
+				closed.updates[instruction.dest] = instruction.args[back];
+				closed.initial[instruction.dest] = instruction.args[1 - back];
+			} break;
+			case IR_CONSTANT:
+			case IR_COPY:
+			case TK_PLUS:
+			case TK_MINUS:
+			case TK_STAR:
+			case TK_EQUAL:
+			case TK_LESS_THAN:
+			case IR_BRANCH:
+			{
+			} break;
+			default:
+			{
+				/* anything that can fault or be seen outside has to stay */
+				return false;
+			} break;
+		}
+
+		if (instruction.dest >= 0)
+		{
+			closed.definitions[instruction.dest] = i;
+		}
+	}
+
+	/* the trip count, from counter + step < bound */
+	int condition = terminator.args[0];
+	if (!closed.definitions.count(condition) || loop.instructions[closed.definitions[condition]].op != TK_LESS_THAN)
+	{
+		return false;
+	}
+
+	int next = loop.instructions[closed.definitions[condition]].args[0];
+	int bound = loop.instructions[closed.definitions[condition]].args[1];
+	int counter = -1;
+	for (const std::pair<const int, int> &update : closed.updates)
+	{
+		if (update.second == next)
+		{
+			counter = update.first;
+		}
+	}
+
+	std::unordered_map<int, int> constants;
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		for (const IRGenerator::Instruction &instruction : block.instructions)
+		{
+			if (instruction.op == IR_CONSTANT)
+			{
+				constants[instruction.dest] = instruction.value;
+			}
+		}
+	}
+
+	Affine counter_step;
+	if (counter < 0 || !_accumulator_step(p_function, closed, counter, counter_step))
+	{
+		return false;
+	}
+
+	/* constants from inside the loop are rebuilt in its replacement */
+	for (const IRGenerator::Instruction &instruction : closed.code)
+	{
+		if (instruction.op == IR_CONSTANT)
+		{
+			constants[instruction.dest] = instruction.value;
+		}
+	}
+
+	if (
+		!constants.count(bound) ||
+		!constants.count(closed.initial[counter]) ||
+		counter_step.step != -1 ||
+		!constants.count(counter_step.base) ||
+		constants[counter_step.base] < 1
+	) {
+		return false;
+	}
+
+	long long start = constants[closed.initial[counter]];
+	long long step = constants[counter_step.base];
+	long long end = constants[bound];
+	long long iterations = (start + step >= end) ? 1 : (end - start + step - 1) / step;
+	if (start + iterations * step > INT_MAX)
+	{
+		return false;
+	}
+
+	/* every value used after the loop, at the last time round */
+	std::unordered_map<int, int> replacements;
+	for (unsigned int i = 0; i < p_function.blocks.size(); i++)
+	{
+		if (i == p_block)
+		{
+			continue;
+		}
+
+		for (const IRGenerator::Instruction &instruction : p_function.blocks[i].instructions)
+		{
+			for (int arg : instruction.args)
+			{
+				if (!closed.definitions.count(arg) || replacements.count(arg))
+				{
+					continue;
+				}
+
+				Affine form;
+				int phi = -1;
+				for (const std::pair<const int, int> &update : closed.updates)
+				{
+					if (update.second == arg)
+					{
+						phi = update.first;
+					}
+				}
+
+				if (closed.updates.count(arg) || phi >= 0)
+				{
+					int accumulator = (phi >= 0) ? phi : arg;
+					if (!_accumulator_step(p_function, closed, accumulator, form))
+					{
+						return false;
+					}
+					replacements[arg] = _evaluate_closed(p_function, closed, closed.initial[accumulator], form, iterations - ((phi >= 0) ? 0 : 1));
+					continue;
+				}
+
+				if (!_affine_form(p_function, closed, arg, form))
+				{
+					return false;
+				}
+				replacements[arg] = form.base;
+				if (form.step != -1)
+				{
+					int last = _emit_closed_constant(p_function, closed, iterations - 1);
+					int offset = _emit_closed(p_function, closed, TK_STAR, form.step, last);
+					replacements[arg] = _emit_closed(p_function, closed, TK_PLUS, form.base, offset);
+				}
+			}
+		}
+	}
+
+	/* every phi has to be accounted for, or the loop was doing something else */
+	for (const std::pair<const int, int> &update : closed.updates)
+	{
+		Affine form;
+		if (!_accumulator_step(p_function, closed, update.first, form))
+		{
+			return false;
+		}
+	}
+
+	IRGenerator::Block &block = p_function.blocks[p_block];
+	unsigned int exit = block.instructions.back().targets[1];
+	block.instructions = closed.code;
+	block.instructions.push_back(IRGenerator::make_instruction(IR_JUMP));
+	block.instructions.back().targets.push_back(exit);
+
+	for (const std::pair<const int, int> &replacement : replacements)
+	{
+		_replace_uses(p_function, replacement.first, replacement.second);
+	}
+	return true;
+}
+
+bool Optimiser::_affine_form(IRGenerator::Function &p_function, ClosedLoop &p_loop, int p_value, Affine &r_form)
+{
+	/* defined before the loop, the same every time round */
+	if (!p_loop.definitions.count(p_value))
+	{
+		r_form = Affine{p_value, -1};
+		return true;
+	}
+
+	if (p_loop.forms.count(p_value))
+	{
+		r_form = p_loop.forms[p_value];
+		return true;
+	}
+
+	if (p_loop.visiting.count(p_value))
+	{
+		return false;
+	}
+	p_loop.visiting.insert(p_value);
+
+	const IRGenerator::Instruction instruction = p_function.blocks[p_loop.block].instructions[p_loop.definitions[p_value]];
+	Affine left;
+	Affine right;
+	bool found = false;
+	switch (instruction.op)
+	{
+		case IR_CONSTANT:
+		{
+			r_form = Affine{_emit_closed_constant(p_function, p_loop, instruction.value), -1};
+			found = true;
+		} break;
+		case IR_COPY:
+		{
+			found = _affine_form(p_function, p_loop, instruction.args[0], r_form);
+		} break;
+		case IR_PHI:
+		{
+			/* only counters are affine, anything summing the iteration is quadratic */
+			Affine step;
+			found = _accumulator_step(p_function, p_loop, p_value, step) && step.step == -1;
+			r_form = Affine{p_loop.initial[p_value], step.base};
+		} break;
+		case TK_PLUS:
+		case TK_MINUS:
+		{
+			found = _affine_form(p_function, p_loop, instruction.args[0], left) && _affine_form(p_function, p_loop, instruction.args[1], right);
+			if (!found)
+			{
+				break;
+			}
+
+			r_form.base = _emit_closed(p_function, p_loop, instruction.op, left.base, right.base);
+			r_form.step = left.step;
+			if (right.step != -1)
+			{
+				int zero = _emit_closed_constant(p_function, p_loop, 0);
+				r_form.step = _emit_closed(p_function, p_loop, instruction.op, (left.step != -1) ? left.step : zero, right.step);
+			}
+		} break;
+		case TK_STAR:
+		{
+			found = _affine_form(p_function, p_loop, instruction.args[0], left) && _affine_form(p_function, p_loop, instruction.args[1], right);
+			if (found && left.step != -1)
+			{
+				std::swap(left, right);
+			}
+
+			/* one side has to be the same every time round */
+			found &= left.step == -1;
+			if (!found)
+			{
+				break;
+			}
+
+			r_form.base = _emit_closed(p_function, p_loop, TK_STAR, left.base, right.base);
+			r_form.step = (right.step != -1) ? _emit_closed(p_function, p_loop, TK_STAR, left.base, right.step) : -1;
+		} break;
+		default:
+		{
+		} break;
+	}
+
+	p_loop.visiting.erase(p_value);
+	if (found)
+	{
+		p_loop.forms[p_value] = r_form;
+	}
+	return found;
+}
+
+bool Optimiser::_accumulator_step(IRGenerator::Function &p_function, ClosedLoop &p_loop, int p_phi, Affine &r_step)
+{
+	/* what is added to the phi each time round, phi = phi + step or phi - step */
+	int update = p_loop.updates.at(p_phi);
+	if (update == p_phi)
+	{
+		r_step = Affine{_emit_closed_constant(p_function, p_loop, 0), -1};
+		return true;
+	}
+
+	if (!p_loop.definitions.count(update))
+	{
+		return false;
+	}
+
+	const IRGenerator::Instruction instruction = p_function.blocks[p_loop.block].instructions[p_loop.definitions[update]];
+	if (instruction.op != TK_PLUS && instruction.op != TK_MINUS)
+	{
+		return false;
+	}
+
+	int added = -1;
+	if (instruction.args[0] == p_phi)
+	{
+		added = instruction.args[1];
+	}
+	else if (instruction.op == TK_PLUS && instruction.args[1] == p_phi)
+	{
+		added = instruction.args[0];
+	}
+
+	if (added < 0)
+	{
+		return false;
+	}
+
+	/* the step cannot depend on the phi itself */
+	bool inserted = p_loop.visiting.insert(p_phi).second;
+	bool found = _affine_form(p_function, p_loop, added, r_step);
+	if (inserted)
+	{
+		p_loop.visiting.erase(p_phi);
+	}
+	if (!found || instruction.op == TK_PLUS)
+	{
+		return found;
+	}
+
+	int zero = _emit_closed_constant(p_function, p_loop, 0);
+	r_step.base = _emit_closed(p_function, p_loop, TK_MINUS, zero, r_step.base);
+	if (r_step.step != -1)
+	{
+		r_step.step = _emit_closed(p_function, p_loop, TK_MINUS, zero, r_step.step);
+	}
+	return true;
+}
+
+int Optimiser::_evaluate_closed(
+		IRGenerator::Function &p_function,
+		ClosedLoop &p_loop,
+		int p_initial,
+		const Affine &p_step,
+		long long p_iterations
+) {
+	/* initial + base * n + step * n(n - 1) / 2, wrapping like the loop would have */
+	unsigned long long n = p_iterations;
+	int times = _emit_closed_constant(p_function, p_loop, (unsigned int)n);
+	int value = _emit_closed(p_function, p_loop, TK_PLUS, p_initial, _emit_closed(p_function, p_loop, TK_STAR, p_step.base, times));
+	if (p_step.step == -1 || n < 2)
+	{
+		return value;
+	}
+
+	int pairs = _emit_closed_constant(p_function, p_loop, (unsigned int)(n * (n - 1) / 2));
+	return _emit_closed(p_function, p_loop, TK_PLUS, value, _emit_closed(p_function, p_loop, TK_STAR, p_step.step, pairs));
+}
+
+int Optimiser::_emit_closed(IRGenerator::Function &p_function, ClosedLoop &p_loop, Token p_op, int p_left, int p_right)
+{
+	int dest = p_function.register_count++;
+	p_loop.code.push_back(IRGenerator::make_instruction(p_op, dest, {p_left, p_right}));
+	return dest;
+}
+
+int Optimiser::_emit_closed_constant(IRGenerator::Function &p_function, ClosedLoop &p_loop, int p_value)
+{
+	int dest = p_function.register_count++;
+	p_loop.code.push_back(IRGenerator::make_instruction(IR_CONSTANT, dest, {}, p_value));
+	return dest;
+}
+
+bool Optimiser::_unroll_loops(IRGenerator::Function &p_function)
+{
+	/*
+	 * Counted loops that are a single block testing i < n after
+	 * i = i + k run unroll_factor bodies per test while there are
+	 * that many iterations left, the original loop finishes off the
+	 * rest. Works on locals, before they become SSA values.
+	 */
+	/* only worked out once a loop might need it */
+	std::set<unsigned int> closable;
+	bool closable_known = false;
+
+	bool changed = false;
+	for (unsigned int b = 0; b < p_function.blocks.size(); b++)
+	{
+		IRGenerator::Block loop = p_function.blocks[b];
+		const IRGenerator::Instruction &terminator = loop.instructions.back();
+		if (
+			terminator.op != IR_BRANCH ||
+			terminator.targets[0] != loop.id ||
+			terminator.targets[1] == loop.id ||
+			loop.instructions.size() > unroll_size_limit
+		) {
+			continue;
+		}
+
+		/* entered only from itself and one preheader */
+		std::unordered_map<unsigned int, std::vector<unsigned int>> predecessors = _predecessors(p_function);
+		std::vector<unsigned int> &entries = predecessors[loop.id];
+		if (entries.size() != 2 || std::count(entries.begin(), entries.end(), loop.id) != 1)
+		{
+			continue;
+		}
+		unsigned int preheader = (entries[0] == loop.id) ? entries[1] : entries[0];
+
+		std::unordered_map<int, unsigned int> definitions;
+		for (unsigned int i = 0; i < loop.instructions.size(); i++)
+		{
+			if (loop.instructions[i].dest >= 0)
+			{
+				definitions[loop.instructions[i].dest] = i;
+			}
+		}
+
+		if (!definitions.count(terminator.args[0]))
+		{
+			continue;
+		}
+		const IRGenerator::Instruction &condition = loop.instructions[definitions[terminator.args[0]]];
+		if (condition.op != TK_LESS_THAN)
+		{
+			continue;
+		}
+		int counter = condition.args[0];
+		int bound = condition.args[1];
+
+		/* the counter is stored once, as the value it had coming in plus a constant */
+		std::string local;
+		unsigned int stores = 0;
+		for (const IRGenerator::Instruction &instruction : loop.instructions)
+		{
+			if (instruction.op == IR_STORE && instruction.args[0] == counter)
+			{
+				local = instruction.name;
+			}
+		}
+
+		int store_index = -1;
+		for (unsigned int i = 0; i < loop.instructions.size(); i++)
+		{
+			if (loop.instructions[i].op == IR_STORE && loop.instructions[i].name == local)
+			{
+				stores++;
+				store_index = i;
+			}
+		}
+
+		if (local.empty() || stores != 1 || !definitions.count(counter))
+		{
+			continue;
+		}
+
+		/* value numbering shares constants, so the step may well be defined before the loop */
+		std::unordered_map<int, int> constants;
+		for (const IRGenerator::Block &block : p_function.blocks)
+		{
+			for (const IRGenerator::Instruction &instruction : block.instructions)
+			{
+				if (instruction.op == IR_CONSTANT)
+				{
+					constants[instruction.dest] = instruction.value;
+				}
+			}
+		}
+
+		const IRGenerator::Instruction &step = loop.instructions[definitions[counter]];
+		if (step.op != TK_PLUS)
+		{
+			continue;
+		}
+
+		int load = step.args[0];
+		int increment = step.args[1];
+		if (!definitions.count(load) || loop.instructions[definitions[load]].op != IR_LOAD)
+		{
+			std::swap(load, increment);
+		}
+
+		if (
+			!definitions.count(load) ||
+			loop.instructions[definitions[load]].op != IR_LOAD ||
+			loop.instructions[definitions[load]].name != local ||
+			definitions[load] > (unsigned int)store_index ||
+			!constants.count(increment) ||
+			constants[increment] < 1 ||
+			constants[increment] > unroll_step_limit
+		) {
+			continue;
+		}
+
+		/* the bound cannot change inside the loop, reload or rebuild it where needed */
+		IRGenerator::Instruction bound_instruction = IRGenerator::make_instruction(IR_COPY, -1, {bound});
+		if (definitions.count(bound))
+		{
+			bound_instruction = loop.instructions[definitions[bound]];
+			bool invariant = bound_instruction.op == IR_CONSTANT;
+			if (bound_instruction.op == IR_LOAD)
+			{
+				invariant = true;
+				for (const IRGenerator::Instruction &instruction : loop.instructions)
+				{
+					invariant &= instruction.op != IR_STORE || instruction.name != bound_instruction.name;
+				}
+			}
+
+			if (!invariant)
+			{
+				continue;
+			}
+		}
+
+		/* left whole when the closed form can remove it altogether, which it never does with a call */
+		bool calls = false;
+		for (const IRGenerator::Instruction &instruction : loop.instructions)
+		{
+			calls |= instruction.op == IR_CALL;
+		}
+
+		if (!calls)
+		{
+			if (!closable_known)
+			{
+				closable = _closable_loops(p_function);
+				closable_known = true;
+			}
+
+			if (closable.count(loop.id))
+			{
+				continue;
+			}
+		}
+
+		unsigned int check_block = p_function.block_count++;
+		unsigned int test_block = p_function.block_count++;
+		unsigned int unrolled_block = p_function.block_count++;
+		unsigned int remainder_block = p_function.block_count++;
+		std::vector<IRGenerator::Block> blocks(4);
+
+		/* stop early when bound - (factor - 1) * k would wrap */
+		IRGenerator::Block &check = blocks[0];
+		check.id = check_block;
+		check.label = loop.label + "_unroll_check";
+		int check_bound = _rematerialise(p_function, check, bound_instruction);
+		int distance = p_function.register_count++;
+		check.instructions.push_back(IRGenerator::make_instruction(IR_CONSTANT, distance, {}, (unroll_factor - 1) * constants[increment]));
+		int limit = p_function.register_count++;
+		check.instructions.push_back(IRGenerator::make_instruction(TK_MINUS, limit, {check_bound, distance}));
+		int wraps = p_function.register_count++;
+		check.instructions.push_back(IRGenerator::make_instruction(TK_LESS_THAN, wraps, {limit, check_bound}));
+		check.instructions.push_back(IRGenerator::make_instruction(IR_BRANCH, -1, {wraps}));
+		check.instructions.back().targets = {test_block, loop.id};
+
+		IRGenerator::Block &test = blocks[1];
+		test.id = test_block;
+		test.label = loop.label + "_unroll_test";
+		_emit_counter_test(p_function, test, local, limit, unrolled_block, loop.id);
+
+		/* a fresh set of registers for every copy of the body */
+		IRGenerator::Block &unrolled = blocks[2];
+		unrolled.id = unrolled_block;
+		unrolled.label = loop.label + "_unrolled";
+		for (unsigned int copy = 0; copy < unroll_factor; copy++)
+		{
+			std::unordered_map<int, int> renamed;
+			for (unsigned int i = 0; i + 1 < loop.instructions.size(); i++)
+			{
+				IRGenerator::Instruction instruction = loop.instructions[i];
+				for (int &arg : instruction.args)
+				{
+					if (renamed.count(arg))
+					{
+						arg = renamed[arg];
+					}
+				}
+
+				if (instruction.dest >= 0)
+				{
+					renamed[instruction.dest] = p_function.register_count;
+					instruction.dest = p_function.register_count++;
+				}
+				unrolled.instructions.push_back(instruction);
+			}
+		}
+		_emit_counter_test(p_function, unrolled, local, limit, unrolled_block, remainder_block);
+
+		/* whatever is left goes round the original loop, if anything */
+		IRGenerator::Block &remainder = blocks[3];
+		remainder.id = remainder_block;
+		remainder.label = loop.label + "_remainder";
+		int remainder_bound = _rematerialise(p_function, remainder, bound_instruction);
+		_emit_counter_test(p_function, remainder, local, remainder_bound, loop.id, terminator.targets[1]);
+
+		for (IRGenerator::Block &block : p_function.blocks)
+		{
+			if (block.id != preheader)
+			{
+				continue;
+			}
+
+			for (unsigned int &target : block.instructions.back().targets)
+			{
+				if (target == loop.id)
+				{
+					target = check_block;
+				}
+			}
+		}
+
+		p_function.blocks.insert(p_function.blocks.begin() + b, blocks.begin(), blocks.end());
+		b += blocks.size();
+		changed = true;
+	}
+	return changed;
+}
+
+std::set<unsigned int> Optimiser::_closable_loops(const IRGenerator::Function &p_function)
+{
+	/* the closed form needs SSA, so it is tried on a copy taken as far as it would be */
+	IRGenerator::Function copy = p_function;
+	_promote_locals(copy);
+	_run_passes(copy);
+
+	std::unordered_map<unsigned int, std::vector<unsigned int>> predecessors = _predecessors(copy);
+	std::set<unsigned int> loops;
+	for (unsigned int i = 0; i < copy.blocks.size(); i++)
+	{
+		unsigned int id = copy.blocks[i].id;
+		if (_close_loop(copy, i, predecessors))
+		{
+			loops.insert(id);
+		}
+	}
+	return loops;
+}
+
+int Optimiser::_rematerialise(
+		IRGenerator::Function &p_function,
+		IRGenerator::Block &p_block,
+		const IRGenerator::Instruction &p_instruction
+) {
+	/* values from outside the loop are already available */
+	if (p_instruction.op == IR_COPY)
+	{
+		return p_instruction.args[0];
+	}
+
+	IRGenerator::Instruction instruction = p_instruction;
+	instruction.dest = p_function.register_count++;
+	p_block.instructions.push_back(instruction);
+	return instruction.dest;
+}
+
+void Optimiser::_emit_counter_test(
+		IRGenerator::Function &p_function,
+		IRGenerator::Block &p_block,
+		const std::string &p_local,
+		int p_bound,
+		unsigned int p_true,
+		unsigned int p_false
+) {
+	int counter = p_function.register_count++;
+	p_block.instructions.push_back(IRGenerator::make_instruction(IR_LOAD, counter, {}, 0, p_local));
+	int condition = p_function.register_count++;
+	p_block.instructions.push_back(IRGenerator::make_instruction(TK_LESS_THAN, condition, {counter, p_bound}));
+	p_block.instructions.push_back(IRGenerator::make_instruction(IR_BRANCH, -1, {condition}));
+	p_block.instructions.back().targets = {p_true, p_false};
+}
+
+void Optimiser::_place_blocks(IRGenerator::Function &p_function)
+{
+	/*
+	 * Chains of blocks where each falls through to the next. A chain
+	 * follows the likely side of a hinted branch, otherwise the next
+	 * block in source order, then the blocks it skipped start their
+	 * own chains after it. Cold code ends up out of the way.
+	 */
+	std::unordered_map<unsigned int, unsigned int> indices = _block_indices(p_function);
+	std::set<unsigned int> placed;
+	std::vector<IRGenerator::Block> blocks;
+	for (unsigned int i = 0; i < p_function.blocks.size(); i++)
+	{
+		unsigned int index = i;
+		while (!placed.count(p_function.blocks[index].id))
+		{
+			const IRGenerator::Block &block = p_function.blocks[index];
+			placed.insert(block.id);
+			blocks.push_back(block);
+
+			const IRGenerator::Instruction &terminator = block.instructions.back();
+			if (terminator.op == IR_BRANCH && terminator.value != 0)
+			{
+				unsigned int likely = terminator.targets[(terminator.value > 0) ? 0 : 1];
+				if (!placed.count(likely))
+				{
+					index = indices[likely];
+					continue;
+				}
+			}
+
+			if (index + 1 >= p_function.blocks.size())
+			{
+				break;
+			}
+			index++;
+		}
+	}
+	p_function.blocks = blocks;
+}
+
+bool Optimiser::_simplify_cfg(IRGenerator::Function &p_function)
+{
+	bool changed = false;
+
+	/* branches and switches to the same place are just jumps */
+	for (IRGenerator::Block &block : p_function.blocks)
+	{
+		IRGenerator::Instruction &terminator = block.instructions.back();
+		bool same = terminator.op == IR_BRANCH || terminator.op == IR_SWITCH;
+		for (unsigned int target : terminator.targets)
+		{
+			same &= target == terminator.targets[0];
+		}
+
+		if (same)
+		{
+			unsigned int target = terminator.targets[0];
+			terminator = IRGenerator::make_instruction(IR_JUMP);
+			terminator.targets.push_back(target);
+			changed = true;
+		}
+	}
+
+	/* jump straight through blocks that only jump */
+	std::unordered_map<unsigned int, unsigned int> forward;
+	for (unsigned int i = 1; i < p_function.blocks.size(); i++)
+	{
+		const IRGenerator::Block &block = p_function.blocks[i];
+		if (block.instructions.size() != 1 || block.instructions[0].op != IR_JUMP || block.instructions[0].targets[0] == block.id)
+		{
+			continue;
+		}
+
+		/* phis depend on which block we came from, so leave those edges alone */
+		if (!_has_phis(p_function, block.instructions[0].targets[0]))
+		{
+			forward[block.id] = block.instructions[0].targets[0];
+		}
+	}
+
+	for (IRGenerator::Block &block : p_function.blocks)
+	{
+		for (unsigned int &target : block.instructions.back().targets)
+		{
+			/* bound the walk, as empty loops jump to themselves */
+			unsigned int steps = 0;
+			while (forward.count(target) && steps++ < forward.size())
+			{
+				target = forward[target];
+				changed = true;
+			}
+		}
+	}
+
+	changed |= _remove_unreachable_blocks(p_function);
+
+	/* merge blocks into their only predecessor */
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		std::unordered_map<unsigned int, std::vector<unsigned int>> predecessors = _predecessors(p_function);
+		std::unordered_map<unsigned int, unsigned int> indices = _block_indices(p_function);
+
+		for (IRGenerator::Block &block : p_function.blocks)
+		{
+			const IRGenerator::Instruction &terminator = block.instructions.back();
+			if (terminator.op != IR_JUMP)
+			{
+				continue;
+			}
+
+			unsigned int target = terminator.targets[0];
+			if (target == p_function.blocks[0].id || target == block.id || predecessors[target].size() != 1)
+			{
+				continue;
+			}
+
+			unsigned int index = indices[target];
+			std::vector<IRGenerator::Instruction> instructions = p_function.blocks[index].instructions;
+
+			/* with a single predecessor any phis just forward their value */
+			while (instructions.front().op == IR_PHI)
+			{
+				_replace_uses(p_function, instructions.front().dest, instructions.front().args[0]);
+				for (IRGenerator::Instruction &instruction : instructions)
+				{
+					for (int &arg : instruction.args)
+					{
+						if (arg == instructions.front().dest)
+						{
+							arg = instructions.front().args[0];
+						}
+					}
+				}
+				instructions.erase(instructions.begin());
+			}
+
+			for (unsigned int successor : instructions.back().targets)
+			{
+				_rename_phi_incoming(p_function, successor, target, block.id);
+			}
+
+			block.instructions.pop_back();
+			block.instructions.insert(block.instructions.end(), instructions.begin(), instructions.end());
+			p_function.blocks.erase(p_function.blocks.begin() + index);
+
+			merged = true;
+			changed = true;
+			break;
+		}
+	}
+	return changed;
+}
+
+bool Optimiser::_remove_unreachable_blocks(IRGenerator::Function &p_function)
+{
+	std::unordered_map<unsigned int, unsigned int> indices = _block_indices(p_function);
+
+	std::set<unsigned int> reachable;
+	std::vector<unsigned int> stack;
+	stack.push_back(p_function.blocks[0].id);
+	while (!stack.empty())
+	{
+		unsigned int id = stack.back();
+		stack.pop_back();
+		if (reachable.count(id))
+		{
+			continue;
+		}
+		reachable.insert(id);
+
+		for (unsigned int target : p_function.blocks[indices[id]].instructions.back().targets)
+		{
+			stack.push_back(target);
+		}
+	}
+
+	if (reachable.size() == p_function.blocks.size())
+	{
+		return false;
+	}
+
+	/* every phi is cleaned up before any block is copied, a loop header comes before its back edge */
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		if (reachable.count(block.id))
+		{
+			continue;
+		}
+
+		for (unsigned int target : block.instructions.back().targets)
+		{
+			_remove_phi_incoming(p_function, target, block.id);
+		}
+	}
+
+	std::vector<IRGenerator::Block> blocks;
+	for (const IRGenerator::Block &block : p_function.blocks)
+	{
+		if (reachable.count(block.id))
+		{
+			blocks.push_back(block);
+		}
+	}
+	p_function.blocks = blocks;
+	return true;
+}
+
+bool Optimiser::_eliminate_dead_stores(IRGenerator::Function &p_function)
+{
+	/*
+	 * Backwards liveness of locals, a store is dead if
+	 * the local is not read again before being overwritten.
+	 */
+	std::vector<std::set<std::string>> live_in;
+	std::vector<std::set<std::string>> live_out;
+	_local_liveness(p_function, live_in, live_out);
+	unsigned int block_count = p_function.blocks.size();
+
+	bool changed = false;
+	for (unsigned int i = 0; i < block_count; i++)
+	{
+		std::vector<IRGenerator::Instruction> &instructions = p_function.blocks[i].instructions;
+		std::set<std::string> live = live_out[i];
+		for (int j = instructions.size() - 1; j >= 0; j--)
+		{
+			if (instructions[j].op == IR_LOAD)
+			{
+				live.insert(instructions[j].name);
+				continue;
+			}
+
+			if (instructions[j].op != IR_STORE)
+			{
+				continue;
+			}
+
+			if (!live.count(instructions[j].name))
+			{
+				instructions.erase(instructions.begin() + j);
+				changed = true;
+				continue;
+			}
+			live.erase(instructions[j].name);
+		}
+	}
+	return changed;
+}
+
+bool Optimiser::_eliminate_dead_code(IRGenerator::Function &p_function)
+{
+	bool changed = false;
+	bool removed = true;
+	while (removed)
+	{
+		removed = false;
+
+		std::unordered_map<int, unsigned int> uses;
+		for (const IRGenerator::Block &block : p_function.blocks)
+		{
+			for (const IRGenerator::Instruction &instruction : block.instructions)
+			{
+				for (int arg : instruction.args)
+				{
+					uses[arg]++;
+				}
+			}
+		}
+
+		for (IRGenerator::Block &block : p_function.blocks)
+		{
+			std::vector<IRGenerator::Instruction> &instructions = block.instructions;
+			for (int i = instructions.size() - 1; i >= 0; i--)
+			{
+				/* calls may have side effects */
+				if (instructions[i].dest < 0 || instructions[i].op == IR_CALL || uses[instructions[i].dest] > 0)
+				{
+					continue;
+				}
+				instructions.erase(instructions.begin() + i);
+				removed = true;
+				changed = true;
+			}
+		}
+	}
+	return changed;
+}
+
+Optimiser::Optimiser()
+{
+
+}
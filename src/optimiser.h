@@ -0,0 +1,244 @@
+/*************************************************************************/
+/*  optimiser.h                                                          */
+/*************************************************************************/
+/*                       The MIT License (MIT)                           */
+/*************************************************************************/
+/* Copyright (c) 2018 Paul Batty.                                        */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#ifndef OPTIMISER_H
+#define OPTIMISER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <set>
+
+#include "tokens.h"
+#include "options.h"
+#include "ir_generator.h"
+
+class Optimiser
+{
+private:
+	/* bodies run per test when unrolled, and how big a loop can be to get unrolled */
+	const unsigned int unroll_factor = 4;
+	const unsigned int unroll_size_limit = 32;
+	const int unroll_step_limit = 1 << 16;
+
+	/* how much work a call evaluated at compile time can take */
+	const unsigned int interpreter_step_limit = 1 << 17;
+	const unsigned int interpreter_depth_limit = 256;
+
+	/* largest function cloned for its constant arguments, and how many clones to make */
+	const unsigned int clone_size_limit = 64;
+	const unsigned int clone_limit = 16;
+
+	/*
+	 * Every function as it was generated, by name. There is no
+	 * memory outside of locals, so a function is pure, and only
+	 * depends on its arguments, unless it calls something that
+	 * is not defined here.
+	 */
+	std::unordered_map<std::string, IRGenerator::Function> program;
+	std::unordered_map<std::string, std::unordered_map<unsigned int, unsigned int>> program_indices;
+	std::set<std::string> pure_functions;
+
+	/* clones by the function and constant arguments they were made for */
+	std::unordered_map<std::string, std::string> clones;
+
+	/*
+	 * A counter for every block, then one for the taken side of its
+	 * branch if it ends in one, in function and block order as they
+	 * are after leaving SSA. Profiles are a 32 bit count of counters,
+	 * a 32 bit count of functions and a 32 bit checksum of each,
+	 * followed by the 64 bit counters.
+	 */
+	Options options;
+	std::vector<unsigned long long> profile;
+	std::vector<unsigned int> profile_checksums;
+
+	void _load_profile();
+	unsigned int _profile_checksum(const IRGenerator::Function &p_function);
+	void _instrument(IRGenerator::Function &p_function, unsigned int &r_counter);
+	void _apply_profile(IRGenerator::Function &p_function, unsigned int &r_counter);
+
+	std::unordered_map<unsigned int, unsigned int> _block_indices(
+			const IRGenerator::Function &p_function
+	);
+
+	std::unordered_map<unsigned int, std::vector<unsigned int>> _predecessors(
+			const IRGenerator::Function &p_function
+	);
+
+	void _postorder(
+			const IRGenerator::Function &p_function,
+			std::unordered_map<unsigned int, unsigned int> &p_indices,
+			unsigned int p_block,
+			std::set<unsigned int> &r_visited,
+			std::vector<unsigned int> &r_order
+	);
+
+	std::vector<unsigned int> _reverse_postorder(const IRGenerator::Function &p_function);
+
+	std::unordered_map<unsigned int, unsigned int> _immediate_dominators(
+			const IRGenerator::Function &p_function
+	);
+
+	std::unordered_map<unsigned int, std::set<unsigned int>> _dominance_frontiers(
+			const IRGenerator::Function &p_function,
+			std::unordered_map<unsigned int, unsigned int> &p_dominators
+	);
+
+	void _local_liveness(
+			const IRGenerator::Function &p_function,
+			std::vector<std::set<std::string>> &r_live_in,
+			std::vector<std::set<std::string>> &r_live_out
+	);
+
+	void _replace_uses(IRGenerator::Function &p_function, int p_from, int p_to);
+	bool _has_phis(const IRGenerator::Function &p_function, unsigned int p_block);
+	void _remove_phi_incoming(IRGenerator::Function &p_function, unsigned int p_block, unsigned int p_predecessor);
+	void _rename_phi_incoming(
+			IRGenerator::Function &p_function,
+			unsigned int p_block,
+			unsigned int p_from,
+			unsigned int p_to
+	);
+
+	bool _evaluate(Token p_op, int p_left, int p_right, int &r_result);
+	bool _is_commutative(Token p_op);
+
+	void _number_values(
+			IRGenerator::Function &p_function,
+			std::unordered_map<unsigned int, unsigned int> &p_indices,
+			std::unordered_map<unsigned int, std::vector<unsigned int>> &p_children,
+			unsigned int p_block,
+			std::unordered_map<std::string, int> p_available,
+			std::unordered_map<int, int> &r_replacements
+	);
+
+	void _run_passes(IRGenerator::Function &p_function);
+
+	bool _promote_locals(IRGenerator::Function &p_function);
+	void _rename_locals(
+			IRGenerator::Function &p_function,
+			std::unordered_map<unsigned int, unsigned int> &p_indices,
+			std::unordered_map<unsigned int, std::vector<unsigned int>> &p_children,
+			unsigned int p_block,
+			std::unordered_map<std::string, std::vector<int>> p_stacks,
+			std::unordered_map<int, int> &r_replacements
+	);
+	void _leave_ssa(IRGenerator::Function &p_function);
+	void _place_blocks(IRGenerator::Function &p_function);
+
+	/* base + step * t on the t'th time round a loop, both invariant, step is -1 when known to be zero */
+	struct Affine
+	{
+		int base;
+		int step;
+	};
+
+	/* a single block loop being rewritten, code is what replaces it */
+	struct ClosedLoop
+	{
+		unsigned int block;
+		std::unordered_map<int, unsigned int> definitions;
+		std::unordered_map<int, int> initial;
+		std::unordered_map<int, int> updates;
+		std::unordered_map<int, Affine> forms;
+		std::set<int> visiting;
+		std::vector<IRGenerator::Instruction> code;
+	};
+
+	bool _close_loops(IRGenerator::Function &p_function);
+	bool _close_loop(
+			IRGenerator::Function &p_function,
+			unsigned int p_block,
+			std::unordered_map<unsigned int, std::vector<unsigned int>> &p_predecessors
+	);
+	bool _affine_form(IRGenerator::Function &p_function, ClosedLoop &p_loop, int p_value, Affine &r_form);
+	bool _accumulator_step(IRGenerator::Function &p_function, ClosedLoop &p_loop, int p_phi, Affine &r_step);
+	int _emit_closed(IRGenerator::Function &p_function, ClosedLoop &p_loop, Token p_op, int p_left, int p_right);
+	int _emit_closed_constant(IRGenerator::Function &p_function, ClosedLoop &p_loop, int p_value);
+	int _evaluate_closed(
+			IRGenerator::Function &p_function,
+			ClosedLoop &p_loop,
+			int p_initial,
+			const Affine &p_step,
+			long long p_iterations
+	);
+
+	bool _unroll_loops(IRGenerator::Function &p_function);
+	std::set<unsigned int> _closable_loops(const IRGenerator::Function &p_function);
+	int _rematerialise(
+			IRGenerator::Function &p_function,
+			IRGenerator::Block &p_block,
+			const IRGenerator::Instruction &p_instruction
+	);
+	void _emit_counter_test(
+			IRGenerator::Function &p_function,
+			IRGenerator::Block &p_block,
+			const std::string &p_local,
+			int p_bound,
+			unsigned int p_true,
+			unsigned int p_false
+	);
+
+	void _find_pure_functions();
+	bool _propagate_calls(
+			IRGenerator::Function &p_function,
+			std::vector<IRGenerator::Function> &r_clones
+	);
+	std::string _clone_function(
+			const std::string &p_name,
+			const std::vector<int> &p_args,
+			std::unordered_map<int, int> &p_constants,
+			std::vector<IRGenerator::Function> &r_clones
+	);
+	bool _interpret(
+			const std::string &p_name,
+			const std::vector<int> &p_args,
+			unsigned int p_depth,
+			unsigned int &r_steps,
+			int &r_result
+	);
+
+	bool _fold_constants(IRGenerator::Function &p_function);
+	bool _fold_identity(
+			IRGenerator::Instruction &p_instruction,
+			std::unordered_map<int, int> &p_constants,
+			std::unordered_map<int, int> &r_identities
+	);
+	bool _eliminate_common_subexpressions(IRGenerator::Function &p_function);
+	bool _simplify_cfg(IRGenerator::Function &p_function);
+	bool _remove_unreachable_blocks(IRGenerator::Function &p_function);
+	bool _eliminate_dead_stores(IRGenerator::Function &p_function);
+	bool _eliminate_dead_code(IRGenerator::Function &p_function);
+
+public:
+	void optimise(std::vector<IRGenerator::Function> &p_functions, const Options &p_options);
+
+	Optimiser();
+};
+
+#endif // OPTIMISER_H
@@ -0,0 +1,65 @@
+/*************************************************************************/
+/*  options.h                                                            */
+/*************************************************************************/
+/*                       The MIT License (MIT)                           */
+/*************************************************************************/
+/* Copyright (c) 2018 Paul Batty.                                        */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <string>
+
+/*
+ * Command line flags that change how code is generated.
+ */
+struct Options
+{
+	bool omit_frame_pointer = false;
+
+	/* -falign-functions=n and -falign-loops=n, in bytes, 1 leaves them unaligned */
+	unsigned int align_functions = 16;
+	unsigned int align_loops = 16;
+
+	/* count blocks and branches into profile_file, or read the counts back */
+	bool profile_generate = false;
+	bool profile_use = false;
+	std::string profile_file;
+
+	/* -fno-ipa-cp, calls with constant arguments are neither evaluated nor cloned */
+	bool propagate_calls = true;
+
+	/* -c, a relocatable object for the system linker rather than an executable */
+	bool compile_only = false;
+
+	/* build the executable in place in a mapping of the output file */
+	bool mmap_output = false;
+
+	/* --run, assemble into memory and call the program from pcc rather than writing it out */
+	bool run = false;
+
+	/* --perf-map, list the functions in /tmp/perf-PID.map so perf can name the code --run made */
+	bool perf_map = false;
+};
+
+#endif // OPTIONS_H
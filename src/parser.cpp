@@ -43,16 +43,20 @@ std::unique_ptr<TreeNode<Parser::Node>> Parser::parse(const std::string &p_file_
 	current_file = p_file_path;
 	std::unique_ptr<TreeNode<Node>> root = _make_node(TYPE_PROGRAM, p_file_path);
 
+	/* the whole file at once, a program cannot be parsed in pieces */
 	const int buffer_size = 4096;
 	std::unique_ptr<char[]> buffer(new char[buffer_size]);
+	std::string code;
 	while (stream)
 	{
 		stream.read(buffer.get(), buffer_size);
-		lexer.append_code(buffer.get());
-		_parse_program(root);
+		code.append(buffer.get(), stream.gcount());
 	}
 	stream.close();
 
+	lexer.append_code(code);
+	_parse_program(root);
+
 	std::cout << "-----------------------------------------------" << std::endl;
 	_print_tree(root);
 	std::cout << "-----------------------------------------------" << std::endl;
@@ -69,6 +73,7 @@ std::unique_ptr<TreeNode<Parser::Node>> Parser::_make_node(
 	node.type = p_type;
 	node.token = p_token;
 	node.value = p_value;
+	node.line = lexer.get_token_line() + 1;
 
 	std::unique_ptr<TreeNode<Node>> tree_node(new TreeNode<Node>());
 	tree_node->set_data(node);
@@ -509,9 +514,15 @@ void Parser::_parse_statement(std::unique_ptr<TreeNode<Node>> &p_parent) {
 		return;
 	}
 
-	if (current_token == TK_CASE    ||
-		current_token == TK_DEFAULT ||
-		(current_token == TK_IDENTIFIER && _peek() == TK_COLON))
+	if (current_token == TK_CASE || current_token == TK_DEFAULT)
+	{
+		std::unique_ptr<TreeNode<Node>> node = _make_node(TYPE_LABELED_STATEMENT, "");
+		_parse_labeled_statement(node);
+		p_parent->add_child(node);
+		return;
+	}
+
+	if (current_token == TK_IDENTIFIER && _peek() == TK_COLON)
 	{
 		// todo labeled
 		return;
@@ -530,6 +541,40 @@ void Parser::_parse_statement(std::unique_ptr<TreeNode<Node>> &p_parent) {
 	_advance();
 }
 
+void Parser::_parse_labeled_statement(
+		std::unique_ptr<TreeNode<Node>> &p_parent
+) {
+	if (current_token != TK_CASE && current_token != TK_DEFAULT)
+	{
+		_error("expected 'case' or 'default' but found '" + lexer.get_token_value() + "'");
+	}
+
+	Token type_token = current_token;
+	std::unique_ptr<TreeNode<Node>> type = _make_node(current_token, lexer.get_token_value());
+	p_parent->add_child(type);
+	_advance();
+
+	if (type_token == TK_CASE)
+	{
+		std::unique_ptr<TreeNode<Node>> expression = _make_node(TYPE_CONSTANT_EXPRESSION, "");
+		_parse_conditional_expression(expression);
+		p_parent->add_child(expression);
+	}
+
+	if (current_token != TK_COLON)
+	{
+		_error("expected ':' but found '" + lexer.get_token_value() + "'");
+	}
+
+	std::unique_ptr<TreeNode<Node>> colon = _make_node(TK_COLON, lexer.get_token_value());
+	p_parent->add_child(colon);
+	_advance();
+
+	std::unique_ptr<TreeNode<Node>> statement = _make_node(TYPE_STATEMENT, "");
+	_parse_statement(statement);
+	p_parent->add_child(statement);
+}
+
 void Parser::_parse_selection_statement(
 		std::unique_ptr<TreeNode<Node>> &p_parent
 ) {
@@ -98,11 +98,13 @@ public:
 		TK_ASSIGN_BIT_XOR,
 	};
 
+	/* line is where it was in the source, 0 when it was made up */
 	struct Node
 	{
 		Token type;
 		Token token;
 		std::string value;
+		int line = 0;
 	};
 
 private:
@@ -209,6 +211,10 @@ private:
 			std::unique_ptr<TreeNode<Node>> &p_parent
 	);
 
+	void _parse_labeled_statement(
+			std::unique_ptr<TreeNode<Node>> &p_parent
+	);
+
 	void _parse_selection_statement(
 			std::unique_ptr<TreeNode<Node>> &p_parent
 	);
@@ -101,6 +101,7 @@ std::unique_ptr<TreeNode<SymanticAnalysier::Node>> SymanticAnalysier::_make_node
 	node.id = node_count++;
 	node.type = p_type;
 	node.value = p_value;
+	node.line = current_node.line;
 
 	std::unique_ptr<TreeNode<Node>> tree_node(new TreeNode<Node>());
 	tree_node->set_data(node);
@@ -323,6 +324,18 @@ void SymanticAnalysier::_analyse_statement(
 							op.type = TK_STAR;
 							op.value = "*";
 						} break;
+						case TK_ASSIGN_DIVIDE:
+						{
+							op.token = TK_DIVIDE;
+							op.type = TK_DIVIDE;
+							op.value = "/";
+						} break;
+						case TK_ASSIGN_MODULO:
+						{
+							op.token = TK_MODULO;
+							op.type = TK_MODULO;
+							op.value = "%";
+						} break;
 					}
 					_advance();
 					tree_vector.insert(tree_vector.begin() + current_node_offset, op);
@@ -341,9 +354,21 @@ void SymanticAnalysier::_analyse_statement(
 				}
 			}
 
-			/* HACK: Need to inject lvalue for self expression. */
+			/* HACK: Need to inject lvalue for self expression, as a statement x++ is x = x + 1. */
 			if (current_node.type == TK_POST_INCREMENT || current_node.type == TK_POST_DECREMENT)
 			{
+				Parser::Node op;
+				op.token = (current_node.type == TK_POST_INCREMENT) ? TK_PLUS : TK_MINUS;
+				op.type = op.token;
+				op.value = (current_node.type == TK_POST_INCREMENT) ? "+" : "-";
+				tree_vector[current_node_offset] = op;
+
+				Parser::Node one;
+				one.type = TK_CONSTANT;
+				one.value = "1";
+				one.token = TK_CONSTANT;
+				tree_vector.insert(tree_vector.begin() + current_node_offset + 1, one);
+
 				Parser::Node lnode;
 				lnode.type = TYPE_IDENTIFIER;
 				lnode.value = value;
@@ -378,6 +403,46 @@ void SymanticAnalysier::_analyse_statement(
 
 			p_parent->add_child(if_node);
 	    } break;
+	    case TK_SWITCH:
+	    {
+		    std::unique_ptr<TreeNode<Node>> switch_node = _make_node(TK_SWITCH, current_node.value);
+
+			_advance(); // switch
+			_advance(); // (
+			_analyse_expression(switch_node);
+
+			std::unique_ptr<TreeNode<Node>> statment = _make_node(TYPE_STATEMENT, current_node.value);
+			_analyse_statement(statment);
+			switch_node->add_child(statment);
+
+			p_parent->add_child(switch_node);
+	    } break;
+	    case TK_CASE:
+	    {
+		    std::unique_ptr<TreeNode<Node>> case_node = _make_node(TK_CASE, current_node.value);
+
+			_advance(); // case
+			_analyse_expression(case_node);
+
+			std::unique_ptr<TreeNode<Node>> statment = _make_node(TYPE_STATEMENT, current_node.value);
+			_analyse_statement(statment);
+			case_node->add_child(statment);
+
+			p_parent->add_child(case_node);
+	    } break;
+	    case TK_DEFAULT:
+	    {
+		    std::unique_ptr<TreeNode<Node>> default_node = _make_node(TK_DEFAULT, current_node.value);
+
+			_advance(); // default
+			_advance(); // :
+
+			std::unique_ptr<TreeNode<Node>> statment = _make_node(TYPE_STATEMENT, current_node.value);
+			_analyse_statement(statment);
+			default_node->add_child(statment);
+
+			p_parent->add_child(default_node);
+	    } break;
 	    case TK_WHILE:
 	    {
 		    std::unique_ptr<TreeNode<Node>> while_node = _make_node(TK_WHILE, current_node.value);
@@ -516,6 +581,7 @@ void SymanticAnalysier::_analyse_expression(
 
 				std::unique_ptr<TreeNode<Node>> close_paren = _make_node(current_node.token, current_node.value);
 				arg_tree[func_call_index]->add_child(close_paren);
+				_advance(); // )
 			}
 			output_queue.push(node);
 			continue;
@@ -566,7 +632,10 @@ void SymanticAnalysier::_analyse_expression(
 
 		while (!op_stack.empty() && op_stack.top().token != TK_PARENTHESIS_OPEN)
 		{
-			if (op_precedence.at(op_stack.top().token) < op_precedence.at(current_node.token))
+			/* operators of the same precedence group left to right, apart from assignment */
+			int top = op_precedence.at(op_stack.top().token);
+			int current = op_precedence.at(current_node.token);
+			if (top < current || (top == current && current_node.token != TK_ASSIGN))
 			{
 				output_queue.push(op_stack.top());
 				op_stack.pop();
@@ -46,6 +46,7 @@ public:
 		unsigned int id;
 		Token type;
 		std::string value;
+		int line = 0;
 	};
 private:
 
@@ -200,6 +200,20 @@ enum Token
 	DECLARATION,
 	CODE_BLOCK,
 
+	/* IR */
+	IR_CONSTANT,
+	IR_PARAMETER,
+	IR_LOAD,
+	IR_STORE,
+	IR_COPY,
+	IR_PHI,
+	IR_CALL,
+	IR_JUMP,
+	IR_BRANCH,
+	IR_SWITCH,
+	IR_RETURN,
+	IR_PROFILE,
+
 	/* assembler tokens */
 	OP_NONE,
 	OP_BYTE,
@@ -226,7 +240,20 @@ enum Token
 	TK_SUB,
 	TK_MUL,
 	TK_INC,
-	TK_DEC
+	TK_DEC,
+	TK_LEA,
+	TK_SET,
+	TK_SHL,
+	TK_SAR,
+	TK_SHR,
+	TK_ASM_AND,
+	TK_NEG,
+	TK_DIV,
+	TK_CLTD,
+	TK_MOVZX,
+	TK_MOVSX,
+	TK_DIRECTIVE,
+	TK_STRING
 };
 
 const std::unordered_map<Token, std::string> token_to_string
@@ -407,6 +434,20 @@ const std::unordered_map<Token, std::string> token_to_string
 	{DECLARATION, "DECLARATION"},
 	{CODE_BLOCK, "CODE_BLOCK"},
 
+	/* IR */
+	{IR_CONSTANT, "CONSTANT"},
+	{IR_PARAMETER, "PARAMETER"},
+	{IR_LOAD, "LOAD"},
+	{IR_STORE, "STORE"},
+	{IR_COPY, "COPY"},
+	{IR_PHI, "PHI"},
+	{IR_CALL, "CALL"},
+	{IR_JUMP, "JUMP"},
+	{IR_BRANCH, "BRANCH"},
+	{IR_SWITCH, "SWITCH"},
+	{IR_RETURN, "RETURN"},
+	{IR_PROFILE, "PROFILE"},
+
 	/* Assembeler */
 	{ OP_NONE, "NONE"},
 	{ OP_BYTE, "BYTE"},
@@ -433,7 +474,20 @@ const std::unordered_map<Token, std::string> token_to_string
 	{ TK_ADD, "ADD"},
 	{ TK_MUL, "MUL"},
 	{ TK_INC, "INC"},
-	{ TK_DEC, "DEC"}
+	{ TK_DEC, "DEC"},
+	{ TK_LEA, "LEA"},
+	{ TK_SET, "SET"},
+	{ TK_SHL, "SHL"},
+	{ TK_SAR, "SAR"},
+	{ TK_SHR, "SHR"},
+	{ TK_ASM_AND, "ASM_AND"},
+	{ TK_NEG, "NEG"},
+	{ TK_DIV, "DIV"},
+	{ TK_CLTD, "CLTD"},
+	{ TK_MOVZX, "MOVZX"},
+	{ TK_MOVSX, "MOVSX"},
+	{ TK_DIRECTIVE, "DIRECTIVE"},
+	{ TK_STRING, "STRING"}
 };
 
 const std::unordered_map<Token, int> op_precedence
@@ -452,6 +506,9 @@ const std::unordered_map<Token, int> op_precedence
 
 	{TK_EQUAL, 7},
 
+	{TK_AND, 11},
+	{TK_OR, 12},
+
 	{TK_ASSIGN, 14}
 };
 
@@ -0,0 +1,21 @@
+//result=43
+
+int sum(int a, int b, int c, int d, int e, int f, int g, int h)
+{
+	return a + b + c + d + e + f + g + h;
+}
+
+int sub(int a, int b)
+{
+	return a - b;
+}
+
+int swap(int a, int b)
+{
+	return sub(b, a);
+}
+
+int main()
+{
+	return sum(1, 2, 3, 4, 5, 6, 7, 8) + swap(3, 10);
+}
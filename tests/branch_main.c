@@ -0,0 +1,23 @@
+//result=192
+
+int main()
+{
+	int s = 0;
+	int i = 0;
+	int n = 3;
+
+	/* the loop body is too long for a rel8 back edge, the if is not */
+	while (i < n)
+	{
+		s = s + i * 3 + 1; s = (s - i) + 2; s = (s + i * 5) - 1; s = s + 7;
+		s = s + i * 3 + 1; s = (s - i) + 2; s = (s + i * 5) - 1; s = s + 7;
+		s = s + i * 3 + 1; s = (s - i) + 2; s = (s + i * 5) - 1; s = s + 7;
+		s = s + i * 3 + 1; s = (s - i) + 2; s = (s + i * 5) - 1; s = s + 7;
+		i = i + 1;
+		if (1000 < s)
+		{
+			s = 0;
+		}
+	}
+	return s;
+}
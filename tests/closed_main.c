@@ -0,0 +1,88 @@
+//result=85
+
+int f(int k, int x)
+{
+	int s = 0;
+	int i;
+	for (i = 0; i < 100; i++)
+	{
+		s = s + i * k + x;
+	}
+	return s;
+}
+
+int g(int k)
+{
+	int s = 7;
+	int t = 0;
+	int i = 3;
+	while (i < 50)
+	{
+		t = t - 2;
+		s = s - i;
+		i = i + 3;
+	}
+	return s + t * k + i;
+}
+
+int h(int k)
+{
+	int s = 0;
+	int i = 0;
+	do
+	{
+		s = s + k * i * 2;
+		i = i + 1;
+	} while (i < 1);
+	return s + i;
+}
+
+int squares()
+{
+	int s = 0;
+	int i;
+	for (i = 0; i < 100000; i++)
+	{
+		s = s + i * i;
+	}
+	return s;
+}
+
+/* not affine, so it is unrolled instead */
+int mix(int k)
+{
+	int s = 0;
+	int i;
+	for (i = 0; i < 1000; i = i + 2)
+	{
+		s = (s * 3) + k;
+	}
+	return s;
+}
+
+/* the inner loop closes to 20, so the outer loop never goes round a second time */
+int nested(int n)
+{
+	int t = 0;
+	int i;
+	int j;
+	for (i = 0; i < n; i++)
+	{
+		t = 0;
+		for (j = 0; j < 10; j++)
+		{
+			t = t + 2;
+		}
+
+		if (t == 20)
+		{
+			return t + i + n;
+		}
+	}
+	return 0;
+}
+
+int main()
+{
+	return (f(3, 2) + g(5) + h(4) + squares()) % 256 + (mix(1) == 0 - 1678971256) + nested(3);
+}
@@ -0,0 +1,34 @@
+//result=220
+
+int divide(int a, int b)
+{
+	return a / b;
+}
+
+int modulo(int a, int b)
+{
+	return a % b;
+}
+
+/* without parentheses these all group left to right */
+int mixed(int a, int b, int c)
+{
+	return a % 7 * 100 + a / 8 * 10000 + a / b / c - b - c;
+}
+
+int main()
+{
+	int n = 0 - 47;
+	int s = 0;
+
+	s = s + divide(n, 5) + modulo(n, 5);
+	s = s + (n / 4) + (n % 4);
+	s = s + (n / 7) + (n % 7);
+	s = s + (n / (0 - 3)) + (n % (0 - 3));
+
+	n = 1000;
+	n /= 9;
+	n %= 100;
+
+	return s + n + 100 + mixed(100, 5, 4) % 256;
+}
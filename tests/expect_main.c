@@ -0,0 +1,28 @@
+//result=100
+
+int check(int a, int b)
+{
+	int s = 0;
+	if (__builtin_expect(a == 0, 0))
+	{
+		s = b * 7;
+		s = s + 3;
+	}
+	else
+	{
+		s = a + b;
+	}
+	return s + __builtin_expect(b, 1);
+}
+
+int main()
+{
+	int i = 0;
+	int t = 0;
+	while (__builtin_expect(i < 10, 1))
+	{
+		t = t + check(i, 2);
+		i++;
+	}
+	return t;
+}
@@ -0,0 +1,57 @@
+//result=44
+
+int scale(int x, int k)
+{
+	int s = 0;
+	int i = 0;
+	while (i < k)
+	{
+		s = s + x;
+		i++;
+	}
+	return s;
+}
+
+int distance(int a, int b)
+{
+	if (a < b)
+	{
+		return b - a;
+	}
+	return a - b;
+}
+
+int spin(int n)
+{
+	int s = 0;
+	int i = 0;
+	while (i < n)
+	{
+		s = s + i;
+		i++;
+	}
+	return s;
+}
+
+/* the counter is declared without a value */
+int repeat(int k)
+{
+	int s = 0;
+	int i;
+	for (i = 0; i < 3; i++)
+	{
+		s = s + k;
+	}
+	return s;
+}
+
+int main()
+{
+	int t = 0;
+	int i;
+	for (i = 0; i < 5; i++)
+	{
+		t = t + scale(i, 3);
+	}
+	return t + distance(9, 4) + spin(40000) % 100 + repeat(3);
+}
@@ -0,0 +1,48 @@
+//result=47
+
+int both(int a, int b)
+{
+	if (a < b && b < 10)
+	{
+		return 1;
+	}
+	return 0;
+}
+
+int either(int a, int b)
+{
+	int r = a == 3 || b == 4;
+	return r;
+}
+
+int safe_divide(int a, int b)
+{
+	/* the division is never reached when b is zero */
+	if (b == 0 || a / b == 2)
+	{
+		return 1;
+	}
+	return 0;
+}
+
+int count(int n)
+{
+	int i = 0;
+	int s = 0;
+	while (i < n && s < 20 || i == 0)
+	{
+		s = s + i;
+		i++;
+	}
+	return s;
+}
+
+int main()
+{
+	int s = 0;
+	s = s + both(1, 2) + both(3, 2) * 2 + both(1, 20) * 4;
+	s = s + either(3, 0) * 8 + either(0, 4) * 16 + either(0, 0) * 32;
+	s = s + safe_divide(7, 0) + safe_divide(7, 7) * 2;
+	s = s + count(100);
+	return s;
+}
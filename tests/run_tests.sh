@@ -3,38 +3,42 @@
 # ensure we are in the tests directory
 cd `dirname $0`
 
-for file in *.c
+# once as is, then without calls being evaluated at compile time so the code runs for real
+for flags in "" "-fno-ipa-cp"
 do
-	set -x
-	filename="${file%.*}";
-	
-	# delete any old versions
-	rm "$filename.s";
-	rm "$filename";
+	for file in *.c
+	do
+		set -x
+		filename="${file%.*}";
 
-	# get the expected result
-	expected=$(head -n 1 "$file" | grep -Po '(result=)([0-9]+)' | cut -d '=' -f 2);
-	echo "Running test: $file... expecting $expected";
+		# delete any old versions
+		rm "$filename.s";
+		rm "$filename";
 
-	# compile
-	../bin/pcc $file > /dev/null;
-	set +x
-	if [ ! -f "$filename" ]
-	then
-		echo "$file failed to compile."
-		exit 1
-	fi
+		# get the expected result
+		expected=$(head -n 1 "$file" | grep -Po '(result=)([0-9]+)' | cut -d '=' -f 2);
+		echo "Running test: $file $flags... expecting $expected";
 
-	# make it executible
-	chmod +x "$filename"
+		# compile
+		../bin/pcc $flags $file > /dev/null;
+		set +x
+		if [ ! -f "$filename" ]
+		then
+			echo "$file failed to compile."
+			exit 1
+		fi
 
-	# run and check output is as expected
-	./"$filename"
-	if [ "$?" == "$expected" ]
-	then
-		echo "$file test passed."
-	else
-		echo "$file test failed."
-		exit 1
-	fi
+		# make it executible
+		chmod +x "$filename"
+
+		# run and check output is as expected
+		./"$filename"
+		if [ "$?" == "$expected" ]
+		then
+			echo "$file test passed."
+		else
+			echo "$file test failed."
+			exit 1
+		fi
+	done
 done
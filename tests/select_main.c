@@ -0,0 +1,43 @@
+//result=76
+
+int index(int a, int b, int c)
+{
+	return a + b * 4 + c;
+}
+
+int offset(int a, int b)
+{
+	return a + b * 8 + 12;
+}
+
+int scale(int a)
+{
+	return a * 8 + a * 5 - 3;
+}
+
+int less(int a, int b)
+{
+	return a < b;
+}
+
+int negative(int a)
+{
+	if (a < 0)
+	{
+		return 1;
+	}
+	return 0;
+}
+
+/* x + INT_MIN and x - INT_MIN fold into a lea, wrapping like the add */
+int wrap(int x)
+{
+	int c = 0 - 2147483647;
+	c = c - 1;
+	return (x + c) + (x - c);
+}
+
+int main()
+{
+	return index(1, 2, 3) + offset(1, 2) + scale(2) + less(1, 2) + less(2, 1) + negative(0 - 5) + negative(3) + wrap(5);
+}
@@ -0,0 +1,63 @@
+//result=205
+
+int dense(int x)
+{
+	int r = 0;
+	switch (x)
+	{
+		case 0: r = 10; break;
+		case 1: r = 11; break;
+		case 2:
+		case 3: r = 13; break;
+		case 5: r = 15;
+		case 6: r = r + 1; break;
+		default: r = 99;
+	}
+	return r;
+}
+
+int sparse(int x)
+{
+	switch (x)
+	{
+		case 1: return 1;
+		case 10: return 2;
+		case 100: return 3;
+		case 1000: return 4;
+		case 10000: return 5;
+		case 0 - 7: return 6;
+		case 20: case 21: case 22: case 23: case 24: return 7;
+	}
+	return 0;
+}
+
+int loopy(int n)
+{
+	int i = 0;
+	int s = 0;
+	while (i < n)
+	{
+		switch (i % 4)
+		{
+			case 0: s = s + 1; break;
+			case 1: i++; continue;
+			case 2: s = s + 3;
+			default: s = s + 5;
+		}
+		i++;
+	}
+	return s;
+}
+
+int main()
+{
+	int s = 0;
+	int i = 0 - 3;
+	while (i < 30)
+	{
+		s = s * 3 + dense(i) + sparse(i);
+		i++;
+	}
+	s = s + sparse(1000) * 7 + sparse(10000) + loopy(23);
+	return s % 251;
+}
@@ -0,0 +1,28 @@
+//result=31
+
+/* the inner loop closes to a constant, which leaves the back edge of the outer loop unreachable */
+int first(int y)
+{
+	int x = 2;
+	int i = 0;
+	int d = 0;
+	for (i = 1; i < ((y % 9) + 3); i++)
+	{
+		d = 0;
+		do
+		{
+			d = d + 1;
+		} while (d < 5);
+
+		if (((40357 < d) + 1))
+		{
+			return (i - (0 - 4)) + (d < y);
+		}
+	}
+	return x;
+}
+
+int main()
+{
+	return first(9) + first(0) + first(0 - 3) * 10;
+}
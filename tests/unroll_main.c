@@ -0,0 +1,41 @@
+//result=126
+
+int sum(int n, int k)
+{
+	int s = 0;
+	int i;
+	for (i = 0; i < n; i++)
+	{
+		s = s + i * k;
+	}
+	return s;
+}
+
+int evens(int n)
+{
+	int s = 0;
+	int i = 0;
+	while (i < n)
+	{
+		s = s + 1;
+		i = i + 2;
+	}
+	return s;
+}
+
+/* the step constant is already defined before the loop */
+int ones(int n)
+{
+	int s = 1;
+	int i;
+	for (i = 0; i < n; i++)
+	{
+		s = s + 3;
+	}
+	return s;
+}
+
+int main()
+{
+	return sum(10, 1) + sum(7, 2) + sum(3, 1) + evens(9) + ones(10);
+}